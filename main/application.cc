@@ -810,6 +810,20 @@ void Application::StartListening() {
     }
 }
 
+/*
+ * An early hint that a conversation may follow, e.g. a button pressed down. The protocol may open
+ * its channel in the background, so the click or wake word does not wait for the handshake. The
+ * hint is handled on the main task, where the device state and OpenAudioChannel() live.
+ */
+void Application::PreConnect() {
+    Schedule([this]() {
+        if (protocol_ == nullptr || device_state_ != kDeviceStateIdle || protocol_->IsAudioChannelOpened()) {
+            return;
+        }
+        protocol_->PreConnect();
+    });
+}
+
 void Application::StopListening() {
     if (device_state_ == kDeviceStateAudioTesting) {
         audio_service_.EnableAudioTesting(false);
@@ -942,6 +956,8 @@ void Application::Start() {
         protocol_ = std::make_unique<MqttProtocol>();
     }
 
+    protocol_->SetUplinkFrameDuration(CONFIG_OPUS_UPLINK_FRAME_DURATION);
+    protocol_->SetUplinkBatchFrames(CONFIG_UPLINK_BATCH_MAX_FRAMES);
     protocol_->OnConnected([this]() {
         DismissAlert();
     });
@@ -950,13 +966,15 @@ void Application::Start() {
         last_error_message_ = message;
         xEventGroupSetBits(event_group_, MAIN_EVENT_ERROR);
     });
-    protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
+    protocol_->OnIncomingAudio([this](AudioStreamPacketPtr packet) {
         if (device_state_ == kDeviceStateSpeaking) {
             audio_service_.PushPacketToDecodeQueue(std::move(packet));
         }
     });
     protocol_->OnAudioChannelOpened([this, codec, &board]() {
         board.SetPowerSaveMode(false);
+        audio_service_.PrepareAudioPower(kAudioPowerHintServerHello);
+        audio_service_.SetEncodeFrameDuration(protocol_->uplink_frame_duration());
         if (protocol_->server_sample_rate() != codec->output_sample_rate()) {
             ESP_LOGW(TAG, "服务器采样率 %d 与设备输出采样率 %d 不匹配,重采样可能导致失真",
             protocol_->server_sample_rate(), codec->output_sample_rate());
@@ -970,53 +988,67 @@ void Application::Start() {
             SetDeviceState(kDeviceStateIdle);
         });
     });
-    protocol_->OnIncomingJson([this, display](const cJSON* root) {
-        // Parse JSON data
-        auto type = cJSON_GetObjectItem(root, "type");
-        if (strcmp(type->valuestring, "tts") == 0) {
-            auto state = cJSON_GetObjectItem(root, "state");
-            if (strcmp(state->valuestring, "start") == 0) {
-                Schedule([this]() {
-                    aborted_ = false;
-                    if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
-                        SetDeviceState(kDeviceStateSpeaking);
-                    }
-                });
-            } else if (strcmp(state->valuestring, "stop") == 0) {
-                Schedule([this]() {
-                    if (device_state_ == kDeviceStateSpeaking) {
-                        if (listening_mode_ == kListeningModeManualStop) {
-                            SetDeviceState(kDeviceStateIdle);
-                        } else {
-                            SetDeviceState(kDeviceStateListening);
-                        }
+    // The frequent messages are dispatched from the scanned fields, without a cJSON tree
+    protocol_->OnIncomingMessage("tts", [this, display](const JsonMessage& message) {
+        if (message.state == nullptr) {
+            return;
+        }
+        if (strcmp(message.state, "start") == 0) {
+            audio_service_.PrepareAudioPower(kAudioPowerHintTtsStart);
+            Schedule([this]() {
+                aborted_ = false;
+                if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
+                    SetDeviceState(kDeviceStateSpeaking);
+                }
+            });
+        } else if (strcmp(message.state, "stop") == 0) {
+            Schedule([this]() {
+                if (device_state_ == kDeviceStateSpeaking) {
+                    if (listening_mode_ == kListeningModeManualStop) {
+                        SetDeviceState(kDeviceStateIdle);
+                    } else {
+                        SetDeviceState(kDeviceStateListening);
                     }
-                });
-            } else if (strcmp(state->valuestring, "sentence_start") == 0) {
-                auto text = cJSON_GetObjectItem(root, "text");
-                if (cJSON_IsString(text)) {
-                    ESP_LOGI(TAG, "<< %s", text->valuestring);
-                    Schedule([this, display, message = std::string(text->valuestring)]() {
-                        display->SetChatMessage("assistant", message.c_str());
-                    });
                 }
-            }
-        } else if (strcmp(type->valuestring, "stt") == 0) {
-            auto text = cJSON_GetObjectItem(root, "text");
-            if (cJSON_IsString(text)) {
-                ESP_LOGI(TAG, ">> %s", text->valuestring);
-                Schedule([this, display, message = std::string(text->valuestring)]() {
-                    display->SetChatMessage("user", message.c_str());
+            });
+        } else if (strcmp(message.state, "sentence_start") == 0) {
+            if (message.text != nullptr) {
+                ESP_LOGI(TAG, "<< %s", message.text);
+                Schedule([this, display, text = std::string(message.text)]() {
+                    display->SetChatMessage("assistant", text.c_str());
                 });
             }
-        } else if (strcmp(type->valuestring, "llm") == 0) {
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(emotion)) {
-                Schedule([this, display, emotion_str = std::string(emotion->valuestring)]() {
-                    display->SetEmotion(emotion_str.c_str());
-                });
+        }
+    });
+    protocol_->OnIncomingMessage("stt", [this, display](const JsonMessage& message) {
+        if (message.text != nullptr) {
+            ESP_LOGI(TAG, ">> %s", message.text);
+            Schedule([this, display, text = std::string(message.text)]() {
+                display->SetChatMessage("user", text.c_str());
+            });
+        }
+        Schedule([this]() {
+            // In auto stop mode the recognized text ends the utterance, the PA powers up for the
+            // reply; while the user may still talk it stays off because of the 4G interference
+            if (device_state_ == kDeviceStateListening && listening_mode_ == kListeningModeAutoStop) {
+                audio_service_.PrepareAudioPower(kAudioPowerHintUtteranceEnd);
             }
-        } else if (strcmp(type->valuestring, "mcp") == 0) {
+        });
+    });
+    protocol_->OnIncomingMessage("llm", [this, display](const JsonMessage& message) {
+        if (message.emotion != nullptr) {
+            Schedule([this, display, emotion_str = std::string(message.emotion)]() {
+                display->SetEmotion(emotion_str.c_str());
+            });
+        }
+    });
+    protocol_->OnIncomingJson([this, display](const cJSON* root) {
+        // Parse JSON data
+        auto type = cJSON_GetObjectItem(root, "type");
+        if (!cJSON_IsString(type)) {
+            return;
+        }
+        if (strcmp(type->valuestring, "mcp") == 0) {
             auto payload = cJSON_GetObjectItem(root, "payload");
             if (cJSON_IsObject(payload)) {
                 McpServer::GetInstance().ParseMessage(payload);
@@ -1144,6 +1176,57 @@ void Application::Start() {
 
 }
 
+/*
+ * Send the uplink packets, several per transport write when the server accepted batching.
+ *
+ * Frames are held until the batch is full or holding one more frame would exceed the delay cap.
+ * Nothing is held in realtime mode or outside of listening, so interruptions and the end of an
+ * utterance are not delayed. Returns how long the main loop may wait before the batch is due.
+ */
+TickType_t Application::SendAudioPackets() {
+    auto& latency_tracer = audio_service_.GetLatencyTracer();
+    size_t batch_frames = protocol_ ? protocol_->uplink_batch_frames() : 1;
+    int max_delay_ms = 0;
+    if (batch_frames > 1 && listening_mode_ != kListeningModeRealtime && device_state_ == kDeviceStateListening) {
+        max_delay_ms = CONFIG_UPLINK_BATCH_MAX_DELAY_MS;
+    }
+
+    auto flush = [&]() {
+        uint32_t send_start_us = AudioLatencyTracer::Now();
+        size_t count = uplink_batch_.size();
+        bool sent = protocol_ && protocol_->SendAudioBatch(uplink_batch_);
+        uplink_batch_.clear();
+        if (sent) {
+            for (size_t i = 0; i < count; i++) {
+                latency_tracer.RecordSince(kLatencyStageSend, send_start_us);
+            }
+        }
+        return sent;
+    };
+
+    while (auto packet = audio_service_.PopPacketFromSendQueue()) {
+        if (uplink_batch_.empty()) {
+            uplink_batch_start_us_ = esp_timer_get_time();
+        }
+        uplink_batch_.push_back(std::move(packet));
+        if (uplink_batch_.size() >= batch_frames && !flush()) {
+            return portMAX_DELAY;
+        }
+    }
+    if (uplink_batch_.empty()) {
+        return portMAX_DELAY;
+    }
+
+    int held_ms = (esp_timer_get_time() - uplink_batch_start_us_) / 1000;
+    int frame_duration = protocol_ ? protocol_->uplink_frame_duration() : OPUS_FRAME_DURATION_MS;
+    if (held_ms + frame_duration > max_delay_ms) {
+        flush();
+        return portMAX_DELAY;
+    }
+    // Normally the next frame comes first, this only fires when the utterance ended
+    return pdMS_TO_TICKS(max_delay_ms - held_ms) + 1;
+}
+
 // 向主事件循环添加异步任务
 void Application::Schedule(std::function<void()> callback) {
     {
@@ -1156,25 +1239,24 @@ void Application::Schedule(std::function<void()> callback) {
 // 主事件循环控制聊天状态和WebSocket连接
 // 其他任务如需访问WebSocket或聊天状态,应通过Schedule调用此函数
 void Application::MainEventLoop() {
+    TickType_t timeout = portMAX_DELAY;
     while (true) {
         auto bits = xEventGroupWaitBits(event_group_, MAIN_EVENT_SCHEDULE |
             MAIN_EVENT_SEND_AUDIO |
             MAIN_EVENT_WAKE_WORD_DETECTED |
             MAIN_EVENT_VAD_CHANGE |
             MAIN_EVENT_CLOCK_TICK |
-            MAIN_EVENT_ERROR, pdTRUE, pdFALSE, portMAX_DELAY);
+            MAIN_EVENT_ERROR, pdTRUE, pdFALSE, timeout);
 
         if (bits & MAIN_EVENT_ERROR) {
             SetDeviceState(kDeviceStateIdle);
             Alert(Lang::Strings::ERROR, last_error_message_.c_str(), "circle_xmark", Lang::Sounds::OGG_DISCONNECT);
         }
 
-        if (bits & MAIN_EVENT_SEND_AUDIO) {
-            while (auto packet = audio_service_.PopPacketFromSendQueue()) {
-                if (protocol_ && !protocol_->SendAudio(std::move(packet))) {
-                    break;
-                }
-            }
+        /* A held batch is sent when its delay runs out, even if no event came in */
+        timeout = portMAX_DELAY;
+        if ((bits & MAIN_EVENT_SEND_AUDIO) || !uplink_batch_.empty()) {
+            timeout = SendAudioPackets();
         }
 
         if (bits & MAIN_EVENT_WAKE_WORD_DETECTED) {
@@ -1305,6 +1387,8 @@ void Application::OnWakeWordDetected() {
                 return;
             }
         }
+        audio_service_.GetLatencyTracer().RecordSince(kLatencyStageWakeToChannelOpen,
+            audio_service_.wake_word_detected_us());
 
         auto wake_word = audio_service_.GetLastWakeWord();
         ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
@@ -10,6 +10,7 @@
 #include <mutex>
 #include <deque>
 #include <memory>
+#include <vector>
 
 #include "protocol.h"
 #include "ota.h"
@@ -54,6 +55,7 @@ public:
     void ToggleChatState();
     void StartListening();
     void StopListening();
+    void PreConnect();
     void Reboot();
     void WakeWordInvoke(const std::string& wake_word);
     bool UpgradeFirmware(Ota& ota, const std::string& url = "");
@@ -84,12 +86,16 @@ private:
     int clock_ticks_ = 0;
     TaskHandle_t check_new_version_task_handle_ = nullptr;
     TaskHandle_t main_event_loop_task_handle_ = nullptr;
+    // Uplink packets held for one transport write, owned by the main event loop
+    std::vector<AudioStreamPacketPtr> uplink_batch_;
+    int64_t uplink_batch_start_us_ = 0;
 
     void OnWakeWordDetected();
     void CheckNewVersion(Ota& ota);
     void CheckAssetsVersion();
     void ShowActivationCode(const std::string& code, const std::string& message);
     void SetListeningMode(ListeningMode mode);
+    TickType_t SendAudioPackets();
 
     // MyDazy Periodic status report (HTTP POST to ota_url + "/status")
     esp_timer_handle_t status_timer_handle_ = nullptr;
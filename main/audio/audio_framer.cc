@@ -0,0 +1,97 @@
+#include "audio_framer.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "AudioFramer"
+
+
+PcmRingBuffer::~PcmRingBuffer() {
+    heap_caps_free(buffer_);
+}
+
+bool PcmRingBuffer::Allocate(size_t capacity, uint32_t caps) {
+    heap_caps_free(buffer_);
+    buffer_ = (int16_t*)heap_caps_malloc(capacity * sizeof(int16_t), caps);
+    if (buffer_ == nullptr) {
+        capacity_ = 0;
+        return false;
+    }
+    capacity_ = capacity;
+    read_ = write_ = 0;
+    return true;
+}
+
+size_t PcmRingBuffer::Write(const int16_t* data, size_t samples) {
+    size_t dropped = 0;
+    if (samples > capacity_) {
+        dropped = samples - capacity_;
+        data += dropped;
+        write_ += dropped;
+        samples = capacity_;
+    }
+    size_t offset = write_ % capacity_;
+    size_t first = std::min(samples, capacity_ - offset);
+    memcpy(buffer_ + offset, data, first * sizeof(int16_t));
+    memcpy(buffer_, data + first, (samples - first) * sizeof(int16_t));
+    write_ += samples;
+
+    if (write_ - read_ > capacity_) {
+        dropped += write_ - read_ - capacity_;
+        read_ = write_ - capacity_;
+    }
+    return dropped;
+}
+
+bool PcmRingBuffer::Read(int16_t* data, size_t samples) {
+    if (size() < samples) {
+        return false;
+    }
+    size_t offset = read_ % capacity_;
+    size_t first = std::min(samples, capacity_ - offset);
+    memcpy(data, buffer_ + offset, first * sizeof(int16_t));
+    memcpy(data + first, buffer_, (samples - first) * sizeof(int16_t));
+    read_ += samples;
+    return true;
+}
+
+bool AudioFramer::Initialize(size_t max_frame_samples, size_t max_chunk_samples, uint32_t caps) {
+    max_frame_samples_ = max_frame_samples;
+    frame_.reserve(max_frame_samples);
+    return ring_.Allocate(max_frame_samples + max_chunk_samples, caps);
+}
+
+void AudioFramer::SetFrameSamples(size_t frame_samples) {
+    frame_samples_ = std::min(frame_samples, max_frame_samples_);
+    ring_.Clear();
+}
+
+void AudioFramer::Push(const int16_t* data, size_t samples,
+    const std::function<void(std::vector<int16_t>&& frame)>& on_frame) {
+    if (frame_samples_ == 0 || ring_.capacity() == 0) {
+        return;
+    }
+
+    // Nothing is pending, whole frames go out without passing through the ring
+    if (ring_.size() == 0) {
+        while (samples >= frame_samples_) {
+            frame_.assign(data, data + frame_samples_);
+            on_frame(std::move(frame_));
+            data += frame_samples_;
+            samples -= frame_samples_;
+        }
+    }
+
+    size_t dropped = ring_.Write(data, samples);
+    if (dropped > 0) {
+        dropped_ += dropped;
+        ESP_LOGW(TAG, "Chunk of %u samples does not fit, dropped %u", samples, dropped);
+    }
+    while (ring_.size() >= frame_samples_) {
+        frame_.resize(frame_samples_);
+        ring_.Read(frame_.data(), frame_samples_);
+        on_frame(std::move(frame_));
+    }
+}
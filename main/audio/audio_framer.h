@@ -0,0 +1,68 @@
+#ifndef AUDIO_FRAMER_H
+#define AUDIO_FRAMER_H
+
+#include <functional>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Fixed-capacity circular buffer of 16-bit PCM, allocated once with the given heap caps.
+ *
+ * Writing more than fits drops the oldest samples. Not thread safe, the owner serializes access.
+ */
+class PcmRingBuffer {
+public:
+    PcmRingBuffer() = default;
+    ~PcmRingBuffer();
+    PcmRingBuffer(const PcmRingBuffer&) = delete;
+    PcmRingBuffer& operator=(const PcmRingBuffer&) = delete;
+
+    bool Allocate(size_t capacity, uint32_t caps);
+    void Clear() { read_ = write_; }
+
+    // Returns the number of old samples dropped to make room
+    size_t Write(const int16_t* data, size_t samples);
+    // Copies out exactly `samples` samples, false if fewer are buffered
+    bool Read(int16_t* data, size_t samples);
+
+    size_t size() const { return write_ - read_; }
+    size_t capacity() const { return capacity_; }
+
+private:
+    int16_t* buffer_ = nullptr;
+    size_t capacity_ = 0;
+    uint32_t read_ = 0;         // Samples, both positions only grow
+    uint32_t write_ = 0;
+};
+
+/*
+ * Cuts PCM chunks of any size into frames of exactly frame_samples.
+ *
+ * Only the remainder that does not fill a frame is kept in the ring, whole frames at the start of
+ * a chunk are copied straight to the output. The frame is handed to the callback as an rvalue, a
+ * consumer that swaps it with a pooled buffer gives the framer that buffer to fill next, so after
+ * warm-up framing allocates nothing.
+ */
+class AudioFramer {
+public:
+    // max_chunk_samples is the largest chunk ever pushed, the ring holds it on top of a partial frame
+    bool Initialize(size_t max_frame_samples, size_t max_chunk_samples, uint32_t caps);
+    void SetFrameSamples(size_t frame_samples);
+    void Reset() { ring_.Clear(); }
+
+    void Push(const int16_t* data, size_t samples, const std::function<void(std::vector<int16_t>&& frame)>& on_frame);
+
+    size_t frame_samples() const { return frame_samples_; }
+    // Samples dropped because a chunk was larger than promised
+    uint32_t dropped() const { return dropped_; }
+
+private:
+    PcmRingBuffer ring_;
+    std::vector<int16_t> frame_;
+    size_t frame_samples_ = 0;
+    size_t max_frame_samples_ = 0;
+    uint32_t dropped_ = 0;
+};
+
+#endif // AUDIO_FRAMER_H
@@ -0,0 +1,221 @@
+#include "audio_kernels.h"
+#include "sdkconfig.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if CONFIG_IDF_TARGET_ESP32S3
+// audio_kernels_esp32s3.S, blocks of 8 samples with 16-byte aligned stores
+extern "C" {
+void audio_kernels_interleave_pie(const int16_t* src0, const int16_t* src1, int16_t* dst, size_t blocks);
+int32_t audio_kernels_dot_pie(const int16_t* x, const int16_t* c, size_t pairs);
+void audio_kernels_add_pie(const int16_t* src, int16_t* dst, size_t blocks);
+void audio_kernels_scale_pie(const int16_t* src, int16_t* dst, size_t blocks, const int16_t* gain, bool accumulate);
+}
+
+// Samples to go until ptr is aligned for the vector stores
+static inline size_t SamplesToAlignment(const void* ptr, size_t sample_size) {
+    return ((AUDIO_KERNELS_ALIGNMENT - (uintptr_t)ptr % AUDIO_KERNELS_ALIGNMENT) % AUDIO_KERNELS_ALIGNMENT) / sample_size;
+}
+#endif
+
+template <int kChannels>
+static inline void SelectChannelsFixed(int16_t* data, int first, int second, size_t frames) {
+    const int16_t* src = data;
+    int16_t* dst = data;
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4, src += 4 * kChannels, dst += 8) {
+        // Load the whole block before storing, dst trails src by at least one frame
+        int16_t a0 = src[first], b0 = src[second];
+        int16_t a1 = src[kChannels + first], b1 = src[kChannels + second];
+        int16_t a2 = src[2 * kChannels + first], b2 = src[2 * kChannels + second];
+        int16_t a3 = src[3 * kChannels + first], b3 = src[3 * kChannels + second];
+        dst[0] = a0; dst[1] = b0;
+        dst[2] = a1; dst[3] = b1;
+        dst[4] = a2; dst[5] = b2;
+        dst[6] = a3; dst[7] = b3;
+    }
+    for (; i < frames; i++, src += kChannels, dst += 2) {
+        int16_t a = src[first], b = src[second];
+        dst[0] = a;
+        dst[1] = b;
+    }
+}
+
+template <int kChannels>
+static inline void SplitChannelsFixed(const int16_t* __restrict src, int first, int second,
+    int16_t* __restrict dst0, int16_t* __restrict dst1, size_t frames) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4, src += 4 * kChannels) {
+        dst0[i] = src[first];
+        dst1[i] = src[second];
+        dst0[i + 1] = src[kChannels + first];
+        dst1[i + 1] = src[kChannels + second];
+        dst0[i + 2] = src[2 * kChannels + first];
+        dst1[i + 2] = src[2 * kChannels + second];
+        dst0[i + 3] = src[3 * kChannels + first];
+        dst1[i + 3] = src[3 * kChannels + second];
+    }
+    for (; i < frames; i++, src += kChannels) {
+        dst0[i] = src[first];
+        dst1[i] = src[second];
+    }
+}
+
+void AudioKernels::SelectChannels(int16_t* data, int channels, int first, int second, size_t frames) {
+    switch (channels) {
+    case 2:
+        if (first == 0 && second == 1) {
+            return;
+        }
+        SelectChannelsFixed<2>(data, first, second, frames);
+        break;
+    case 4:
+        SelectChannelsFixed<4>(data, first, second, frames);
+        break;
+    default:
+        for (size_t i = 0; i < frames; i++) {
+            int16_t a = data[i * channels + first];
+            int16_t b = data[i * channels + second];
+            data[i * 2] = a;
+            data[i * 2 + 1] = b;
+        }
+        break;
+    }
+}
+
+void AudioKernels::SplitChannels(const int16_t* src, int channels, int first, int second,
+    int16_t* dst0, int16_t* dst1, size_t frames) {
+    switch (channels) {
+    case 2:
+        SplitChannelsFixed<2>(src, first, second, dst0, dst1, frames);
+        break;
+    case 4:
+        SplitChannelsFixed<4>(src, first, second, dst0, dst1, frames);
+        break;
+    default:
+        for (size_t i = 0; i < frames; i++) {
+            dst0[i] = src[i * channels + first];
+            dst1[i] = src[i * channels + second];
+        }
+        break;
+    }
+}
+
+void AudioKernels::InterleaveChannels(const int16_t* src0, const int16_t* src1, int16_t* dst, size_t frames) {
+    // With src0 == dst + frames, frame i reads dst[frames + i] while the writes so far only
+    // reached dst[2 * i - 1], so the in-place case needs no scratch buffer
+    size_t i = 0;
+#if CONFIG_IDF_TARGET_ESP32S3
+    // A block of 8 frames writes 32 bytes, so a 4-byte aligned dst reaches alignment within 3
+    // frames. The last block is left to the scalar loop: the vector loads read a block ahead, and
+    // in place they stay behind the stores only while a block of the source is still unread.
+    size_t head = SamplesToAlignment(dst, 2 * sizeof(int16_t));
+    if ((uintptr_t)dst % (2 * sizeof(int16_t)) == 0 && frames >= head + 16) {
+        for (; i < head; i++) {
+            int16_t a = src0[i];
+            dst[2 * i] = a;
+            dst[2 * i + 1] = src1[i];
+        }
+        size_t blocks = (frames - head) / 8 - 1;
+        audio_kernels_interleave_pie(src0 + head, src1 + head, dst + 2 * head, blocks);
+        i = head + blocks * 8;
+    }
+#endif
+    for (; i < frames; i++) {
+        int16_t a = src0[i];
+        dst[2 * i] = a;
+        dst[2 * i + 1] = src1[i];
+    }
+}
+
+int16_t AudioKernels::DotProduct(const int16_t* x, const int16_t* c, size_t taps) {
+    int32_t acc;
+#if CONFIG_IDF_TARGET_ESP32S3
+    if (taps % 16 == 0 && (uintptr_t)c % AUDIO_KERNELS_ALIGNMENT == 0) {
+        acc = audio_kernels_dot_pie(x, c, taps / 16);
+    } else
+#endif
+    {
+        // Unrolled so both loads stream forward
+        int32_t acc0 = 0;
+        int32_t acc1 = 0;
+        for (size_t i = 0; i < taps; i += 4) {
+            acc0 += x[i] * c[i] + x[i + 2] * c[i + 2];
+            acc1 += x[i + 1] * c[i + 1] + x[i + 3] * c[i + 3];
+        }
+        acc = acc0 + acc1;
+    }
+    acc = (acc + (1 << 14)) >> 15;
+    if (acc > INT16_MAX) {
+        return INT16_MAX;
+    } else if (acc < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return acc;
+}
+
+static inline int16_t Saturate(int32_t value) {
+    return (int16_t)std::clamp(value, (int32_t)INT16_MIN, (int32_t)INT16_MAX);
+}
+
+template <bool kAccumulate>
+static inline void MixScaledFixed(const int16_t* __restrict src, int16_t* __restrict dst, size_t samples,
+    int32_t gain, int32_t gain_step) {
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        int32_t v0 = (src[i] * gain) >> 15;
+        int32_t v1 = (src[i + 1] * (gain + gain_step)) >> 15;
+        int32_t v2 = (src[i + 2] * (gain + 2 * gain_step)) >> 15;
+        int32_t v3 = (src[i + 3] * (gain + 3 * gain_step)) >> 15;
+        if (kAccumulate) {
+            v0 += dst[i];
+            v1 += dst[i + 1];
+            v2 += dst[i + 2];
+            v3 += dst[i + 3];
+        }
+        dst[i] = Saturate(v0);
+        dst[i + 1] = Saturate(v1);
+        dst[i + 2] = Saturate(v2);
+        dst[i + 3] = Saturate(v3);
+        gain += 4 * gain_step;
+    }
+    for (; i < samples; i++, gain += gain_step) {
+        int32_t v = (src[i] * gain) >> 15;
+        dst[i] = Saturate(kAccumulate ? v + dst[i] : v);
+    }
+}
+
+static void MixScaledScalar(const int16_t* src, int16_t* dst, size_t samples, int32_t gain, int32_t gain_step,
+    bool accumulate) {
+    // The gain is at most 1.0 in Q15, so a product fits in 32 bits before the shift
+    if (accumulate) {
+        MixScaledFixed<true>(src, dst, samples, gain, gain_step);
+    } else {
+        MixScaledFixed<false>(src, dst, samples, gain, gain_step);
+    }
+}
+
+void AudioKernels::MixScaled(const int16_t* src, int16_t* dst, size_t samples, int32_t gain, int32_t gain_step,
+    bool accumulate) {
+    size_t i = 0;
+#if CONFIG_IDF_TARGET_ESP32S3
+    // Outside a fade the gain is steady and the block goes to the vector unit. Unity gain does
+    // not fit a 16-bit lane, but it is an exact copy or a plain saturating add.
+    size_t head = SamplesToAlignment(dst, sizeof(int16_t));
+    if (gain_step == 0 && gain >= 0 && gain <= (1 << 15) && samples >= head + 16) {
+        MixScaledScalar(src, dst, head, gain, 0, accumulate);
+        size_t blocks = (samples - head) / 8 - 1;
+        if (gain < (1 << 15)) {
+            int16_t lane_gain = gain;
+            audio_kernels_scale_pie(src + head, dst + head, blocks, &lane_gain, accumulate);
+        } else if (accumulate) {
+            audio_kernels_add_pie(src + head, dst + head, blocks);
+        } else {
+            memcpy(dst + head, src + head, blocks * 8 * sizeof(int16_t));
+        }
+        i = head + blocks * 8;
+    }
+#endif
+    MixScaledScalar(src + i, dst + i, samples - i, gain + (int32_t)i * gain_step, gain_step, accumulate);
+}
@@ -0,0 +1,47 @@
+#ifndef AUDIO_KERNELS_H
+#define AUDIO_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Vector loads on the ESP32-S3 read this many samples past the data, buffers they stream keep room for it
+#define AUDIO_KERNELS_PADDING 8
+// Alignment in bytes of the vector stores, and of the coefficients of DotProduct()
+#define AUDIO_KERNELS_ALIGNMENT 16
+
+/*
+ * Channel shuffling, filtering and mixing kernels for 16-bit PCM.
+ *
+ * Layouts with 2 or 4 slots per frame, which is what the codecs deliver, go through unrolled
+ * fixed-stride loops; any other layout falls back to a generic loop.
+ *
+ * On the ESP32-S3 InterleaveChannels(), DotProduct() and MixScaled() at a steady gain run on the
+ * PIE vector unit (audio_kernels_esp32s3.S). The samples before the first aligned store and the
+ * last block stay on the scalar loops, which are also what other targets and the host build run.
+ */
+class AudioKernels {
+public:
+    // Keep slots `first` and `second` of every frame as a 2-channel stream, in place.
+    // The output never overtakes the input, so data may be resized to frames * 2 afterwards.
+    static void SelectChannels(int16_t* data, int channels, int first, int second, size_t frames);
+
+    // Copy slots `first` and `second` of every frame into two planar buffers.
+    static void SplitChannels(const int16_t* src, int channels, int first, int second,
+        int16_t* dst0, int16_t* dst1, size_t frames);
+
+    // Interleave two planar buffers into a 2-channel stream.
+    // src0 may alias the upper half of dst (src0 == dst + frames), frames are written front to back.
+    static void InterleaveChannels(const int16_t* src0, const int16_t* src1, int16_t* dst, size_t frames);
+
+    // Q15 dot product of `taps` samples, rounded and saturated to 16 bits. taps is a multiple of
+    // 4; the vector path takes a multiple of 16 with c aligned to AUDIO_KERNELS_ALIGNMENT and
+    // AUDIO_KERNELS_PADDING readable samples after x + taps.
+    static int16_t DotProduct(const int16_t* x, const int16_t* c, size_t taps);
+
+    // dst = src * gain, or dst += src * gain when accumulating, saturated to 16 bits.
+    // The Q15 gain starts at `gain` and moves by `gain_step` every sample, so a fade has no steps.
+    static void MixScaled(const int16_t* src, int16_t* dst, size_t samples, int32_t gain, int32_t gain_step,
+        bool accumulate);
+};
+
+#endif // AUDIO_KERNELS_H
@@ -0,0 +1,95 @@
+#include "audio_latency.h"
+
+static const char* const kStageNames[kLatencyStageCount] = {
+    "process",
+    "encode_queue",
+    "encode",
+    "send_queue",
+    "send",
+    "capture_to_send",
+    "wake_to_first_packet",
+    "wake_to_preroll",
+    "wake_to_channel_open",
+    "jitter",
+    "decode",
+    "resample",
+    "playback_queue",
+    "i2s_write",
+    "receive_to_speaker",
+};
+
+void LatencyHistogram::Record(uint32_t us) {
+    uint32_t index = 0;
+    uint32_t scaled = us / LATENCY_HISTOGRAM_FIRST_BUCKET_US;
+    if (scaled > 0) {
+        index = 32 - __builtin_clz(scaled);
+        if (index >= LATENCY_HISTOGRAM_BUCKETS) {
+            index = LATENCY_HISTOGRAM_BUCKETS - 1;
+        }
+    }
+    buckets_[index]++;
+    count_++;
+    total_us_ += us;
+    if (us > max_us_) {
+        max_us_ = us;
+    }
+}
+
+void LatencyHistogram::Reset() {
+    for (auto& bucket : buckets_) {
+        bucket = 0;
+    }
+    count_ = 0;
+    max_us_ = 0;
+    total_us_ = 0;
+}
+
+uint32_t LatencyHistogram::PercentileUpperUs(int percent) const {
+    uint64_t target = ((uint64_t)count_ * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS - 1; i++) {
+        seen += buckets_[i];
+        if (seen >= target) {
+            return LATENCY_HISTOGRAM_FIRST_BUCKET_US << i;
+        }
+    }
+    return UINT32_MAX;
+}
+
+cJSON* LatencyHistogram::ToJson() const {
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "count", count_);
+    cJSON_AddNumberToObject(json, "avg_us", count_ > 0 ? total_us_ / count_ : 0);
+    cJSON_AddNumberToObject(json, "max_us", max_us_);
+    cJSON* buckets = cJSON_CreateArray();
+    for (auto bucket : buckets_) {
+        cJSON_AddItemToArray(buckets, cJSON_CreateNumber(bucket));
+    }
+    cJSON_AddItemToObject(json, "buckets", buckets);
+    return json;
+}
+
+void AudioLatencyTracer::Reset() {
+    for (auto& histogram : histograms_) {
+        histogram.Reset();
+    }
+}
+
+const char* AudioLatencyTracer::StageName(AudioLatencyStage stage) {
+    return kStageNames[stage];
+}
+
+cJSON* AudioLatencyTracer::ToJson() const {
+    cJSON* json = cJSON_CreateObject();
+    cJSON* bounds = cJSON_CreateArray();
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS - 1; i++) {
+        cJSON_AddItemToArray(bounds, cJSON_CreateNumber(LATENCY_HISTOGRAM_FIRST_BUCKET_US << i));
+    }
+    cJSON_AddItemToObject(json, "bucket_upper_us", bounds);
+    cJSON* stages = cJSON_CreateObject();
+    for (int i = 0; i < kLatencyStageCount; i++) {
+        cJSON_AddItemToObject(stages, kStageNames[i], histograms_[i].ToJson());
+    }
+    cJSON_AddItemToObject(json, "stages", stages);
+    return json;
+}
@@ -0,0 +1,85 @@
+#ifndef AUDIO_LATENCY_H
+#define AUDIO_LATENCY_H
+
+#include <cstdint>
+
+#include <cJSON.h>
+#include <esp_timer.h>
+
+// Bucket i counts latencies below 250us << i, the last bucket is open ended (>= 1024ms)
+#define LATENCY_HISTOGRAM_BUCKETS 14
+#define LATENCY_HISTOGRAM_FIRST_BUCKET_US 250
+
+enum AudioLatencyStage {
+    // Uplink
+    kLatencyStageProcess,           // Audio processor feed -> processed frame
+    kLatencyStageEncodeQueue,       // Encode queue wait
+    kLatencyStageEncode,            // Opus encode
+    kLatencyStageSendQueue,         // Send queue wait
+    kLatencyStageSend,              // Protocol SendAudio
+    kLatencyStageCaptureToSend,     // Audio processor feed -> handed to the protocol
+    kLatencyStageWakeToFirstPacket, // Wake word detected -> first uplink packet handed to the protocol
+    kLatencyStageWakeToPreroll,     // Wake word detected -> first wake word pre-roll packet ready
+    kLatencyStageWakeToChannelOpen, // Wake word detected -> audio channel open, near zero when pre-connected
+    // Downlink
+    kLatencyStageJitter,            // Decode queue and jitter buffer wait
+    kLatencyStageDecode,            // Opus decode
+    kLatencyStageResample,          // Output resampling
+    kLatencyStagePlaybackQueue,     // Playback queue wait
+    kLatencyStageI2sWrite,          // Codec output write
+    kLatencyStageReceiveToSpeaker,  // Received -> written to the codec
+    kLatencyStageCount
+};
+
+class LatencyHistogram {
+public:
+    void Record(uint32_t us);
+    void Reset();
+    cJSON* ToJson() const;
+
+    uint32_t count() const { return count_; }
+    uint32_t max_us() const { return max_us_; }
+    uint32_t average_us() const { return count_ > 0 ? total_us_ / count_ : 0; }
+    // Upper bound of the bucket holding the given percentile, UINT32_MAX if it is the open ended one
+    uint32_t PercentileUpperUs(int percent) const;
+
+private:
+    uint32_t buckets_[LATENCY_HISTOGRAM_BUCKETS] = {};
+    uint32_t count_ = 0;
+    uint32_t max_us_ = 0;
+    uint64_t total_us_ = 0;
+};
+
+/*
+ * Per-stage latency histograms of the audio pipeline.
+ *
+ * Frames carry 32-bit microsecond timestamps (they wrap every 71 minutes, differences stay valid),
+ * and each stage has a single writer task. Recording is a subtraction and a count-leading-zeros,
+ * so the tracer stays enabled in production. Readers may see a histogram mid-update, which is fine
+ * for statistics.
+ */
+class AudioLatencyTracer {
+public:
+    static inline uint32_t Now() { return (uint32_t)esp_timer_get_time(); }
+
+    // Record the time elapsed since start_us, a zero start means the frame carries no timestamp
+    inline void RecordSince(AudioLatencyStage stage, uint32_t start_us) {
+        if (start_us != 0) {
+            histograms_[stage].Record(Now() - start_us);
+        }
+    }
+    inline void Record(AudioLatencyStage stage, uint32_t us) {
+        histograms_[stage].Record(us);
+    }
+
+    void Reset();
+    cJSON* ToJson() const;
+
+    const LatencyHistogram& histogram(AudioLatencyStage stage) const { return histograms_[stage]; }
+    static const char* StageName(AudioLatencyStage stage);
+
+private:
+    LatencyHistogram histograms_[kLatencyStageCount];
+};
+
+#endif // AUDIO_LATENCY_H
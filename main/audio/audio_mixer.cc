@@ -0,0 +1,128 @@
+#include "audio_mixer.h"
+#include "audio_kernels.h"
+
+#include <algorithm>
+
+
+void AudioMixer::Configure(int sample_rate) {
+    hold_samples_ = sample_rate * AUDIO_MIXER_DUCK_HOLD_MS / 1000;
+    ramp_step_ = std::max(1, AUDIO_MIXER_UNITY_GAIN / (sample_rate * AUDIO_MIXER_RAMP_MS / 1000));
+}
+
+void AudioMixer::SetGain(AudioStream stream, int32_t gain) {
+    streams_[stream].gain = std::clamp(gain, 0, AUDIO_MIXER_UNITY_GAIN);
+}
+
+void AudioMixer::SetDuckGain(int32_t gain) {
+    duck_gain_ = std::clamp(gain, 0, AUDIO_MIXER_UNITY_GAIN);
+}
+
+void AudioMixer::Feed(AudioStream stream, const int16_t* pcm, size_t samples) {
+    auto& s = streams_[stream];
+    // A stream that was silent starts at its target, only a gain change while it plays is ramped
+    if (!s.played || clock_ - s.last_active >= hold_samples_) {
+        s.current_gain = GetTargetGain(stream);
+    }
+    s.pcm = pcm;
+    s.offset = 0;
+    s.remaining = samples;
+}
+
+void AudioMixer::Drop(AudioStream stream) {
+    auto& s = streams_[stream];
+    s.pcm = nullptr;
+    s.offset = 0;
+    s.remaining = 0;
+}
+
+bool AudioMixer::empty() const {
+    for (auto& s : streams_) {
+        if (s.remaining > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int32_t AudioMixer::GetTargetGain(int stream) const {
+    int32_t gain = streams_[stream].gain;
+    for (int higher = stream + 1; higher < kAudioStreamCount; higher++) {
+        auto& s = streams_[higher];
+        if (s.remaining > 0 || (s.played && clock_ - s.last_active < hold_samples_)) {
+            return (gain * duck_gain_) >> 15;
+        }
+    }
+    return gain;
+}
+
+void AudioMixer::Advance(int stream, size_t samples) {
+    auto& s = streams_[stream];
+    s.offset += samples;
+    s.remaining -= samples;
+    s.last_active = clock_ + samples;
+    s.played = true;
+    if (s.remaining == 0) {
+        s.pcm = nullptr;
+    }
+}
+
+AudioStream AudioMixer::PassThrough() {
+    int found = kAudioStreamCount;
+    for (int i = 0; i < kAudioStreamCount; i++) {
+        if (streams_[i].remaining == 0) {
+            continue;
+        }
+        if (found != kAudioStreamCount) {
+            return kAudioStreamCount;
+        }
+        found = i;
+    }
+    if (found == kAudioStreamCount) {
+        return kAudioStreamCount;
+    }
+    auto& s = streams_[found];
+    if (s.offset != 0 || s.current_gain != AUDIO_MIXER_UNITY_GAIN || GetTargetGain(found) != AUDIO_MIXER_UNITY_GAIN) {
+        return kAudioStreamCount;
+    }
+    size_t samples = s.remaining;
+    Advance(found, samples);
+    clock_ += samples;
+    return (AudioStream)found;
+}
+
+std::vector<int16_t>& AudioMixer::Mix() {
+    size_t samples = SIZE_MAX;
+    for (auto& s : streams_) {
+        if (s.remaining > 0) {
+            samples = std::min(samples, s.remaining);
+        }
+    }
+    if (samples == SIZE_MAX) {
+        mix_.clear();
+        return mix_;
+    }
+
+    // The buffer keeps its capacity, after the first blocks mixing allocates nothing
+    mix_.resize(samples);
+    bool accumulate = false;
+    for (int i = 0; i < kAudioStreamCount; i++) {
+        auto& s = streams_[i];
+        if (s.remaining == 0) {
+            continue;
+        }
+        int32_t target = GetTargetGain(i);
+        int32_t max_change = (int32_t)std::min<size_t>(samples * ramp_step_, AUDIO_MIXER_UNITY_GAIN);
+        int32_t end = std::clamp(target, s.current_gain - max_change, s.current_gain + max_change);
+        int32_t step = (end - s.current_gain) / (int32_t)samples;
+        AudioKernels::MixScaled(s.pcm + s.offset, mix_.data(), samples, s.current_gain, step, accumulate);
+        s.current_gain += step * (int32_t)samples;
+        if (s.current_gain != end && step == 0) {
+            // A change smaller than one step per sample lands at the end of the block
+            s.current_gain = end;
+        }
+        accumulate = true;
+        Advance(i, samples);
+    }
+    clock_ += samples;
+    return mix_;
+}
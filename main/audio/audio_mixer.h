@@ -0,0 +1,77 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Q15 gains, 1.0 is 32768
+#define AUDIO_MIXER_UNITY_GAIN 32768
+// A higher stream keeps the lower ones ducked for this long after its last block, so gaps do not pump
+#define AUDIO_MIXER_DUCK_HOLD_MS 200
+// Time a gain change takes from full scale to silence, the ducking fades over a fraction of it
+#define AUDIO_MIXER_RAMP_MS 40
+
+// Output streams, in ascending priority
+enum AudioStream {
+    kAudioStreamVoice,      // TTS and the audio test replay
+    kAudioStreamPrompt,     // UI sounds
+    kAudioStreamAlarm,
+    kAudioStreamCount,
+};
+
+/*
+ * Mixes the decoded output streams into the blocks written to the codec.
+ *
+ * Every stream hands over one block at a time, the mixer takes the longest run every active stream
+ * can fill, scales each stream by its gain and by the duck gain while a higher stream plays, and
+ * sums them with saturation into a reused buffer. Gain changes are ramped per sample.
+ *
+ * A lone stream at unity gain is not copied at all, PassThrough() hands its block back as it is,
+ * so with only TTS playing the output path is the same as without the mixer.
+ *
+ * Only the audio output task calls into the mixer, except for SetGain() and SetDuckGain().
+ */
+class AudioMixer {
+public:
+    void Configure(int sample_rate);
+    void SetGain(AudioStream stream, int32_t gain);
+    void SetDuckGain(int32_t gain);
+
+    // The block must stay valid until the stream is no longer active
+    void Feed(AudioStream stream, const int16_t* pcm, size_t samples);
+    void Drop(AudioStream stream);
+    bool active(AudioStream stream) const { return streams_[stream].remaining > 0; }
+    // Samples of the current block already mixed
+    size_t offset(AudioStream stream) const { return streams_[stream].offset; }
+    bool empty() const;
+
+    // The stream whose whole block goes out untouched, consumed; kAudioStreamCount if it has to be mixed
+    AudioStream PassThrough();
+    // Mix the next run of samples, the buffer is owned by the mixer and valid until the next call
+    std::vector<int16_t>& Mix();
+
+private:
+    struct Stream {
+        const int16_t* pcm = nullptr;
+        size_t offset = 0;
+        size_t remaining = 0;
+        std::atomic<int32_t> gain = AUDIO_MIXER_UNITY_GAIN;
+        int32_t current_gain = AUDIO_MIXER_UNITY_GAIN;
+        uint32_t last_active = 0;   // Mixer clock at the end of the last block
+        bool played = false;
+    };
+
+    Stream streams_[kAudioStreamCount];
+    std::vector<int16_t> mix_;
+    std::atomic<int32_t> duck_gain_ = AUDIO_MIXER_UNITY_GAIN / 4;  // -12 dB
+    uint32_t clock_ = 0;            // Samples written so far
+    uint32_t hold_samples_ = 0;
+    int32_t ramp_step_ = AUDIO_MIXER_UNITY_GAIN;   // Largest gain change per sample
+
+    int32_t GetTargetGain(int stream) const;
+    void Advance(int stream, size_t samples);
+};
+
+#endif // AUDIO_MIXER_H
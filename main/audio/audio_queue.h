@@ -0,0 +1,175 @@
+#ifndef AUDIO_QUEUE_H
+#define AUDIO_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+
+/*
+ * Bounded single-producer / single-consumer ring queue used between the audio tasks.
+ *
+ * Push() may only be called from one task and Pop() from one other task at a time, neither of them
+ * ever takes a lock. Wakeups are delivered through event group bits bound with BindEvents():
+ * the readable bit is set after every push and the writable bit after every pop, so each queue
+ * wakes only the task that waits on it, and a bit set before the waiter blocks is never lost.
+ *
+ * Clear() may be called from any task. It does not touch the slots, it only marks everything
+ * pushed so far as discarded; the consumer drops those items on its next Pop(). Discarded items
+ * no longer count against the capacity, and there are slots for twice max_capacity items, so
+ * the producer can refill a cleared queue before the consumer has run. Only a second Clear() of
+ * a full queue with no Pop() in between makes the producer wait for the consumer.
+ *
+ * set_capacity() moves the limit up to max_capacity, so a queue sized by a time budget follows
+ * the frame duration without reallocating.
+ *
+ * peak_size() is the most items queued at once since the last reset_peak_size(), it shows how
+ * much of the budget a queue really needs.
+ */
+template <typename T>
+class AudioQueue {
+public:
+    explicit AudioQueue(size_t capacity, size_t max_capacity = 0) : capacity_(capacity) {
+        if (max_capacity < capacity) {
+            max_capacity = capacity;
+        }
+        max_capacity_ = max_capacity;
+        size_t slots = 1;
+        while (slots < 2 * max_capacity) {
+            slots <<= 1;
+        }
+        mask_ = slots - 1;
+        slots_ = std::make_unique<T[]>(slots);
+    }
+
+    AudioQueue(const AudioQueue&) = delete;
+    AudioQueue& operator=(const AudioQueue&) = delete;
+
+    void BindEvents(EventGroupHandle_t event_group, EventBits_t readable_bit, EventBits_t writable_bit) {
+        event_group_ = event_group;
+        readable_bit_ = readable_bit;
+        writable_bit_ = writable_bit;
+    }
+
+    // Producer side. The item is only moved from when the push succeeds.
+    bool Push(T&& item) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (!HasRoom(tail)) {
+            return false;
+        }
+        slots_[tail & mask_] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        // Only the producer raises the peak, a plain compare is enough
+        size_t queued = size();
+        if (queued > peak_size_.load(std::memory_order_relaxed)) {
+            peak_size_.store(queued, std::memory_order_relaxed);
+        }
+        Signal(readable_bit_);
+        return true;
+    }
+
+    // Consumer side.
+    bool Pop(T& item) {
+        uint32_t head = Reclaim();
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(slots_[head & mask_]);
+        slots_[head & mask_] = T();
+        head_.store(head + 1, std::memory_order_release);
+        Signal(writable_bit_);
+        return true;
+    }
+
+    void Clear() {
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        uint32_t flush = flush_.load(std::memory_order_relaxed);
+        while ((int32_t)(tail - flush) > 0 &&
+            !flush_.compare_exchange_weak(flush, tail, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+        // The consumer drops the items, a producer waiting for room may push again right away
+        Signal(readable_bit_ | writable_bit_);
+    }
+
+    size_t size() const {
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        uint32_t flush = flush_.load(std::memory_order_acquire);
+        if ((int32_t)(flush - head) > 0) {
+            head = flush;
+        }
+        return (int32_t)(tail - head) > 0 ? tail - head : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+    bool full() const { return !HasRoom(tail_.load(std::memory_order_acquire)); }
+    size_t capacity() const { return capacity_.load(std::memory_order_relaxed); }
+    size_t peak_size() const { return peak_size_.load(std::memory_order_relaxed); }
+    void reset_peak_size() { peak_size_.store(0, std::memory_order_relaxed); }
+
+    // Items already queued beyond a lowered capacity stay queued, the producer just waits longer
+    void set_capacity(size_t capacity) {
+        if (capacity < 1) {
+            capacity = 1;
+        }
+        if (capacity > max_capacity_) {
+            capacity = max_capacity_;
+        }
+        capacity_.store(capacity, std::memory_order_relaxed);
+        Signal(writable_bit_);
+    }
+
+private:
+    std::unique_ptr<T[]> slots_;
+    std::atomic<size_t> capacity_;
+    size_t max_capacity_ = 0;
+    uint32_t mask_ = 0;
+    std::atomic<uint32_t> head_ = 0;
+    std::atomic<uint32_t> tail_ = 0;
+    std::atomic<uint32_t> flush_ = 0;
+    std::atomic<size_t> peak_size_ = 0;
+    EventGroupHandle_t event_group_ = nullptr;
+    EventBits_t readable_bit_ = 0;
+    EventBits_t writable_bit_ = 0;
+
+    void Signal(EventBits_t bits) {
+        if (event_group_ != nullptr && bits != 0) {
+            xEventGroupSetBits(event_group_, bits);
+        }
+    }
+
+    // Whether the producer may push at tail: the items after the last Clear() are below the
+    // capacity, and the slot is not still held by a discarded item the consumer has not dropped
+    bool HasRoom(uint32_t tail) const {
+        uint32_t head = head_.load(std::memory_order_acquire);
+        if (tail - head > mask_) {
+            return false;
+        }
+        uint32_t flush = flush_.load(std::memory_order_acquire);
+        if ((int32_t)(flush - head) > 0) {
+            head = flush;
+        }
+        return tail - head < capacity();
+    }
+
+    // Drop the items discarded by Clear(), only called by the consumer
+    uint32_t Reclaim() {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t flush = flush_.load(std::memory_order_acquire);
+        if ((int32_t)(flush - head) <= 0) {
+            return head;
+        }
+        while (head != flush) {
+            slots_[head & mask_] = T();
+            head++;
+        }
+        head_.store(head, std::memory_order_release);
+        Signal(writable_bit_);
+        return head;
+    }
+};
+
+#endif // AUDIO_QUEUE_H
@@ -1,23 +1,68 @@
 #include "audio_service.h"
 #include <esp_log.h>
-#include <cstring>
+#include <esp_memory_utils.h>
+#include <algorithm>
+#include <iterator>
 
+#include "audio_kernels.h"
+#include "jitter_buffer.h"
+
+#if CONFIG_USE_AUDIO_PROCESSOR
 #include "processors/afe_audio_processor.h"
+#else
+#include "processors/no_audio_processor.h"
+#endif
 
+#if CONFIG_IDF_TARGET_ESP32S3 || CONFIG_IDF_TARGET_ESP32P4
 #include "wake_words/afe_wake_word.h"
 #include "wake_words/custom_wake_word.h"
+#else
+#include "wake_words/esp_wake_word.h"
+#endif
 
 #define TAG "AudioService"
 
+// The codec paths each leading signal predicts, indexed by AudioPowerHint
+#define AUDIO_POWER_INPUT  (1 << 0)
+#define AUDIO_POWER_OUTPUT (1 << 1)
+static const struct {
+    const char* name;
+    int paths;
+} kAudioPowerHints[] = {
+    { "button", AUDIO_POWER_INPUT | AUDIO_POWER_OUTPUT },   // A prompt sound, then listening
+    { "touch", AUDIO_POWER_INPUT | AUDIO_POWER_OUTPUT },
+    { "stt", AUDIO_POWER_OUTPUT },                          // The server closed the utterance, its reply follows
+    { "hello", AUDIO_POWER_INPUT },                         // Listening starts once the channel opens
+    { "tts_start", AUDIO_POWER_OUTPUT },
+};
+
+static const char* GetPowerHintName(int hint) {
+    return hint >= 0 ? kAudioPowerHints[hint].name : "demand";
+}
 
 AudioService::AudioService() {
     event_group_ = xEventGroupCreate();
+    queue_event_group_ = xEventGroupCreate();
+
+    audio_encode_queue_.BindEvents(queue_event_group_, AS_QUEUE_ENCODE_READABLE, AS_QUEUE_ENCODE_WRITABLE);
+    audio_decode_queue_.BindEvents(queue_event_group_, AS_QUEUE_DECODE_READABLE, AS_QUEUE_DECODE_WRITABLE);
+    audio_send_queue_.BindEvents(queue_event_group_, 0, AS_QUEUE_SEND_WRITABLE);
+    audio_playback_queue_.BindEvents(queue_event_group_, AS_QUEUE_PLAYBACK_READABLE, AS_QUEUE_PLAYBACK_WRITABLE);
+    // Played back through the decode path once testing stops
+    audio_testing_queue_.BindEvents(queue_event_group_, AS_QUEUE_DECODE_READABLE, 0);
+    for (auto& sound : sound_streams_) {
+        sound.packets.BindEvents(queue_event_group_, AS_QUEUE_DECODE_READABLE, AS_QUEUE_SOUND_WRITABLE);
+        sound.playback.BindEvents(queue_event_group_, AS_QUEUE_PLAYBACK_READABLE, AS_QUEUE_PLAYBACK_WRITABLE);
+    }
 }
 
 AudioService::~AudioService() {
     if (event_group_ != nullptr) {
         vEventGroupDelete(event_group_);
     }
+    if (queue_event_group_ != nullptr) {
+        vEventGroupDelete(queue_event_group_);
+    }
 }
 
 
@@ -28,12 +73,19 @@ void AudioService::Initialize(AudioCodec* codec) {
     /* Setup the audio codec */
     opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
     opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_->SetComplexity(0);
+    opus_encoder_->SetComplexity(complexity_controller_.complexity());
+#if CONFIG_USE_UPLINK_VAD_GATE
+    /* Keepalive and trailing silence frames shrink to a few bytes */
+    opus_encoder_->SetDtx(true);
+#endif
 
     if (codec->input_sample_rate() != 16000) {
         input_resampler_.Configure(codec->input_sample_rate(), 16000);
         reference_resampler_.Configure(codec->input_sample_rate(), 16000);
     }
+    playout_clock_.Configure(codec->output_sample_rate(), AUDIO_CODEC_DMA_DESC_NUM * AUDIO_CODEC_DMA_FRAME_NUM,
+        AUDIO_CODEC_DMA_FRAME_NUM);
+    audio_mixer_.Configure(codec->output_sample_rate());
 
 #if CONFIG_USE_AUDIO_PROCESSOR
     audio_processor_ = std::make_unique<AfeAudioProcessor>();
@@ -63,6 +115,19 @@ void AudioService::Initialize(AudioCodec* codec) {
         .skip_unhandled_events = true,
     };
     esp_timer_create(&audio_power_timer_args, &audio_power_timer_);
+
+    /* Hints arrive from button, touch and network tasks, the codec is switched in the timer task */
+    esp_timer_create_args_t audio_power_up_timer_args = {
+        .callback = [](void* arg) {
+            AudioService* audio_service = (AudioService*)arg;
+            audio_service->ApplyPowerHints();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "audio_power_up",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&audio_power_up_timer_args, &audio_power_up_timer_);
 }
 
 void AudioService::Start() {
@@ -86,27 +151,39 @@ void AudioService::Start() {
     }, "audio_output", 2048 * 2, this, 4, &audio_output_task_handle_);
 
 
-    /* Start the opus codec task */
-    xTaskCreate([](void* arg) {
+    /* Start the opus decode and encode tasks, a slow encode must not hold up playback */
+    xTaskCreatePinnedToCore([](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
-        audio_service->OpusCodecTask();
+        audio_service->OpusDecodeTask();
         vTaskDelete(NULL);
-    }, "opus_codec", 2048 * 13, this, 2, &opus_codec_task_handle_);
+    }, "opus_decode", 2048 * 8, this, CONFIG_OPUS_DECODE_TASK_PRIORITY, &opus_decode_task_handle_,
+        CONFIG_OPUS_DECODE_TASK_CORE < 0 ? tskNO_AFFINITY : CONFIG_OPUS_DECODE_TASK_CORE);
+
+    xTaskCreatePinnedToCore([](void* arg) {
+        AudioService* audio_service = (AudioService*)arg;
+        audio_service->OpusEncodeTask();
+        vTaskDelete(NULL);
+    }, "opus_encode", 2048 * 13, this, CONFIG_OPUS_ENCODE_TASK_PRIORITY, &opus_encode_task_handle_,
+        CONFIG_OPUS_ENCODE_TASK_CORE < 0 ? tskNO_AFFINITY : CONFIG_OPUS_ENCODE_TASK_CORE);
 }
 
 void AudioService::Stop() {
     esp_timer_stop(audio_power_timer_);
+    esp_timer_stop(audio_power_up_timer_);
     service_stopped_ = true;
     xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING |
         AS_EVENT_WAKE_WORD_RUNNING |
         AS_EVENT_AUDIO_PROCESSOR_RUNNING);
 
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    audio_encode_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    audio_encode_queue_.Clear();
+    audio_decode_queue_.Clear();
+    audio_playback_queue_.Clear();
+    audio_testing_queue_.Clear();
+    for (auto& sound : sound_streams_) {
+        sound.packets.Clear();
+        sound.playback.Clear();
+    }
+    xEventGroupSetBits(queue_event_group_, AS_QUEUE_ALL_EVENTS);
 }
 
 // bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
@@ -172,10 +249,16 @@ extern "C" {
     extern bool headset_present;
 }
 bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
-   if (!codec_->input_enabled()) {
-        esp_timer_stop(audio_power_timer_);
-        esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
-        codec_->EnableInput(true);
+    if (!codec_->input_enabled()) {
+        PowerUpInput();
+    }
+    if (input_power_hint_ >= 0) {
+        int hint = input_power_hint_.exchange(-1);
+        if (hint >= 0) {
+            power_statistics_.used++;
+            ESP_LOGI(TAG, "Input powered up by %s was used after %lld ms", GetPowerHintName(hint),
+                (esp_timer_get_time() - input_power_up_time_) / 1000);
+        }
     }
     int capture_channels = 4;  // 4个MIC
     int processing_channels = 2;    // 处理2个通道
@@ -185,69 +268,32 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
     int reference_slot = headset_present ? 1 : 1; // 耳机插入时使用通道2，否则使用通道2  
 
     if (codec_->input_sample_rate() != sample_rate) {
-        data.resize(samples * codec_->input_sample_rate() / sample_rate * capture_channels);
+        size_t frames = samples * codec_->input_sample_rate() / sample_rate;
+        data.resize(frames * capture_channels);
         if (!codec_->InputData(data)) {
             return false;
         }
-        if (capture_channels == 4 && processing_channels == 2) {  // 这里直接写死，用4个MIC处理2个通道：插入耳机时使用通道4，否则使用通道1
-            auto ch0 = std::vector<int16_t>(data.size() / 4);
-            auto ch1 = std::vector<int16_t>(data.size() / 4);
-            for (size_t i = 0, j = 0; i < ch0.size(); ++i, j += 4) {
-                // ch0[i] = data[j + AUDIO_TDM_PRIMARY_SLOT];
-                // ch1[i] = data[j + AUDIO_TDM_REFERENCE_SLOT];
-                ch0[i] = data[j + primary_slot];
-                ch1[i] = data[j + reference_slot];
-            }
-            auto resampled_ch0 = std::vector<int16_t>(input_resampler_.GetOutputSamples(ch0.size()));
-            auto resampled_ch1 = std::vector<int16_t>(reference_resampler_.GetOutputSamples(ch1.size()));
-            input_resampler_.Process(ch0.data(), ch0.size(), resampled_ch0.data());
-            reference_resampler_.Process(ch1.data(), ch1.size(), resampled_ch1.data());
-            data.resize(resampled_ch0.size() + resampled_ch1.size());
-            for (size_t i = 0, j = 0; i < resampled_ch0.size(); ++i, j += 2) {
-                data[j] = resampled_ch0[i];
-                data[j + 1] = resampled_ch1[i];
-            }
-        } else if (processing_channels == 2) {
-            auto mic_channel = std::vector<int16_t>(data.size() / 2);
-            auto reference_channel = std::vector<int16_t>(data.size() / 2);
-            for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
-                mic_channel[i] = data[j];
-                reference_channel[i] = data[j + 1];
-            }
-            auto resampled_mic = std::vector<int16_t>(input_resampler_.GetOutputSamples(mic_channel.size()));
-            auto resampled_reference = std::vector<int16_t>(reference_resampler_.GetOutputSamples(reference_channel.size()));
-            input_resampler_.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
-            reference_resampler_.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
-            data.resize(resampled_mic.size() + resampled_reference.size());
-            for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
-                data[j] = resampled_mic[i];
-                data[j + 1] = resampled_reference[i];
-            }
-        } else {
-            auto resampled = std::vector<int16_t>(input_resampler_.GetOutputSamples(data.size()));
-            input_resampler_.Process(data.data(), data.size(), resampled.data());
-            data = std::move(resampled);
-        }
+        // 这里直接写死，用4个MIC处理2个通道：插入耳机时使用通道4，否则使用通道1
+        // The scratch buffers keep their capacity, only the first read allocates
+        mic_channel_.resize(frames);
+        reference_channel_.resize(frames);
+        AudioKernels::SplitChannels(data.data(), capture_channels, primary_slot, reference_slot,
+            mic_channel_.data(), reference_channel_.data(), frames);
+
+        // Resample the mic channel straight into the upper half of data, then interleave in place
+        size_t output_frames = input_resampler_.GetOutputSamples(frames);
+        resampled_reference_.resize(reference_resampler_.GetOutputSamples(frames));
+        data.resize(output_frames * processing_channels);
+        input_resampler_.Process(mic_channel_.data(), frames, data.data() + output_frames);
+        reference_resampler_.Process(reference_channel_.data(), frames, resampled_reference_.data());
+        AudioKernels::InterleaveChannels(data.data() + output_frames, resampled_reference_.data(), data.data(), output_frames);
     } else {
         data.resize(samples * capture_channels);
         if (!codec_->InputData(data)) {
             return false;
         }
-        if (capture_channels == 4 && processing_channels == 2) {
-            auto ch0 = std::vector<int16_t>(data.size() / 4);
-            auto ch1 = std::vector<int16_t>(data.size() / 4);
-            for (size_t i = 0, j = 0; i < ch0.size(); ++i, j += 4) {
-                // ch0[i] = data[j + AUDIO_TDM_PRIMARY_SLOT];
-                // ch1[i] = data[j + AUDIO_TDM_REFERENCE_SLOT];
-                ch0[i] = data[j + primary_slot];
-                ch1[i] = data[j + reference_slot];
-            }
-            data.resize(ch0.size() + ch1.size());
-            for (size_t i = 0, j = 0; i < ch0.size(); ++i, j += 2) {
-                data[j] = ch0[i];
-                data[j + 1] = ch1[i];
-            }
-        }
+        AudioKernels::SelectChannels(data.data(), capture_channels, primary_slot, reference_slot, samples);
+        data.resize(samples * processing_channels);
     }
 
     /* Update the last input time */
@@ -276,7 +322,7 @@ void AudioService::AudioInputTask() {
 #if AUDIO_MIC4_LOOPBACK_TEST
         {
             std::vector<int16_t> data;
-            int samples = OPUS_FRAME_DURATION_MS * codec_->output_sample_rate() / 1000;
+            int samples = encode_frame_duration_ * codec_->output_sample_rate() / 1000;
             if (ReadAudioData(data, codec_->output_sample_rate(), samples)) {
                 if (codec_->input_channels() > 1) {
                     size_t channels = static_cast<size_t>(codec_->input_channels());
@@ -293,9 +339,7 @@ void AudioService::AudioInputTask() {
                 }
 
                 if (!codec_->output_enabled()) {
-                    esp_timer_stop(audio_power_timer_);
-                    esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
-                    codec_->EnableOutput(true);
+                    PowerUpOutput();
                 }
                 codec_->OutputData(data);
                 last_output_time_ = std::chrono::steady_clock::now();
@@ -310,23 +354,32 @@ void AudioService::AudioInputTask() {
         if (service_stopped_) {
             break;
         }
+        /* Wait for the mic to settle only if it was powered up or the speaker played just now */
         if (audio_input_need_warmup_) {
             audio_input_need_warmup_ = false;
-            vTaskDelay(pdMS_TO_TICKS(120));
-            continue;
+            if (!codec_->input_enabled()) {
+                PowerUpInput();
+            }
+            int64_t wait_us = std::max(input_settle_time_.load(), output_quiet_time_.load()) - esp_timer_get_time();
+            if (wait_us > 0) {
+                vTaskDelay(pdMS_TO_TICKS((wait_us + 999) / 1000));
+                continue;
+            }
+            power_statistics_.warmups_skipped++;
         }
 
 
 
         /* Used for audio testing in NetworkConfiguring mode by clicking the BOOT button */
         if (bits & AS_EVENT_AUDIO_TESTING_RUNNING) {
-            if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
-                ESP_LOGW(TAG, "Audio testing queue is full, stopping audio testing");
+            bool full = testing_to_flash_ ? testing_writer_.failed() : audio_testing_queue_.full();
+            if (full) {
+                ESP_LOGW(TAG, "Audio testing recording is full, stopping audio testing");
                 EnableAudioTesting(false);
                 continue;
             }
             std::vector<int16_t> data;
-            int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
+            int samples = encode_frame_duration_ * 16000 / 1000;
             if (ReadAudioData(data, 16000, samples)) {
                 // If input channels is 2, we need to fetch the left channel data
                 if (codec_->input_channels() == 2) {
@@ -343,11 +396,10 @@ void AudioService::AudioInputTask() {
 
         /* Feed the wake word */
         if (bits & AS_EVENT_WAKE_WORD_RUNNING) {
-            std::vector<int16_t> data;
             int samples = wake_word_->GetFeedSize();
             if (samples > 0) {
-                if (ReadAudioData(data, 16000, samples)) {
-                    wake_word_->Feed(data);
+                if (ReadAudioData(input_frame_, 16000, samples)) {
+                    wake_word_->Feed(input_frame_);
                     continue;
                 }
             }
@@ -355,11 +407,12 @@ void AudioService::AudioInputTask() {
 
         /* Feed the audio processor */
         if (bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
-            std::vector<int16_t> data;
             int samples = audio_processor_->GetFeedSize();
             if (samples > 0) {
-                if (ReadAudioData(data, 16000, samples)) {
-                    audio_processor_->Feed(std::move(data));
+                if (ReadAudioData(input_frame_, 16000, samples)) {
+                    last_feed_us_ = AudioLatencyTracer::Now();
+                    // A processor that passes the frame on gets a pooled buffer back in its place
+                    audio_processor_->Feed(std::move(input_frame_));
                     continue;
                 }
             }
@@ -375,117 +428,243 @@ void AudioService::AudioInputTask() {
 
 void AudioService::AudioOutputTask() {
     while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() { return !audio_playback_queue_.empty() || service_stopped_; });
         if (service_stopped_) {
             break;
         }
 
-        auto task = std::move(audio_playback_queue_.front());
-        audio_playback_queue_.pop_front();
-        audio_queue_cv_.notify_all();
-        lock.unlock();
+        /* Give every stream that finished its block the next one */
+        for (int i = 0; i < kAudioStreamCount; i++) {
+            auto stream = (AudioStream)i;
+            if (audio_mixer_.active(stream)) {
+                continue;
+            }
+            auto& queue = stream == kAudioStreamVoice ? audio_playback_queue_ : GetSoundStream(stream).playback;
+            auto& task = mixer_tasks_[i];
+            if (queue.Pop(task)) {
+                latency_tracer_.RecordSince(kLatencyStagePlaybackQueue, task->queued_us);
+                audio_mixer_.Feed(stream, task->pcm.data(), task->pcm.size());
+            } else {
+                task.reset();
+            }
+        }
+        if (audio_mixer_.empty()) {
+            xEventGroupWaitBits(queue_event_group_, AS_QUEUE_PLAYBACK_READABLE, pdTRUE, pdFALSE, portMAX_DELAY);
+            continue;
+        }
+
+        /* Only the voice stream carries timestamps, the block starts `offset` samples into its task */
+        auto& voice = mixer_tasks_[kAudioStreamVoice];
+        bool voice_active = audio_mixer_.active(kAudioStreamVoice);
+        size_t voice_offset = audio_mixer_.offset(kAudioStreamVoice);
+        uint32_t starting_origin_us[kAudioStreamCount] = {};
+        for (int i = 0; i < kAudioStreamCount; i++) {
+            if (audio_mixer_.active((AudioStream)i) && audio_mixer_.offset((AudioStream)i) == 0) {
+                starting_origin_us[i] = mixer_tasks_[i]->origin_us;
+            }
+        }
+        AudioStream passthrough = audio_mixer_.PassThrough();
+        std::vector<int16_t>& pcm = passthrough != kAudioStreamCount ? mixer_tasks_[passthrough]->pcm : audio_mixer_.Mix();
 
         if (!codec_->output_enabled()) {
-            esp_timer_stop(audio_power_timer_);
-            esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
-            codec_->EnableOutput(true);
+            PowerUpOutput();
+        }
+        if (output_power_hint_ >= 0) {
+            int hint = output_power_hint_.exchange(-1);
+            if (hint >= 0) {
+                power_statistics_.used++;
+                ESP_LOGI(TAG, "Output powered up by %s was used after %lld ms", GetPowerHintName(hint),
+                    (esp_timer_get_time() - output_power_up_time_) / 1000);
+            }
+        }
+        uint32_t write_start_us = AudioLatencyTracer::Now();
+        codec_->OutputData(pcm);
+        uint32_t write_end_us = AudioLatencyTracer::Now();
+        /* The block just queued plays out over the next DMA ring, the mic hears it until then */
+        output_quiet_time_ = esp_timer_get_time() + (AUDIO_CODEC_DMA_DESC_NUM * AUDIO_CODEC_DMA_FRAME_NUM * 1000000LL /
+            codec_->output_sample_rate()) + AUDIO_INPUT_WARMUP_MS * 1000;
+        latency_tracer_.RecordSince(kLatencyStageI2sWrite, write_start_us);
+#if CONFIG_USE_SERVER_AEC
+        /* Place the block on the speaker timeline for server AEC, untimed audio still takes up DMA room */
+        uint32_t timestamp = 0;
+        uint32_t delay_us = 0;
+        if (voice_active && voice->timestamp > 0) {
+            timestamp = voice->timestamp + voice_offset * 1000 / codec_->output_sample_rate();
+            delay_us = voice->delay_us;
+        }
+        playout_clock_.OnWrite(timestamp, pcm.size(), delay_us, write_start_us, write_end_us);
+#endif
+        for (int i = 0; i < kAudioStreamCount; i++) {
+            latency_tracer_.RecordSince(kLatencyStageReceiveToSpeaker, starting_origin_us[i]);
         }
-        codec_->OutputData(task->pcm);
 
         /* Update the last output time */
         last_output_time_ = std::chrono::steady_clock::now();
         debug_statistics_.playback_count++;
-
-#if CONFIG_USE_SERVER_AEC
-        /* Record the timestamp for server AEC */
-        if (task->timestamp > 0) {
-            lock.lock();
-            timestamp_queue_.push_back(task->timestamp);
-        }
-#endif
     }
 
     ESP_LOGW(TAG, "Audio output task stopped");
 }
 
-void AudioService::OpusCodecTask() {
+void AudioService::OpusDecodeTask() {
+    TickType_t timeout = portMAX_DELAY;
     while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() {
-            return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
-                (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
-        });
-        if (service_stopped_) {
-            break;
-        }
+        xEventGroupWaitBits(queue_event_group_, AS_QUEUE_DECODE_READABLE | AS_QUEUE_PLAYBACK_WRITABLE,
+            pdTRUE, pdFALSE, timeout);
+
+        /* Keep decoding until no progress can be made, bits set meanwhile stay latched */
+        bool busy = true;
+        while (busy && !service_stopped_) {
+            busy = false;
+
+            if (jitter_buffer_reset_.exchange(false)) {
+                LogJitterBufferStats();
+                jitter_buffer_.Reset();
+                testing_reader_.Close();
+                testing_replaying_ = false;
+            }
+
+            /* Local sounds go first, their frames are ready and short, TTS keeps its own queue */
+            for (auto& sound : sound_streams_) {
+                busy |= ServiceSoundStream(sound);
+            }
 
-        /* Decode the audio from decode queue */
-        if (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
-            auto packet = std::move(audio_decode_queue_.front());
-            audio_decode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
+            /* Move the packets from decode queue into the jitter buffer, or replay the testing queue once testing stops */
+            int64_t now_ms = esp_timer_get_time() / 1000;
+            AudioStreamPacketPtr packet;
+            while (!jitter_buffer_.full() && (audio_decode_queue_.Pop(packet) ||
+                (!(xEventGroupGetBits(event_group_) & AS_EVENT_AUDIO_TESTING_RUNNING) && PopTestingPacket(packet)))) {
+                jitter_buffer_.Put(std::move(packet), now_ms);
+            }
 
-            auto task = std::make_unique<AudioTask>();
+            /* Decode the next frame in sequence order, a missing frame is concealed */
+            if (audio_playback_queue_.full()) {
+                continue;
+            }
+            JitterBuffer::PullResult result = jitter_buffer_.Pull(packet, now_ms);
+            if (result == JitterBuffer::kPullNone) {
+                continue;
+            }
+            busy = true;
+            int64_t start_time = esp_timer_get_time();
+            auto task = audio_task_pool_.Acquire();
             task->type = kAudioTaskTypeDecodeToPlaybackQueue;
-            task->timestamp = packet->timestamp;
-
-            SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
-            if (opus_decoder_->Decode(std::move(packet->payload), task->pcm)) {
-                // Resample if the sample rate is different
+            uint32_t decode_start_us = AudioLatencyTracer::Now();
+
+            // Decode into task->pcm and resample it in place, the pooled buffer keeps its capacity
+            bool decoded;
+            if (result == JitterBuffer::kPullPacket) {
+                latency_tracer_.RecordSince(kLatencyStageJitter, packet->queued_us);
+                task->timestamp = packet->timestamp;
+                task->origin_us = packet->origin_us;
+                SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
+                decoded = opus_decoder_->Decode(std::move(packet->payload), task->pcm);
+            } else {
+                // An empty payload makes the decoder run packet loss concealment for one frame
+                decoded = opus_decoder_->Decode(std::vector<uint8_t>(), task->pcm);
+                if (decoded) {
+                    jitter_buffer_.OnConcealed();
+                }
+            }
+            if (decoded) {
+                latency_tracer_.RecordSince(kLatencyStageDecode, decode_start_us);
                 if (opus_decoder_->sample_rate() != codec_->output_sample_rate()) {
-                    int target_size = output_resampler_.GetOutputSamples(task->pcm.size());
-                    std::vector<int16_t> resampled(target_size);
-                    output_resampler_.Process(task->pcm.data(), task->pcm.size(), resampled.data());
-                    task->pcm = std::move(resampled);
+                    uint32_t resample_start_us = AudioLatencyTracer::Now();
+                    output_resampler_.Process(task->pcm);
+                    task->delay_us = output_resampler_.delay_us();
+                    latency_tracer_.RecordSince(kLatencyStageResample, resample_start_us);
                 }
-
-                lock.lock();
-                audio_playback_queue_.push_back(std::move(task));
-                audio_queue_cv_.notify_all();
+                task->queued_us = AudioLatencyTracer::Now();
+                audio_playback_queue_.Push(std::move(task));
             } else {
                 ESP_LOGE(TAG, "Failed to decode audio");
-                lock.lock();
             }
+            decode_statistics_.Record(esp_timer_get_time() - start_time, opus_decoder_->duration_ms());
             debug_statistics_.decode_count++;
         }
-        
-        /* Encode the audio to send queue */
-        if (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) {
-            auto task = std::move(audio_encode_queue_.front());
-            audio_encode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
 
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->frame_duration = OPUS_FRAME_DURATION_MS;
+        if (service_stopped_) {
+            break;
+        }
+
+        /* Wake up in time to release the packets held by the jitter buffer */
+        timeout = portMAX_DELAY;
+        if (!audio_playback_queue_.full()) {
+            int wakeup_ms = jitter_buffer_.NextWakeupMs(esp_timer_get_time() / 1000);
+            if (wakeup_ms >= 0) {
+                timeout = (wakeup_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+            }
+        }
+    }
+
+    ESP_LOGW(TAG, "Opus decode task stopped");
+}
+
+void AudioService::OpusEncodeTask() {
+    while (true) {
+        xEventGroupWaitBits(queue_event_group_, AS_QUEUE_ENCODE_READABLE | AS_QUEUE_SEND_WRITABLE,
+            pdTRUE, pdFALSE, portMAX_DELAY);
+
+        /* Keep encoding until no progress can be made, bits set meanwhile stay latched */
+        AudioTaskPtr task;
+        while (!service_stopped_ && !audio_send_queue_.full() && audio_encode_queue_.Pop(task)) {
+            int64_t start_time = esp_timer_get_time();
+            latency_tracer_.Record(kLatencyStageEncodeQueue, (uint32_t)start_time - task->queued_us);
+
+            /* The encoder follows the frame size, which changes when a session negotiates another duration */
+            int frame_duration = task->pcm.size() * 1000 / 16000;
+            if (frame_duration != encoder_frame_duration_ &&
+                (frame_duration == 20 || frame_duration == 40 || frame_duration == 60)) {
+                ESP_LOGI(TAG, "Opus encoder frame duration: %d ms", frame_duration);
+                opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration);
+                opus_encoder_->SetComplexity(complexity_controller_.complexity());
+#if CONFIG_USE_UPLINK_VAD_GATE
+                opus_encoder_->SetDtx(true);
+#endif
+                encoder_frame_duration_ = frame_duration;
+            }
+
+            auto packet = GetAudioStreamPacketPool().Acquire();
+            packet->frame_duration = encoder_frame_duration_;
             packet->sample_rate = 16000;
             packet->timestamp = task->timestamp;
+            packet->origin_us = task->origin_us;
             if (!opus_encoder_->Encode(std::move(task->pcm), packet->payload)) {
                 ESP_LOGE(TAG, "Failed to encode audio");
                 continue;
             }
+            uint32_t encode_us = esp_timer_get_time() - start_time;
+            encode_statistics_.Record(encode_us, encoder_frame_duration_);
+            if (complexity_controller_.Record(encode_us, encoder_frame_duration_)) {
+                opus_encoder_->SetComplexity(complexity_controller_.complexity());
+            }
+            latency_tracer_.RecordSince(kLatencyStageEncode, (uint32_t)start_time);
+            packet->queued_us = AudioLatencyTracer::Now();
 
             if (task->type == kAudioTaskTypeEncodeToSendQueue) {
-                {
-                    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                    audio_send_queue_.push_back(std::move(packet));
-                }
+                audio_send_queue_.Push(std::move(packet));
                 if (callbacks_.on_send_queue_available) {
                     callbacks_.on_send_queue_available();
                 }
             } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
-                std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                audio_testing_queue_.push_back(std::move(packet));
+                if (testing_to_flash_) {
+                    // A frame still queued when testing stops finds the file closed and is dropped
+                    testing_writer_.Write(packet->payload.data(), packet->payload.size(), packet->frame_duration);
+                } else {
+                    // Replayed much later, keep the recording out of the latency histograms
+                    packet->origin_us = 0;
+                    packet->queued_us = 0;
+                    audio_testing_queue_.Push(std::move(packet));
+                }
             }
             debug_statistics_.encode_count++;
-            lock.lock();
+        }
+
+        if (service_stopped_) {
+            break;
         }
     }
 
-    ESP_LOGW(TAG, "Opus codec task stopped");
+    ESP_LOGW(TAG, "Opus encode task stopped");
 }
 
 void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
@@ -496,58 +675,140 @@ void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
     opus_decoder_.reset();
     opus_decoder_ = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
 
-    auto codec = Board::GetInstance().GetAudioCodec();
-    if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
-        ESP_LOGI(TAG, "Resampling audio from %d to %d", opus_decoder_->sample_rate(), codec->output_sample_rate());
-        output_resampler_.Configure(opus_decoder_->sample_rate(), codec->output_sample_rate());
+    /* Keep the downlink queues at the same time budget */
+    if (frame_duration > 0) {
+        audio_decode_queue_.set_capacity(QUEUE_FRAMES(DECODE_QUEUE_BUDGET_MS, frame_duration));
+        audio_playback_queue_.set_capacity(QUEUE_FRAMES(PLAYBACK_QUEUE_BUDGET_MS, frame_duration));
+    }
+
+    if (opus_decoder_->sample_rate() != codec_->output_sample_rate()) {
+        ESP_LOGI(TAG, "Resampling audio from %d to %d", opus_decoder_->sample_rate(), codec_->output_sample_rate());
+        output_resampler_.Configure(opus_decoder_->sample_rate(), codec_->output_sample_rate());
     }
 }
 
 void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm) {
-    auto task = std::make_unique<AudioTask>();
+    auto task = audio_task_pool_.Acquire();
     task->type = type;
-    task->pcm = std::move(pcm);
-    
-    /* Push the task to the encode queue */
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
+    // Trade buffers, the producer refills the pooled one and neither side allocates
+    task->pcm.swap(pcm);
+    task->origin_us = AudioLatencyTracer::Now();
 
     /* If the task is to send queue, we need to set the timestamp */
-    if (type == kAudioTaskTypeEncodeToSendQueue && !timestamp_queue_.empty()) {
-        if (timestamp_queue_.size() <= MAX_TIMESTAMPS_IN_QUEUE) {
-            task->timestamp = timestamp_queue_.front();
-        } else {
-            ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", timestamp_queue_.size());
+    if (type == kAudioTaskTypeEncodeToSendQueue) {
+        /* The processed frame lags the latest feed by at least the processor latency */
+        task->origin_us = last_feed_us_;
+#if CONFIG_USE_SERVER_AEC
+        /* Tag the frame with what the speaker was playing when its first sample was captured */
+        uint32_t frame_us = task->pcm.size() * 1000000 / 16000;
+        task->timestamp = playout_clock_.TimestampAt(task->origin_us - frame_us);
+#endif
+        latency_tracer_.RecordSince(kLatencyStageProcess, task->origin_us);
+
+        if (uplink_gate_active_ && !GateUplinkFrame(task)) {
+            return;
         }
-        timestamp_queue_.pop_front();
     }
 
-    audio_queue_cv_.wait(lock, [this]() { return audio_encode_queue_.size() < MAX_ENCODE_TASKS_IN_QUEUE; });
-    audio_encode_queue_.push_back(std::move(task));
-    audio_queue_cv_.notify_all();
+    PushToEncodeQueue(std::move(task));
 }
 
-bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait) {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    if (audio_decode_queue_.size() >= MAX_DECODE_PACKETS_IN_QUEUE) {
-        if (wait) {
-            audio_queue_cv_.wait(lock, [this]() { return audio_decode_queue_.size() < MAX_DECODE_PACKETS_IN_QUEUE; });
-        } else {
+/*
+ * Uplink gating, runs in the audio processor output callback right after the VAD update.
+ * Silent frames are held in a short pre-roll instead of being encoded, one keepalive frame is
+ * still sent every UPLINK_GATE_KEEPALIVE_MS, and a speech onset sends the pre-roll first so the
+ * first syllable is not clipped. Returns false if the frame was held back.
+ */
+bool AudioService::GateUplinkFrame(AudioTaskPtr& task) {
+    if (uplink_gate_reset_.exchange(false)) {
+        DropUplinkPreroll();
+        uplink_silence_ms_ = 0;
+    }
+
+    if (voice_detected_) {
+        while (uplink_preroll_count_ > 0) {
+            PushToEncodeQueue(TakeUplinkPreroll());
+            uplink_gate_statistics_.sent++;
+            uplink_gate_statistics_.preroll++;
+        }
+        uplink_silence_ms_ = 0;
+        uplink_gate_statistics_.sent++;
+        return true;
+    }
+
+    uint32_t frame_ms = task->pcm.size() * 1000 / 16000;
+    uplink_silence_ms_ += frame_ms;
+    if (uplink_silence_ms_ >= UPLINK_GATE_KEEPALIVE_MS) {
+        // The held frames are older than the keepalive, they are no use as pre-roll any more
+        DropUplinkPreroll();
+        uplink_silence_ms_ = 0;
+        uplink_gate_statistics_.sent++;
+        uplink_gate_statistics_.keepalive++;
+        return true;
+    }
+
+    // The pre-roll follows the frame duration, the slots are sized for the shortest frames
+    size_t limit = frame_ms > 0 ? UPLINK_GATE_PREROLL_MS / frame_ms : std::size(uplink_preroll_);
+    limit = std::max<size_t>(1, std::min(limit, std::size(uplink_preroll_)));
+    while (uplink_preroll_count_ >= limit) {
+        TakeUplinkPreroll();
+        uplink_gate_statistics_.suppressed++;
+    }
+    uplink_preroll_[(uplink_preroll_head_ + uplink_preroll_count_) % std::size(uplink_preroll_)] = std::move(task);
+    uplink_preroll_count_++;
+    return false;
+}
+
+// Removes the oldest held frame, dropping the returned handle gives the task back to the pool
+AudioTaskPtr AudioService::TakeUplinkPreroll() {
+    AudioTaskPtr task = std::move(uplink_preroll_[uplink_preroll_head_]);
+    uplink_preroll_head_ = (uplink_preroll_head_ + 1) % std::size(uplink_preroll_);
+    uplink_preroll_count_--;
+    return task;
+}
+
+// Every held frame that is dropped instead of sent counts as suppressed
+void AudioService::DropUplinkPreroll() {
+    while (uplink_preroll_count_ > 0) {
+        TakeUplinkPreroll();
+        uplink_gate_statistics_.suppressed++;
+    }
+}
+
+void AudioService::PushToEncodeQueue(AudioTaskPtr&& task) {
+    task->queued_us = AudioLatencyTracer::Now();
+    while (!audio_encode_queue_.Push(std::move(task))) {
+        if (service_stopped_) {
+            return;
+        }
+        xEventGroupWaitBits(queue_event_group_, AS_QUEUE_ENCODE_WRITABLE, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
+}
+
+bool AudioService::PushPacketToDecodeQueue(AudioStreamPacketPtr packet, bool wait) {
+    packet->queued_us = AudioLatencyTracer::Now();
+    packet->origin_us = packet->queued_us;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(decode_producer_mutex_);
+            if (audio_decode_queue_.Push(std::move(packet))) {
+                return true;
+            }
+        }
+        if (!wait || service_stopped_) {
             return false;
         }
+        xEventGroupWaitBits(queue_event_group_, AS_QUEUE_DECODE_WRITABLE, pdTRUE, pdFALSE, portMAX_DELAY);
     }
-    audio_decode_queue_.push_back(std::move(packet));
-    audio_queue_cv_.notify_all();
-    return true;
 }
 
-std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    if (audio_send_queue_.empty()) {
-        return nullptr;
+AudioStreamPacketPtr AudioService::PopPacketFromSendQueue() {
+    AudioStreamPacketPtr packet;
+    if (audio_send_queue_.Pop(packet)) {
+        latency_tracer_.RecordSince(kLatencyStageSendQueue, packet->queued_us);
+        latency_tracer_.RecordSince(kLatencyStageCaptureToSend, packet->origin_us);
+        latency_tracer_.RecordSince(kLatencyStageWakeToFirstPacket, wake_word_detected_us_.exchange(0));
     }
-    auto packet = std::move(audio_send_queue_.front());
-    audio_send_queue_.pop_front();
-    audio_queue_cv_.notify_all();
     return packet;
 }
 
@@ -561,9 +822,10 @@ const std::string& AudioService::GetLastWakeWord() const {
     return wake_word_->GetLastDetectedWakeWord();
 }
 
-std::unique_ptr<AudioStreamPacket> AudioService::PopWakeWordPacket() {
-    auto packet = std::make_unique<AudioStreamPacket>();
+AudioStreamPacketPtr AudioService::PopWakeWordPacket() {
+    auto packet = GetAudioStreamPacketPool().Acquire();
     if (wake_word_->GetWakeWordOpus(packet->payload)) {
+        latency_tracer_.RecordSince(kLatencyStageWakeToPreroll, wake_word_preroll_us_.exchange(0));
         return packet;
     }
     return nullptr;
@@ -596,184 +858,466 @@ void AudioService::EnableVoiceProcessing(bool enable) {
     if (enable) {
         // 【4G干扰优化】录音前关闭PA功放，减少4G RF信号对MIC的干扰
         if (codec_->output_enabled()) {
+            std::lock_guard<std::mutex> lock(power_mutex_);
             codec_->EnableOutput(false);
+            output_quiet_time_ = esp_timer_get_time() + AUDIO_INPUT_WARMUP_MS * 1000;
+            if (output_power_hint_.exchange(-1) >= 0) {
+                power_statistics_.wasted++;
+            }
             ESP_LOGI(TAG, "录音前关闭PA功放，减少4G干扰");
         }
 
         if (!audio_processor_initialized_) {
-            audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+            audio_processor_->Initialize(codec_, encode_frame_duration_, models_list_);
             audio_processor_initialized_ = true;
         }
+        ApplyEncodeFrameDuration();
+
+        /* The AFE VAD is off while device AEC runs, the gate has nothing to go by then */
+#if CONFIG_USE_UPLINK_VAD_GATE
+        uplink_gate_active_ = !device_aec_enabled_;
+#endif
+        /* The output callback drops what the gate still holds from the last session */
+        uplink_gate_reset_ = true;
 
         /* We should make sure no audio is playing */
         ResetDecoder();
+        audio_encode_queue_.reset_peak_size();
+        audio_send_queue_.reset_peak_size();
+        audio_decode_queue_.reset_peak_size();
+        audio_playback_queue_.reset_peak_size();
         audio_input_need_warmup_ = true;
         audio_processor_->Start();
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
     } else {
         audio_processor_->Stop();
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
+
+        /* Heap allocations should stop growing once the pools are warm */
+        auto& packet_pool = GetAudioStreamPacketPool();
+        ESP_LOGI(TAG, "Packet pool: peak %u/%u, heap allocations %lu; task pool: peak %u/%u, heap allocations %lu",
+            packet_pool.peak_in_use(), packet_pool.size(), packet_pool.heap_allocations(),
+            audio_task_pool_.peak_in_use(), audio_task_pool_.size(), audio_task_pool_.heap_allocations());
+        if (uplink_gate_active_) {
+            ESP_LOGI(TAG, "Uplink gate: sent %lu (pre-roll %lu, keepalive %lu), suppressed %lu",
+                uplink_gate_statistics_.sent, uplink_gate_statistics_.preroll, uplink_gate_statistics_.keepalive,
+                uplink_gate_statistics_.suppressed);
+        }
+        ESP_LOGI(TAG, "Encode: %lu frames, avg %lluus, max %luus, %lu deadline misses; decode: %lu frames, avg %lluus, max %luus, %lu deadline misses",
+            encode_statistics_.frames, encode_statistics_.average_us(), encode_statistics_.max_us, encode_statistics_.deadline_misses,
+            decode_statistics_.frames, decode_statistics_.average_us(), decode_statistics_.max_us, decode_statistics_.deadline_misses);
+        auto peaks = GetQueuePeaks();
+        ESP_LOGI(TAG, "Queue peaks: encode %u/%u, send %u/%u, decode %u/%u, playback %u/%u",
+            peaks.encode, audio_encode_queue_.capacity(), peaks.send, audio_send_queue_.capacity(),
+            peaks.decode, audio_decode_queue_.capacity(), peaks.playback, audio_playback_queue_.capacity());
+        auto& complexity = complexity_controller_.stats();
+        ESP_LOGI(TAG, "Opus complexity: %d of %d, load avg %lu%%, peak %lu%%, %lu steps up, %lu steps down",
+            complexity_controller_.complexity(), complexity_controller_.max_complexity(), complexity.load_percent,
+            complexity.peak_percent, complexity.steps_up, complexity.steps_down);
     }
 }
 
+AudioQueuePeaks AudioService::GetQueuePeaks() const {
+    AudioQueuePeaks peaks;
+    peaks.encode = audio_encode_queue_.peak_size();
+    peaks.send = audio_send_queue_.peak_size();
+    peaks.decode = audio_decode_queue_.peak_size();
+    peaks.playback = audio_playback_queue_.peak_size();
+    return peaks;
+}
+
+void AudioService::WarmTaskPool(size_t pcm_samples) {
+    audio_task_pool_.Warm([pcm_samples](AudioTask& task) {
+        task.pcm.reserve(pcm_samples);
+    });
+}
+
 void AudioService::EnableAudioTesting(bool enable) {
     ESP_LOGI(TAG, "%s audio testing", enable ? "Enabling" : "Disabling");
     if (enable) {
+        ApplyEncodeFrameDuration();
+        /* A new recording cuts the replay of the last one */
+        testing_replay_requested_ = false;
+        audio_testing_queue_.Clear();
+        jitter_buffer_reset_ = true;
+#if CONFIG_AUDIO_TESTING_RECORD_TO_FLASH
+        testing_to_flash_ = testing_writer_.Open(AUDIO_TESTING_FILE, 16000);
+#endif
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
     } else {
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
-        /* Copy audio_testing_queue_ to audio_decode_queue_ */
-        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-        audio_decode_queue_ = std::move(audio_testing_queue_);
-        audio_queue_cv_.notify_all();
+        if (testing_to_flash_) {
+            testing_writer_.Close();
+            testing_replay_requested_ = true;
+        }
+        /* The opus decode task plays the recording back after the decode queue */
+        xEventGroupSetBits(queue_event_group_, AS_QUEUE_DECODE_READABLE);
     }
 }
 
 void AudioService::EnableDeviceAec(bool enable) {
     ESP_LOGI(TAG, "%s device AEC", enable ? "Enabling" : "Disabling");
     if (!audio_processor_initialized_) {
-        audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+        audio_processor_->Initialize(codec_, encode_frame_duration_, models_list_);
         audio_processor_initialized_ = true;
     }
 
     audio_processor_->EnableDeviceAec(enable);
+    device_aec_enabled_ = enable;
 }
 
 void AudioService::SetCallbacks(AudioServiceCallbacks& callbacks) {
     callbacks_ = callbacks;
 }
 
-void AudioService::PlaySound(const std::string_view& ogg) {
+void AudioService::SetEncodeFrameDuration(int frame_duration_ms) {
+    if (frame_duration_ms != 20 && frame_duration_ms != 40 && frame_duration_ms != 60) {
+        ESP_LOGW(TAG, "Unsupported frame duration %d ms, keeping %d ms", frame_duration_ms, encode_frame_duration_.load());
+        return;
+    }
+    if (frame_duration_ms != encode_frame_duration_) {
+        ESP_LOGI(TAG, "Uplink frame duration: %d ms", frame_duration_ms);
+        encode_frame_duration_ = frame_duration_ms;
+    }
+}
+
+void AudioService::ApplyEncodeFrameDuration() {
+    int frame_duration = encode_frame_duration_;
+    if (audio_processor_initialized_) {
+        audio_processor_->SetFrameDuration(frame_duration);
+    }
+    audio_encode_queue_.set_capacity(QUEUE_FRAMES(ENCODE_QUEUE_BUDGET_MS, frame_duration));
+    audio_send_queue_.set_capacity(QUEUE_FRAMES(SEND_QUEUE_BUDGET_MS, frame_duration));
+    audio_testing_queue_.set_capacity(QUEUE_FRAMES(AUDIO_TESTING_MAX_DURATION_MS, frame_duration));
+}
+
+void AudioService::PlaySound(const std::string_view& ogg, AudioStream stream) {
+    if (stream == kAudioStreamVoice) {
+        ESP_LOGE(TAG, "Sounds cannot play on the voice stream");
+        return;
+    }
+    auto& sound = GetSoundStream(stream);
     if (!codec_->output_enabled()) {
-        esp_timer_stop(audio_power_timer_);
-        esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
-        codec_->EnableOutput(true);
+        PowerUpOutput();
     }
 
-    const uint8_t* buf = reinterpret_cast<const uint8_t*>(ogg.data());
-    size_t size = ogg.size();
-    size_t offset = 0;
+    /* Sounds mapped from flash are indexed once and played straight from the mapping */
+    const OggOpusIndex* index = esp_ptr_in_drom(ogg.data()) ? GetSoundIndex(ogg) : nullptr;
+    bool zero_copy = index != nullptr;
+    const int frame_duration = SOUND_FRAME_DURATION_MS;
+
+    /* A sound decoded before skips the opus decoder, the first play of it fills the cache */
+    std::shared_ptr<DecodedSound> decoded_sound;
+    if (zero_copy && decoded_sound_cache_.enabled()) {
+        int sample_rate = codec_->output_sample_rate();
+        decoded_sound = decoded_sound_cache_.Find(ogg.data(), sample_rate);
+        if (decoded_sound != nullptr) {
+            auto packet = GetAudioStreamPacketPool().Acquire();
+            packet->decoded_sound = std::move(decoded_sound);
+            PushPacketToSoundQueue(sound, std::move(packet));
+            return;
+        }
+        size_t packets = index->packets().size();
+        decoded_sound = decoded_sound_cache_.CreateBuilder(ogg.data(), sample_rate,
+            packets * (sample_rate * frame_duration / 1000 + 1), packets);
+    }
+    OggOpusIndex local_index;
+    if (index == nullptr) {
+        if (!local_index.Build(ogg)) {
+            return;
+        }
+        index = &local_index;
+    }
 
-    auto find_page = [&](size_t start)->size_t {
-        for (size_t i = start; i + 4 <= size; ++i) {
-            if (buf[i] == 'O' && buf[i+1] == 'g' && buf[i+2] == 'g' && buf[i+3] == 'S') return i;
+    for (auto& view : index->packets()) {
+        auto packet = GetAudioStreamPacketPool().Acquire();
+        packet->sample_rate = index->sample_rate();
+        packet->frame_duration = frame_duration;
+        packet->decoded_sound = decoded_sound;
+        if (zero_copy) {
+            packet->view = view;
+        } else {
+            // The caller's buffer may be gone before the packet is decoded
+            packet->payload.assign(view.data, view.data + view.size);
         }
-        return static_cast<size_t>(-1);
-    };
+        PushPacketToSoundQueue(sound, std::move(packet));
+    }
+}
 
-    bool seen_head = false;
-    bool seen_tags = false;
-    int sample_rate = 16000; // 默认值
+void AudioService::SetStreamGain(AudioStream stream, float gain) {
+    audio_mixer_.SetGain(stream, (int32_t)(gain * AUDIO_MIXER_UNITY_GAIN));
+}
 
+bool AudioService::PushPacketToSoundQueue(SoundStream& sound, AudioStreamPacketPtr packet) {
+    packet->queued_us = AudioLatencyTracer::Now();
+    packet->origin_us = packet->queued_us;
     while (true) {
-        size_t pos = find_page(offset);
-        if (pos == static_cast<size_t>(-1)) break;
-        offset = pos;
-        if (offset + 27 > size) break;
-
-        const uint8_t* page = buf + offset;
-        uint8_t page_segments = page[26];
-        size_t seg_table_off = offset + 27;
-        if (seg_table_off + page_segments > size) break;
-
-        size_t body_size = 0;
-        for (size_t i = 0; i < page_segments; ++i) body_size += page[27 + i];
-
-        size_t body_off = seg_table_off + page_segments;
-        if (body_off + body_size > size) break;
-
-        // Parse packets using lacing
-        size_t cur = body_off;
-        size_t seg_idx = 0;
-        while (seg_idx < page_segments) {
-            size_t pkt_len = 0;
-            size_t pkt_start = cur;
-            bool continued = false;
-            do {
-                uint8_t l = page[27 + seg_idx++];
-                pkt_len += l;
-                cur += l;
-                continued = (l == 255);
-            } while (continued && seg_idx < page_segments);
-
-            if (pkt_len == 0) continue;
-            const uint8_t* pkt_ptr = buf + pkt_start;
-
-            if (!seen_head) {
-                // 解析OpusHead包
-                if (pkt_len >= 19 && std::memcmp(pkt_ptr, "OpusHead", 8) == 0) {
-                    seen_head = true;
-                    
-                    // OpusHead结构：[0-7] "OpusHead", [8] version, [9] channel_count, [10-11] pre_skip
-                    // [12-15] input_sample_rate, [16-17] output_gain, [18] mapping_family
-                    if (pkt_len >= 12) {
-                        uint8_t version = pkt_ptr[8];
-                        uint8_t channel_count = pkt_ptr[9];
-                        
-                        if (pkt_len >= 16) {
-                            // 读取输入采样率 (little-endian)
-                            sample_rate = pkt_ptr[12] | (pkt_ptr[13] << 8) | 
-                                        (pkt_ptr[14] << 16) | (pkt_ptr[15] << 24);
-                            ESP_LOGI(TAG, "OpusHead: version=%d, channels=%d, sample_rate=%d", 
-                                   version, channel_count, sample_rate);
-                        }
-                    }
-                }
-                continue;
-            }
-            if (!seen_tags) {
-                // Expect OpusTags in second packet
-                if (pkt_len >= 8 && std::memcmp(pkt_ptr, "OpusTags", 8) == 0) {
-                    seen_tags = true;
-                }
-                continue;
+        {
+            std::lock_guard<std::mutex> lock(sound.producer_mutex);
+            if (sound.packets.Push(std::move(packet))) {
+                return true;
             }
-
-            // Audio packet (Opus)
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->sample_rate = sample_rate;
-            packet->frame_duration = 60;
-            packet->payload.resize(pkt_len);
-            std::memcpy(packet->payload.data(), pkt_ptr, pkt_len);
-            PushPacketToDecodeQueue(std::move(packet), true);
         }
+        if (service_stopped_) {
+            return false;
+        }
+        xEventGroupWaitBits(queue_event_group_, AS_QUEUE_SOUND_WRITABLE, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
+}
 
-        offset = body_off + body_size;
+const OggOpusIndex* AudioService::GetSoundIndex(const std::string_view& ogg) {
+    std::lock_guard<std::mutex> lock(sound_index_mutex_);
+    auto it = sound_index_cache_.find(ogg.data());
+    if (it != sound_index_cache_.end()) {
+        // Another sound mapped at the same address, queued packets may still use the cached index
+        return it->second->Matches(ogg) ? it->second.get() : nullptr;
+    }
+    if (sound_index_cache_.size() >= SOUND_INDEX_CACHE_SIZE) {
+        return nullptr;
+    }
+
+    auto index = std::make_unique<OggOpusIndex>();
+    if (!index->Build(ogg)) {
+        return nullptr;
     }
+    return sound_index_cache_.emplace(ogg.data(), std::move(index)).first->second.get();
 }
 
 bool AudioService::IsIdle() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && audio_playback_queue_.empty() && audio_testing_queue_.empty();
+    for (auto& sound : sound_streams_) {
+        if (!sound.packets.empty() || !sound.playback.empty() || sound.cached_sound_playing) {
+            return false;
+        }
+    }
+    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && jitter_buffer_.empty() &&
+        audio_playback_queue_.empty() && audio_testing_queue_.empty() && !testing_replaying_ && !testing_replay_requested_;
+}
+
+/* Move one frame of a sound stream towards its playback queue, only called by the opus decode task */
+bool AudioService::ServiceSoundStream(SoundStream& sound) {
+    if (sound.reset.exchange(false)) {
+        sound.cached_sound.reset();
+        sound.cached_sound_playing = false;
+        if (sound.decoder != nullptr) {
+            sound.decoder->ResetState();
+        }
+    }
+    if (sound.playback.full()) {
+        return false;
+    }
+    if (sound.cached_sound != nullptr) {
+        PlayCachedSoundFrame(sound);
+        return true;
+    }
+
+    AudioStreamPacketPtr packet;
+    if (!sound.packets.Pop(packet)) {
+        return false;
+    }
+    if (packet->decoded_sound != nullptr && packet->decoded_sound->complete) {
+        sound.cached_sound = std::move(packet->decoded_sound);
+        sound.cached_sound_offset = 0;
+        sound.cached_sound_playing = true;
+        PlayCachedSoundFrame(sound);
+    } else {
+        DecodeSoundPacket(sound, std::move(packet));
+    }
+    return true;
+}
+
+void AudioService::DecodeSoundPacket(SoundStream& sound, AudioStreamPacketPtr packet) {
+    int64_t start_time = esp_timer_get_time();
+    if (sound.decoder == nullptr || sound.decoder->sample_rate() != packet->sample_rate ||
+        sound.decoder->duration_ms() != packet->frame_duration) {
+        sound.decoder = std::make_unique<OpusDecoderWrapper>(packet->sample_rate, 1, packet->frame_duration);
+        if (packet->sample_rate != codec_->output_sample_rate()) {
+            sound.resampler.Configure(packet->sample_rate, codec_->output_sample_rate());
+        }
+    }
+
+    auto task = audio_task_pool_.Acquire();
+    task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+    task->origin_us = packet->origin_us;
+    bool decoded;
+    if (packet->view.data != nullptr) {
+        // The decoder takes a vector, stage mapped packets in one reused buffer
+        view_payload_.assign(packet->view.data, packet->view.data + packet->view.size);
+        decoded = sound.decoder->Decode(std::move(view_payload_), task->pcm);
+    } else {
+        decoded = sound.decoder->Decode(std::move(packet->payload), task->pcm);
+    }
+    if (!decoded) {
+        ESP_LOGE(TAG, "Failed to decode sound");
+        return;
+    }
+    if (sound.decoder->sample_rate() != codec_->output_sample_rate()) {
+        sound.resampler.Process(task->pcm);
+    }
+    /* The first play of a local sound fills its cache entry */
+    auto& decoded_sound = packet->decoded_sound;
+    if (decoded_sound != nullptr && decoded_sound->Append(task->pcm.data(), task->pcm.size())) {
+        decoded_sound_cache_.Insert(std::move(decoded_sound));
+    }
+    task->queued_us = AudioLatencyTracer::Now();
+    sound.playback.Push(std::move(task));
+    decode_statistics_.Record(esp_timer_get_time() - start_time, sound.decoder->duration_ms());
+    debug_statistics_.decode_count++;
+}
+
+/* Feed one frame of a cached sound straight to the playback queue */
+void AudioService::PlayCachedSoundFrame(SoundStream& sound) {
+    auto& cached_sound = sound.cached_sound;
+    size_t remaining = cached_sound->samples - sound.cached_sound_offset;
+    size_t count = std::min(cached_sound->frame_samples, remaining);
+    auto task = audio_task_pool_.Acquire();
+    task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+    task->pcm.assign(cached_sound->pcm + sound.cached_sound_offset, cached_sound->pcm + sound.cached_sound_offset + count);
+    task->queued_us = AudioLatencyTracer::Now();
+    sound.playback.Push(std::move(task));
+
+    sound.cached_sound_offset += count;
+    if (sound.cached_sound_offset >= cached_sound->samples) {
+        cached_sound.reset();
+        sound.cached_sound_playing = false;
+    }
+}
+
+/* The recording is replayed once testing stops, from RAM or read from flash a page at a time */
+bool AudioService::PopTestingPacket(AudioStreamPacketPtr& packet) {
+    if (audio_testing_queue_.Pop(packet)) {
+        return true;
+    }
+    if (testing_replay_requested_.exchange(false)) {
+        testing_replaying_ = testing_reader_.Open(AUDIO_TESTING_FILE);
+    }
+    if (!testing_replaying_) {
+        return false;
+    }
+    packet = GetAudioStreamPacketPool().Acquire();
+    if (testing_reader_.Read(packet->payload, packet->frame_duration)) {
+        packet->sample_rate = testing_reader_.sample_rate();
+        return true;
+    }
+    packet.reset();
+    testing_reader_.Close();
+    testing_replaying_ = false;
+    return false;
+}
+
+void AudioService::LogJitterBufferStats() {
+    auto& stats = jitter_buffer_.stats();
+    ESP_LOGI(TAG, "Jitter buffer: late %lu, duplicates %lu, lost %lu, concealed %lu, underruns %lu, resyncs %lu, jitter %lums, target %lums",
+        stats.late, stats.duplicates, stats.lost, stats.concealed, stats.underruns, stats.resyncs,
+        stats.jitter_ms, stats.target_delay_ms);
 }
 
 void AudioService::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
     opus_decoder_->ResetState();
-    timestamp_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    audio_decode_queue_.Clear();
+    /* The jitter buffer belongs to the opus decode task, it is reset there */
+    jitter_buffer_reset_ = true;
+    xEventGroupSetBits(queue_event_group_, AS_QUEUE_DECODE_READABLE);
+    audio_playback_queue_.Clear();
+    audio_testing_queue_.Clear();
+    testing_replay_requested_ = false;
+    /* Sounds are cut as well, nothing may play into the mic once voice processing starts */
+    for (auto& sound : sound_streams_) {
+        sound.packets.Clear();
+        sound.playback.Clear();
+        sound.reset = true;
+    }
 }
 
 void AudioService::CheckAndUpdateAudioPowerState() {
+    std::lock_guard<std::mutex> lock(power_mutex_);
     auto now = std::chrono::steady_clock::now();
     auto input_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_input_time_).count();
     auto output_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_output_time_).count();
-    if (input_elapsed > AUDIO_POWER_TIMEOUT_MS && codec_->input_enabled()) {
+    /* A path that was powered up ahead of use and never used does not get the full idle timeout */
+    int input_timeout = input_power_hint_ >= 0 ? PREDICTED_AUDIO_POWER_TIMEOUT_MS : AUDIO_POWER_TIMEOUT_MS;
+    int output_timeout = output_power_hint_ >= 0 ? PREDICTED_AUDIO_POWER_TIMEOUT_MS : OUTPUT_AUDIO_POWER_TIMEOUT_MS;
+    if (input_elapsed > input_timeout && codec_->input_enabled()) {
         ESP_LOGI(TAG, "音频输入超时关闭（闲置 %lld ms）", (long long)input_elapsed);
         codec_->EnableInput(false);
+        int hint = input_power_hint_.exchange(-1);
+        if (hint >= 0) {
+            power_statistics_.wasted++;
+            ESP_LOGI(TAG, "Input powered up by %s was not used", GetPowerHintName(hint));
+        }
     }
-    if (output_elapsed > OUTPUT_AUDIO_POWER_TIMEOUT_MS && codec_->output_enabled()) {
+    if (output_elapsed > output_timeout && codec_->output_enabled()) {
         ESP_LOGI(TAG, "音频输出超时关闭（闲置 %lld ms）", (long long)output_elapsed);
         codec_->EnableOutput(false);
+        int hint = output_power_hint_.exchange(-1);
+        if (hint >= 0) {
+            power_statistics_.wasted++;
+            ESP_LOGI(TAG, "Output powered up by %s was not used", GetPowerHintName(hint));
+        }
     }
     if (!codec_->input_enabled() && !codec_->output_enabled()) {
         esp_timer_stop(audio_power_timer_);
     }
 }
 
+bool AudioService::PowerUpInput(int hint) {
+    std::lock_guard<std::mutex> lock(power_mutex_);
+    if (codec_->input_enabled()) {
+        return false;
+    }
+    esp_timer_stop(audio_power_timer_);
+    esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
+    int64_t start_time = esp_timer_get_time();
+    codec_->EnableInput(true);
+    input_power_up_time_ = esp_timer_get_time();
+    input_settle_time_ = input_power_up_time_ + AUDIO_INPUT_WARMUP_MS * 1000;
+    input_power_hint_ = hint;
+    last_input_time_ = std::chrono::steady_clock::now();
+    ESP_LOGI(TAG, "Input powered up by %s in %lld us", GetPowerHintName(hint), input_power_up_time_ - start_time);
+    return true;
+}
+
+bool AudioService::PowerUpOutput(int hint) {
+    std::lock_guard<std::mutex> lock(power_mutex_);
+    if (codec_->output_enabled()) {
+        return false;
+    }
+    esp_timer_stop(audio_power_timer_);
+    esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
+    int64_t start_time = esp_timer_get_time();
+    codec_->EnableOutput(true);
+    output_power_up_time_ = esp_timer_get_time();
+    output_power_hint_ = hint;
+    last_output_time_ = std::chrono::steady_clock::now();
+    ESP_LOGI(TAG, "Output powered up by %s in %lld us", GetPowerHintName(hint), output_power_up_time_ - start_time);
+    return true;
+}
+
+void AudioService::PrepareAudioPower(AudioPowerHint hint) {
+    pending_power_hints_ |= 1 << hint;
+    power_statistics_.hints++;
+    /* Fails harmlessly while a previous one-shot is still pending, it picks this hint up too */
+    esp_timer_start_once(audio_power_up_timer_, 0);
+}
+
+void AudioService::ApplyPowerHints() {
+    uint32_t hints = pending_power_hints_.exchange(0);
+    if (service_stopped_) {
+        return;
+    }
+    for (int hint = 0; hints != 0; hint++, hints >>= 1) {
+        if ((hints & 1) == 0) {
+            continue;
+        }
+        int paths = kAudioPowerHints[hint].paths;
+        if ((paths & AUDIO_POWER_INPUT) && PowerUpInput(hint)) {
+            power_statistics_.power_ups++;
+        }
+        if ((paths & AUDIO_POWER_OUTPUT) && PowerUpOutput(hint)) {
+            power_statistics_.power_ups++;
+        }
+    }
+}
+
 void AudioService::SetModelsList(srmodel_list_t* models_list) {
     models_list_ = models_list;
 
@@ -795,6 +1339,8 @@ void AudioService::SetModelsList(srmodel_list_t* models_list) {
 
     if (wake_word_) {
         wake_word_->OnWakeWordDetected([this](const std::string& wake_word) {
+            wake_word_detected_us_ = AudioLatencyTracer::Now();
+            wake_word_preroll_us_ = wake_word_detected_us_.load();
             if (callbacks_.on_wake_word_detected) {
                 callbacks_.on_wake_word_detected(wake_word);
             }
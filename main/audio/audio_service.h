@@ -2,10 +2,10 @@
 #define AUDIO_SERVICE_H
 
 #include <memory>
-#include <deque>
-#include <condition_variable>
 #include <chrono>
 #include <mutex>
+#include <atomic>
+#include <map>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -15,37 +15,82 @@
 
 #include <opus_encoder.h>
 #include <opus_decoder.h>
-#include <opus_resampler.h>
 
 #include "audio_codec.h"
 #include "audio_processor.h"
 #include "processors/audio_debugger.h"
 #include "wake_word.h"
 #include "protocol.h"
+#include "audio_queue.h"
+#include "jitter_buffer.h"
+#include "audio_latency.h"
+#include "ogg_opus_index.h"
+#include "ogg_opus_file.h"
+#include "decoded_sound_cache.h"
+#include "polyphase_resampler.h"
+#include "playout_clock.h"
+#include "audio_mixer.h"
+#include "opus_complexity_controller.h"
 
 
 /*
  * There are two types of audio data flow:
  * 1. (MIC) -> [Processors] -> {Encode Queue} -> [Opus Encoder] -> {Send Queue} -> (Server)
- * 2. (Server) -> {Decode Queue} -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
+ * 2. (Server) -> {Decode Queue} -> [Jitter Buffer] -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
  *
- * We use one task for MIC / Speaker / Processors, and one task for Opus Encoder / Opus Decoder.
+ * We use one task for MIC / Speaker / Processors, and one task each for Opus Encoder and Opus Decoder,
+ * so a slow encode never delays playback in full-duplex sessions.
  * 
  * Decode Queue and Send Queue are the main queues, because Opus packets are quite smaller than PCM packets.
  * 
+ * Every queue is a lock-free SPSC AudioQueue with its own readable / writable bits in queue_event_group_,
+ * so a push or pop only wakes the task waiting on that queue.
+ * 
  */
 
+// Default uplink frame duration, the server hello may select 20 or 40 ms instead
 #define OPUS_FRAME_DURATION_MS 60
-#define MAX_ENCODE_TASKS_IN_QUEUE 2
-#define MAX_PLAYBACK_TASKS_IN_QUEUE 2
-#define MAX_DECODE_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
-#define MAX_SEND_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
+#define OPUS_MIN_FRAME_DURATION_MS 20
+
+// Queue capacities are time budgets, converted to frames with the current frame duration
+#define ENCODE_QUEUE_BUDGET_MS 120
+#define PLAYBACK_QUEUE_BUDGET_MS 120
+#define DECODE_QUEUE_BUDGET_MS 2400
+#define SEND_QUEUE_BUDGET_MS 2400
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
-#define MAX_TIMESTAMPS_IN_QUEUE 3
+// Audio testing records here when the file can be created, only the RAM recording is limited in time
+#define AUDIO_TESTING_FILE CONFIG_SPIFFS_BASE_PATH "/audio_test.ogg"
+#define QUEUE_FRAMES(budget_ms, frame_duration_ms) ((budget_ms) / (frame_duration_ms))
+#define QUEUE_MAX_FRAMES(budget_ms) QUEUE_FRAMES(budget_ms, OPUS_MIN_FRAME_DURATION_MS)
+
+// Uplink VAD gate: silence kept to prepend to a speech onset, and the interval of keepalive frames
+#define UPLINK_GATE_PREROLL_MS 240
+#define UPLINK_GATE_KEEPALIVE_MS 1000
+
+// Distinct sounds whose packet index is kept, built-in prompts are well below this
+#define SOUND_INDEX_CACHE_SIZE 32
+// PSRAM kept for decoded prompts, the boards without PSRAM always decode
+#if CONFIG_SPIRAM
+#define DECODED_SOUND_CACHE_BYTES (256 * 1024)
+#else
+#define DECODED_SOUND_CACHE_BYTES 0
+#endif
+
+// Local sounds are always 60 ms frames, every sound stream queues up to the decode budget of packets
+#define SOUND_FRAME_DURATION_MS 60
+#define SOUND_STREAM_COUNT (kAudioStreamCount - kAudioStreamPrompt)
+
+#define AUDIO_TASK_POOL_SIZE (QUEUE_MAX_FRAMES(ENCODE_QUEUE_BUDGET_MS) + QUEUE_MAX_FRAMES(PLAYBACK_QUEUE_BUDGET_MS) + \
+    QUEUE_MAX_FRAMES(UPLINK_GATE_PREROLL_MS) + \
+    SOUND_STREAM_COUNT * QUEUE_FRAMES(PLAYBACK_QUEUE_BUDGET_MS, SOUND_FRAME_DURATION_MS) + kAudioStreamCount + 4)
 
 #define AUDIO_POWER_TIMEOUT_MS 15000
 #define OUTPUT_AUDIO_POWER_TIMEOUT_MS 2000
 #define AUDIO_POWER_CHECK_INTERVAL_MS 1000
+// A path powered up ahead of use goes back down sooner if the prediction was wrong
+#define PREDICTED_AUDIO_POWER_TIMEOUT_MS 3000
+// Settle time for the mic after the codec input powers up or the speaker goes quiet
+#define AUDIO_INPUT_WARMUP_MS 120
 
 
 #define AS_EVENT_AUDIO_TESTING_RUNNING      (1 << 0)
@@ -53,6 +98,16 @@
 #define AS_EVENT_AUDIO_PROCESSOR_RUNNING    (1 << 2)
 #define AS_EVENT_PLAYBACK_NOT_EMPTY         (1 << 3)
 
+#define AS_QUEUE_ENCODE_READABLE            (1 << 0)
+#define AS_QUEUE_ENCODE_WRITABLE            (1 << 1)
+#define AS_QUEUE_DECODE_READABLE            (1 << 2)
+#define AS_QUEUE_DECODE_WRITABLE            (1 << 3)
+#define AS_QUEUE_SEND_WRITABLE              (1 << 4)
+#define AS_QUEUE_PLAYBACK_READABLE          (1 << 5)
+#define AS_QUEUE_PLAYBACK_WRITABLE          (1 << 6)
+#define AS_QUEUE_SOUND_WRITABLE             (1 << 7)
+#define AS_QUEUE_ALL_EVENTS                 (0xFF)
+
 struct AudioServiceCallbacks {
     std::function<void(void)> on_send_queue_available;
     std::function<void(const std::string&)> on_wake_word_detected;
@@ -67,10 +122,97 @@ enum AudioTaskType {
     kAudioTaskTypeDecodeToPlaybackQueue,
 };
 
+// Leading signals that the codec paths will be needed soon
+enum AudioPowerHint {
+    kAudioPowerHintButton,
+    kAudioPowerHintTouch,
+    kAudioPowerHintUtteranceEnd,
+    kAudioPowerHintServerHello,
+    kAudioPowerHintTtsStart,
+};
+
 struct AudioTask {
     AudioTaskType type;
     std::vector<int16_t> pcm;
     uint32_t timestamp;
+    uint32_t origin_us = 0; // Latency tracing: captured or received
+    uint32_t queued_us = 0; // Latency tracing: entered the current queue
+    uint32_t delay_us = 0;  // Filter delay in the PCM, the output resampler lags the timestamp
+
+    void Reset() {
+        timestamp = 0;
+        delay_us = 0;
+        origin_us = 0;
+        queued_us = 0;
+        pcm.clear();
+    }
+    size_t buffer_capacity() const { return pcm.capacity() * sizeof(int16_t); }
+};
+
+// PCM tasks are large, so they are pooled in PSRAM
+using AudioTaskPool = ObjectPool<AudioTask>;
+using AudioTaskPtr = AudioTaskPool::Handle;
+
+// Local sounds of one output stream, decoded independently of the voice stream so they can be mixed over it
+struct SoundStream {
+    AudioQueue<AudioStreamPacketPtr> packets{QUEUE_FRAMES(DECODE_QUEUE_BUDGET_MS, SOUND_FRAME_DURATION_MS)};
+    AudioQueue<AudioTaskPtr> playback{QUEUE_FRAMES(PLAYBACK_QUEUE_BUDGET_MS, SOUND_FRAME_DURATION_MS)};
+    // PlaySound may be called from any task, the producers take turns
+    std::mutex producer_mutex;
+    std::atomic<bool> reset = false;
+    std::atomic<bool> cached_sound_playing = false;
+    // Owned by the opus decode task
+    std::unique_ptr<OpusDecoderWrapper> decoder;
+    PolyphaseResampler resampler;
+    std::shared_ptr<DecodedSound> cached_sound;
+    size_t cached_sound_offset = 0;
+};
+
+// Time spent per opus frame, a frame that takes longer than its own duration misses its deadline
+struct CodecTaskStatistics {
+    uint32_t frames = 0;
+    uint32_t last_us = 0;
+    uint32_t max_us = 0;
+    uint64_t total_us = 0;
+    uint32_t deadline_misses = 0;
+
+    void Record(int64_t us, int frame_duration_ms) {
+        frames++;
+        last_us = us;
+        total_us += us;
+        if (last_us > max_us) {
+            max_us = last_us;
+        }
+        if (us > frame_duration_ms * 1000) {
+            deadline_misses++;
+        }
+    }
+    uint64_t average_us() const { return frames > 0 ? total_us / frames : 0; }
+};
+
+// Frames seen by the uplink VAD gate, every processed frame ends up in exactly one of sent / suppressed
+struct UplinkGateStatistics {
+    uint32_t sent = 0;
+    uint32_t suppressed = 0;
+    uint32_t keepalive = 0;     // Silent frames sent to keep the stream alive, included in sent
+    uint32_t preroll = 0;       // Held frames sent ahead of a speech onset, included in sent
+};
+
+// Codec paths powered up by a hint, every one ends up either used or wasted
+struct AudioPowerStatistics {
+    uint32_t hints = 0;
+    uint32_t power_ups = 0;
+    uint32_t used = 0;
+    uint32_t wasted = 0;            // Powered down again before any audio went through
+    uint32_t warmups_skipped = 0;   // Voice processing started without waiting for the mic to settle
+};
+
+// Most frames each queue held at once since voice processing started, against its time budget
+struct AudioQueuePeaks {
+    size_t encode = 0;
+    size_t send = 0;
+    size_t decode = 0;
+    size_t playback = 0;
 };
 
 struct DebugStatistics {
@@ -89,7 +231,7 @@ public:
     void Start();
     void Stop();
     void EncodeWakeWord();
-    std::unique_ptr<AudioStreamPacket> PopWakeWordPacket();
+    AudioStreamPacketPtr PopWakeWordPacket();
     const std::string& GetLastWakeWord() const;
     bool IsVoiceDetected() const { return voice_detected_; }
     bool IsIdle();
@@ -103,13 +245,35 @@ public:
     void EnableDeviceAec(bool enable);
 
     void SetCallbacks(AudioServiceCallbacks& callbacks);
+    // Uplink frame duration (20, 40 or 60 ms), takes effect the next time voice processing starts
+    void SetEncodeFrameDuration(int frame_duration_ms);
+    int GetEncodeFrameDuration() const { return encode_frame_duration_; }
 
-    bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
-    std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
-    void PlaySound(const std::string_view& sound);
+    bool PushPacketToDecodeQueue(AudioStreamPacketPtr packet, bool wait = false);
+    AudioStreamPacketPtr PopPacketFromSendQueue();
+    // Sounds play on the prompt or alarm stream, mixed over TTS instead of queued behind it
+    void PlaySound(const std::string_view& sound, AudioStream stream = kAudioStreamPrompt);
+    // Linear gain of an output stream, 0.0 to 1.0
+    void SetStreamGain(AudioStream stream, float gain);
+    // Power up the codec paths a leading signal predicts, returns at once and may be called from any task
+    void PrepareAudioPower(AudioPowerHint hint);
     bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
     void SetModelsList(srmodel_list_t* models_list);
+    const JitterBufferStats& GetJitterBufferStats() const { return jitter_buffer_.stats(); }
+    const CodecTaskStatistics& GetEncodeStatistics() const { return encode_statistics_; }
+    const CodecTaskStatistics& GetDecodeStatistics() const { return decode_statistics_; }
+    const OpusComplexityController& GetComplexityController() const { return complexity_controller_; }
+    AudioLatencyTracer& GetLatencyTracer() { return latency_tracer_; }
+    // 0 once the first uplink packet after the wake word was sent
+    uint32_t wake_word_detected_us() const { return wake_word_detected_us_.load(); }
+    const UplinkGateStatistics& GetUplinkGateStatistics() const { return uplink_gate_statistics_; }
+    bool IsUplinkGateActive() const { return uplink_gate_active_; }
+    DecodedSoundCacheStats GetDecodedSoundCacheStats() { return decoded_sound_cache_.stats(); }
+    const AudioPowerStatistics& GetAudioPowerStatistics() const { return power_statistics_; }
+    AudioQueuePeaks GetQueuePeaks() const;
+    // Reserves PCM for every pooled task, so no task buffer grows once audio flows
+    void WarmTaskPool(size_t pcm_samples);
 
 private:
     AudioCodec* codec_ = nullptr;
@@ -119,27 +283,75 @@ private:
     std::unique_ptr<AudioDebugger> audio_debugger_;
     std::unique_ptr<OpusEncoderWrapper> opus_encoder_;
     std::unique_ptr<OpusDecoderWrapper> opus_decoder_;
-    OpusResampler input_resampler_;
-    OpusResampler reference_resampler_;
-    OpusResampler output_resampler_;
+    PolyphaseResampler input_resampler_;
+    PolyphaseResampler reference_resampler_;
+    PolyphaseResampler output_resampler_;
+    std::vector<int16_t> mic_channel_;
+    std::vector<int16_t> reference_channel_;
+    std::vector<int16_t> resampled_reference_;
+    // Frame the input task reads into, the encode queue hands back a pooled buffer for it
+    std::vector<int16_t> input_frame_;
     DebugStatistics debug_statistics_;
+    CodecTaskStatistics encode_statistics_;
+    CodecTaskStatistics decode_statistics_;
+    AudioLatencyTracer latency_tracer_;
+    std::atomic<uint32_t> last_feed_us_ = 0;
+    std::atomic<uint32_t> wake_word_detected_us_ = 0;
+    std::atomic<uint32_t> wake_word_preroll_us_ = 0;
     srmodel_list_t* models_list_ = nullptr;
 
     EventGroupHandle_t event_group_;
+    EventGroupHandle_t queue_event_group_;
 
     // Audio encode / decode
     TaskHandle_t audio_input_task_handle_ = nullptr;
     TaskHandle_t audio_output_task_handle_ = nullptr;
-    TaskHandle_t opus_codec_task_handle_ = nullptr;
-    std::mutex audio_queue_mutex_;
-    std::condition_variable audio_queue_cv_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_send_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_encode_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_playback_queue_;
+    TaskHandle_t opus_decode_task_handle_ = nullptr;
+    TaskHandle_t opus_encode_task_handle_ = nullptr;
+    AudioTaskPool audio_task_pool_{AUDIO_TASK_POOL_SIZE, MALLOC_CAP_SPIRAM};
+    std::vector<uint8_t> view_payload_;
+    SoundStream sound_streams_[SOUND_STREAM_COUNT];
+    // The block each stream is playing, owned by the audio output task
+    AudioMixer audio_mixer_;
+    AudioTaskPtr mixer_tasks_[kAudioStreamCount];
+    AudioQueue<AudioStreamPacketPtr> audio_decode_queue_{QUEUE_FRAMES(DECODE_QUEUE_BUDGET_MS, OPUS_FRAME_DURATION_MS),
+        QUEUE_MAX_FRAMES(DECODE_QUEUE_BUDGET_MS)};
+    AudioQueue<AudioStreamPacketPtr> audio_send_queue_{QUEUE_FRAMES(SEND_QUEUE_BUDGET_MS, OPUS_FRAME_DURATION_MS),
+        QUEUE_MAX_FRAMES(SEND_QUEUE_BUDGET_MS)};
+    AudioQueue<AudioStreamPacketPtr> audio_testing_queue_{QUEUE_FRAMES(AUDIO_TESTING_MAX_DURATION_MS, OPUS_FRAME_DURATION_MS),
+        QUEUE_MAX_FRAMES(AUDIO_TESTING_MAX_DURATION_MS)};
+    OggOpusFileWriter testing_writer_;
+    OggOpusFileReader testing_reader_;      // Owned by the opus decode task
+    std::atomic<bool> testing_to_flash_ = false;
+    std::atomic<bool> testing_replay_requested_ = false;
+    std::atomic<bool> testing_replaying_ = false;
+    AudioQueue<AudioTaskPtr> audio_encode_queue_{QUEUE_FRAMES(ENCODE_QUEUE_BUDGET_MS, OPUS_FRAME_DURATION_MS),
+        QUEUE_MAX_FRAMES(ENCODE_QUEUE_BUDGET_MS)};
+    AudioQueue<AudioTaskPtr> audio_playback_queue_{QUEUE_FRAMES(PLAYBACK_QUEUE_BUDGET_MS, OPUS_FRAME_DURATION_MS),
+        QUEUE_MAX_FRAMES(PLAYBACK_QUEUE_BUDGET_MS)};
+    JitterBuffer jitter_buffer_{QUEUE_MAX_FRAMES(DECODE_QUEUE_BUDGET_MS), DECODE_QUEUE_BUDGET_MS};
+    std::atomic<bool> jitter_buffer_reset_ = false;
+    // The decode queue is fed by the network callback and by PlaySound, so its producers take turns
+    std::mutex decode_producer_mutex_;
+    // Packet index of every sound played from flash, keyed by its mapped address
+    std::map<const char*, std::unique_ptr<OggOpusIndex>> sound_index_cache_;
+    std::mutex sound_index_mutex_;
+    DecodedSoundCache decoded_sound_cache_{DECODED_SOUND_CACHE_BYTES};
     // For server AEC
-    std::deque<uint32_t> timestamp_queue_;
+    PlayoutClock playout_clock_;
+    // Uplink VAD gate, only touched by the audio processor output callback
+    AudioTaskPtr uplink_preroll_[QUEUE_MAX_FRAMES(UPLINK_GATE_PREROLL_MS)];
+    size_t uplink_preroll_head_ = 0;
+    size_t uplink_preroll_count_ = 0;
+    UplinkGateStatistics uplink_gate_statistics_;
+    uint32_t uplink_silence_ms_ = 0;
+    std::atomic<bool> uplink_gate_reset_ = false;
+    bool uplink_gate_active_ = false;
+    bool device_aec_enabled_ = false;
+
+    std::atomic<int> encode_frame_duration_ = OPUS_FRAME_DURATION_MS;
+    int encoder_frame_duration_ = OPUS_FRAME_DURATION_MS;  // Owned by the opus encode task
+    OpusComplexityController complexity_controller_{CONFIG_OPUS_ENCODE_MAX_COMPLEXITY};  // Owned by the opus encode task
 
     bool wake_word_initialized_ = false;
     bool audio_processor_initialized_ = false;
@@ -148,15 +360,45 @@ private:
     bool audio_input_need_warmup_ = false;
 
     esp_timer_handle_t audio_power_timer_ = nullptr;
+    esp_timer_handle_t audio_power_up_timer_ = nullptr;
     std::chrono::steady_clock::time_point last_input_time_;
     std::chrono::steady_clock::time_point last_output_time_;
+    // Power transitions come from the audio tasks and the timer task, they take turns
+    std::mutex power_mutex_;
+    std::atomic<uint32_t> pending_power_hints_ = 0;    // Bit per AudioPowerHint
+    // The hint that powered a path up, until the path is first used; -1 when it was powered on demand
+    std::atomic<int> input_power_hint_ = -1;
+    std::atomic<int> output_power_hint_ = -1;
+    int64_t input_power_up_time_ = 0;
+    int64_t output_power_up_time_ = 0;
+    // The mic is usable from this time on, after the codec input settled and the speaker went quiet
+    std::atomic<int64_t> input_settle_time_ = 0;
+    std::atomic<int64_t> output_quiet_time_ = 0;
+    AudioPowerStatistics power_statistics_;
 
     void AudioInputTask();
     void AudioOutputTask();
-    void OpusCodecTask();
+    void OpusDecodeTask();
+    void OpusEncodeTask();
     void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm);
+    void PushToEncodeQueue(AudioTaskPtr&& task);
+    bool GateUplinkFrame(AudioTaskPtr& task);
+    AudioTaskPtr TakeUplinkPreroll();
+    void DropUplinkPreroll();
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
+    void ApplyEncodeFrameDuration();
     void CheckAndUpdateAudioPowerState();
+    bool PowerUpInput(int hint = -1);
+    bool PowerUpOutput(int hint = -1);
+    void ApplyPowerHints();
+    void LogJitterBufferStats();
+    bool PopTestingPacket(AudioStreamPacketPtr& packet);
+    const OggOpusIndex* GetSoundIndex(const std::string_view& ogg);
+    SoundStream& GetSoundStream(AudioStream stream) { return sound_streams_[stream - kAudioStreamPrompt]; }
+    bool PushPacketToSoundQueue(SoundStream& sound, AudioStreamPacketPtr packet);
+    bool ServiceSoundStream(SoundStream& sound);
+    void DecodeSoundPacket(SoundStream& sound, AudioStreamPacketPtr packet);
+    void PlayCachedSoundFrame(SoundStream& sound);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "decoded_sound_cache.h"
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+
+#define TAG "DecodedSoundCache"
+
+
+DecodedSound::DecodedSound(const void* key, int sample_rate, size_t capacity, size_t packets)
+    : key(key), sample_rate(sample_rate), capacity(capacity), packets_expected(packets) {
+    pcm = (int16_t*)heap_caps_malloc(capacity * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+    if (pcm == nullptr) {
+        failed = true;
+    }
+}
+
+DecodedSound::~DecodedSound() {
+    heap_caps_free(pcm);
+}
+
+bool DecodedSound::Append(const int16_t* data, size_t count) {
+    if (failed || complete) {
+        return false;
+    }
+    if (samples + count > capacity) {
+        failed = true;
+        return false;
+    }
+    if (frame_samples == 0) {
+        frame_samples = count;
+    }
+    memcpy(pcm + samples, data, count * sizeof(int16_t));
+    samples += count;
+    if (++packets_decoded == packets_expected) {
+        complete = true;
+    }
+    return complete;
+}
+
+std::shared_ptr<DecodedSound> DecodedSoundCache::Find(const void* key, int sample_rate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(Key(key, sample_rate));
+    if (it == entries_.end()) {
+        stats_.misses++;
+        return nullptr;
+    }
+    stats_.hits++;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return *it->second;
+}
+
+std::shared_ptr<DecodedSound> DecodedSoundCache::CreateBuilder(const void* key, int sample_rate, size_t samples, size_t packets) {
+    // A single sound may take a quarter of the cache, longer ones always go through the decoder
+    if (packets == 0 || samples * sizeof(int16_t) > max_bytes_ / 4) {
+        return nullptr;
+    }
+    auto sound = std::make_shared<DecodedSound>(key, sample_rate, samples, packets);
+    if (sound->failed) {
+        ESP_LOGW(TAG, "Failed to allocate %u bytes for a decoded sound", samples * sizeof(int16_t));
+        return nullptr;
+    }
+    return sound;
+}
+
+void DecodedSoundCache::Insert(std::shared_ptr<DecodedSound> sound) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Key key(sound->key, sound->sample_rate);
+    if (entries_.find(key) != entries_.end()) {
+        // The same sound was played again before its first decode finished
+        return;
+    }
+    while (!lru_.empty() && stats_.bytes + sound->bytes() > max_bytes_) {
+        auto& oldest = lru_.back();
+        stats_.bytes -= oldest->bytes();
+        entries_.erase(Key(oldest->key, oldest->sample_rate));
+        lru_.pop_back();
+        stats_.evictions++;
+    }
+    stats_.bytes += sound->bytes();
+    lru_.push_front(std::move(sound));
+    entries_[key] = lru_.begin();
+}
+
+DecodedSoundCacheStats DecodedSoundCache::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    DecodedSoundCacheStats stats = stats_;
+    stats.entries = entries_.size();
+    return stats;
+}
@@ -0,0 +1,72 @@
+#ifndef DECODED_SOUND_CACHE_H
+#define DECODED_SOUND_CACHE_H
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * PCM of a local sound, decoded and resampled to the output sample rate.
+ *
+ * The buffer is allocated in PSRAM for the whole sound up front and filled frame by frame by the
+ * opus decode task the first time the sound plays. Once complete it is immutable, so it is shared
+ * by the cache and by every playback still reading it.
+ */
+struct DecodedSound {
+    const void* key = nullptr;
+    int sample_rate = 0;
+    size_t frame_samples = 0;
+    size_t samples = 0;
+    size_t capacity = 0;
+    size_t packets_expected = 0;
+    size_t packets_decoded = 0;
+    bool failed = false;
+    bool complete = false;
+    int16_t* pcm = nullptr;
+
+    DecodedSound(const void* key, int sample_rate, size_t capacity, size_t packets);
+    ~DecodedSound();
+    DecodedSound(const DecodedSound&) = delete;
+    DecodedSound& operator=(const DecodedSound&) = delete;
+
+    // Called by the decode task for every decoded packet, returns true once the last one is in
+    bool Append(const int16_t* data, size_t count);
+    size_t bytes() const { return capacity * sizeof(int16_t); }
+};
+
+struct DecodedSoundCacheStats {
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t evictions = 0;
+    size_t bytes = 0;
+    size_t entries = 0;
+};
+
+// Size-bounded LRU of decoded sounds, keyed by the sound data and the output sample rate
+class DecodedSoundCache {
+public:
+    explicit DecodedSoundCache(size_t max_bytes) : max_bytes_(max_bytes) {}
+
+    // Counts a hit or a miss, a hit becomes the most recently used entry
+    std::shared_ptr<DecodedSound> Find(const void* key, int sample_rate);
+    // A builder for a miss, nullptr if the sound is too large to cache or PSRAM is short
+    std::shared_ptr<DecodedSound> CreateBuilder(const void* key, int sample_rate, size_t samples, size_t packets);
+    void Insert(std::shared_ptr<DecodedSound> sound);
+
+    bool enabled() const { return max_bytes_ > 0; }
+    DecodedSoundCacheStats stats();
+
+private:
+    using Key = std::pair<const void*, int>;
+    std::list<std::shared_ptr<DecodedSound>> lru_;  // Most recently used first
+    std::map<Key, std::list<std::shared_ptr<DecodedSound>>::iterator> entries_;
+    size_t max_bytes_;
+    DecodedSoundCacheStats stats_;
+    std::mutex mutex_;
+};
+
+#endif // DECODED_SOUND_CACHE_H
@@ -0,0 +1,158 @@
+#include "jitter_buffer.h"
+#include <esp_log.h>
+
+#define TAG "JitterBuffer"
+
+
+JitterBuffer::JitterBuffer(size_t max_frames, uint32_t budget_ms) : capacity_(max_frames), budget_ms_(budget_ms) {
+    size_t slots = 1;
+    while (slots < max_frames) {
+        slots <<= 1;
+    }
+    mask_ = slots - 1;
+    slots_ = std::make_unique<AudioStreamPacketPtr[]>(slots);
+}
+
+void JitterBuffer::Put(AudioStreamPacketPtr&& packet, int64_t now_ms) {
+    if (packet->frame_duration > 0) {
+        frame_duration_ = packet->frame_duration;
+    }
+
+    // Unsequenced streams are numbered in arrival order
+    uint32_t sequence = packet->sequence;
+    if (sequence == 0) {
+        sequence = started_ ? highest_sequence_ + 1 : 1;
+    }
+
+    if (!started_) {
+        started_ = true;
+        next_sequence_ = sequence;
+        highest_sequence_ = sequence;
+    }
+
+    int32_t ahead = (int32_t)(sequence - next_sequence_);
+    if (ahead < 0) {
+        if (!pulled_ && (uint32_t)(highest_sequence_ - sequence) < capacity_) {
+            // Reordered before playout started, start from the earlier packet
+            next_sequence_ = sequence;
+        } else if (-ahead >= JITTER_BUFFER_RESYNC_FRAMES) {
+            Resync(sequence);
+        } else {
+            stats_.late++;
+            return;
+        }
+    } else if ((uint32_t)ahead >= capacity_) {
+        Resync(sequence);
+    }
+
+    auto& slot = slots_[sequence & mask_];
+    if (slot) {
+        stats_.duplicates++;
+        return;
+    }
+    if (count_ == 0 && !playing_) {
+        hold_start_ms_ = now_ms;
+        // The decoder drains the buffer between packets that arrive in real time, only a pause
+        // longer than any delay the buffer would add starts a new talk spurt, which is not jitter
+        if (now_ms - last_arrival_ms_ > JITTER_BUFFER_MAX_DELAY_MS) {
+            has_transit_ = false;
+        }
+    }
+    last_arrival_ms_ = now_ms;
+    slot = std::move(packet);
+    count_++;
+    if ((int32_t)(sequence - highest_sequence_) > 0) {
+        highest_sequence_ = sequence;
+    }
+    UpdateJitter(sequence, now_ms);
+}
+
+JitterBuffer::PullResult JitterBuffer::Pull(AudioStreamPacketPtr& packet, int64_t now_ms) {
+    if (count_ == 0) {
+        if (playing_) {
+            playing_ = false;
+            stats_.underruns++;
+        }
+        return kPullNone;
+    }
+
+    if (!playing_) {
+        uint32_t target = target_delay_ms();
+        uint32_t buffered_ms = (highest_sequence_ - next_sequence_ + 1) * frame_duration_;
+        if (buffered_ms < target && now_ms - hold_start_ms_ < target) {
+            return kPullNone;
+        }
+        // Frames that went missing while the buffer was empty are simply skipped
+        while (!slots_[next_sequence_ & mask_]) {
+            next_sequence_++;
+            stats_.lost++;
+        }
+        playing_ = true;
+        pulled_ = true;
+        stats_.target_delay_ms = target;
+    }
+
+    auto& slot = slots_[next_sequence_ & mask_];
+    next_sequence_++;
+    if (!slot) {
+        stats_.lost++;
+        return kPullLost;
+    }
+    packet = std::move(slot);
+    count_--;
+    return kPullPacket;
+}
+
+void JitterBuffer::Reset() {
+    Clear();
+    started_ = false;
+    pulled_ = false;
+}
+
+int JitterBuffer::NextWakeupMs(int64_t now_ms) const {
+    if (playing_ || count_ == 0) {
+        return -1;
+    }
+    int64_t remaining = target_delay_ms() - (now_ms - hold_start_ms_);
+    return remaining > 0 ? (int)remaining : 0;
+}
+
+void JitterBuffer::Clear() {
+    for (size_t i = 0; i <= mask_; i++) {
+        slots_[i].reset();
+    }
+    count_ = 0;
+    playing_ = false;
+    has_transit_ = false;
+}
+
+void JitterBuffer::Resync(uint32_t sequence) {
+    ESP_LOGW(TAG, "Sequence jumped from %lu to %lu, restarting", next_sequence_, sequence);
+    Clear();
+    stats_.resyncs++;
+    next_sequence_ = sequence;
+    highest_sequence_ = sequence;
+}
+
+void JitterBuffer::UpdateJitter(uint32_t sequence, int64_t now_ms) {
+    // Transit time relative to the media clock, only its variation matters
+    int64_t transit = now_ms - (int64_t)sequence * frame_duration_;
+    if (has_transit_) {
+        int64_t d = transit - last_transit_ms_;
+        if (d < 0) {
+            d = -d;
+        }
+        if (d > JITTER_BUFFER_MAX_DELAY_MS * 4) {
+            d = JITTER_BUFFER_MAX_DELAY_MS * 4;
+        }
+        jitter_q4_ += d - ((jitter_q4_ + 8) >> 4);
+        stats_.jitter_ms = jitter_q4_ >> 4;
+    }
+    last_transit_ms_ = transit;
+    has_transit_ = true;
+}
+
+uint32_t JitterBuffer::target_delay_ms() const {
+    uint32_t target = frame_duration_ + 3 * (jitter_q4_ >> 4);
+    return target < JITTER_BUFFER_MAX_DELAY_MS ? target : JITTER_BUFFER_MAX_DELAY_MS;
+}
@@ -0,0 +1,87 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#include "protocol.h"
+
+#define JITTER_BUFFER_MAX_DELAY_MS 300
+#define JITTER_BUFFER_RESYNC_FRAMES 50
+
+struct JitterBufferStats {
+    uint32_t late = 0;          // Arrived after their playout slot, dropped
+    uint32_t duplicates = 0;    // Same sequence received twice, dropped
+    uint32_t lost = 0;          // Never arrived before their playout slot
+    uint32_t concealed = 0;     // Lost frames replaced by packet loss concealment
+    uint32_t underruns = 0;     // The buffer ran dry while playing, this includes the end of every utterance
+    uint32_t resyncs = 0;       // Sequence jumped too far, the buffer was restarted
+    uint32_t jitter_ms = 0;     // Smoothed interarrival jitter (RFC 3550)
+    uint32_t target_delay_ms = 0;
+};
+
+/*
+ * Reorders the downlink Opus packets by sequence number before they are decoded.
+ *
+ * Packets with sequence 0 (WebSocket, local sounds) are numbered in arrival order, so they go
+ * through the same path but never show gaps. Playout starts, and restarts after an underrun,
+ * once the buffer holds target_delay_ms of audio or its oldest packet has waited that long.
+ * The target delay follows the measured arrival jitter, so a clean network adds no delay.
+ *
+ * Put() and Pull() are only called from the opus decode task.
+ */
+class JitterBuffer {
+public:
+    enum PullResult {
+        kPullNone,      // Nothing to play yet
+        kPullPacket,    // packet holds the next frame
+        kPullLost,      // The next frame is missing, conceal it
+    };
+
+    // Holds at most budget_ms of audio, and never more than max_frames frames
+    JitterBuffer(size_t max_frames, uint32_t budget_ms);
+
+    void Put(AudioStreamPacketPtr&& packet, int64_t now_ms);
+    PullResult Pull(AudioStreamPacketPtr& packet, int64_t now_ms);
+    void Reset();
+
+    // Milliseconds until a held packet must be released, -1 if nothing is held
+    int NextWakeupMs(int64_t now_ms) const;
+    void OnConcealed() { stats_.concealed++; }
+
+    size_t size() const { return count_.load(std::memory_order_relaxed); }
+    bool empty() const { return size() == 0; }
+    bool full() const { return size() >= capacity_ || size() * frame_duration_ >= budget_ms_; }
+    const JitterBufferStats& stats() const { return stats_; }
+
+private:
+    std::unique_ptr<AudioStreamPacketPtr[]> slots_;
+    size_t capacity_;
+    uint32_t budget_ms_;
+    uint32_t mask_ = 0;
+    std::atomic<size_t> count_ = 0;
+
+    bool started_ = false;      // A packet was put since the last Reset()
+    bool pulled_ = false;       // A frame was played since the last Reset()
+    bool playing_ = false;
+    uint32_t next_sequence_ = 0;
+    uint32_t highest_sequence_ = 0;
+    int64_t hold_start_ms_ = 0;
+    int64_t last_arrival_ms_ = 0;
+    int frame_duration_ = 60;
+
+    bool has_transit_ = false;
+    int64_t last_transit_ms_ = 0;
+    int32_t jitter_q4_ = 0;     // Jitter in 1/16 ms
+
+    JitterBufferStats stats_;
+
+    void Clear();
+    void Resync(uint32_t sequence);
+    void UpdateJitter(uint32_t sequence, int64_t now_ms);
+    uint32_t target_delay_ms() const;
+};
+
+#endif // JITTER_BUFFER_H
@@ -0,0 +1,124 @@
+#ifndef OBJECT_POOL_H
+#define OBJECT_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+
+#include <esp_heap_caps.h>
+
+/*
+ * Fixed-capacity pool of preallocated objects handed out as RAII handles.
+ *
+ * The objects are constructed once in a slab allocated with the given heap caps, and a released
+ * object keeps the capacity of its buffers, so after warm-up a frame costs no heap allocation.
+ * T must provide Reset() (clear the contents but keep the buffers) and buffer_capacity().
+ *
+ * When the pool is exhausted Acquire() falls back to operator new; such objects, and every buffer
+ * that had to grow while it was out of the pool, are counted in heap_allocations().
+ */
+template <typename T>
+class ObjectPool {
+public:
+    struct Deleter {
+        ObjectPool* pool = nullptr;
+        void operator()(T* object) const {
+            if (pool != nullptr) {
+                pool->Release(object);
+            } else {
+                delete object;
+            }
+        }
+    };
+    using Handle = std::unique_ptr<T, Deleter>;
+
+    ObjectPool(size_t size, uint32_t caps) : size_(size) {
+        objects_ = (T*)heap_caps_malloc(sizeof(T) * size, caps);
+        if (objects_ == nullptr) {
+            objects_ = (T*)heap_caps_malloc(sizeof(T) * size, MALLOC_CAP_DEFAULT);
+        }
+        free_list_ = std::make_unique<T*[]>(size);
+        capacities_ = std::make_unique<size_t[]>(size);
+        for (size_t i = 0; i < size; i++) {
+            new (&objects_[i]) T();
+            free_list_[i] = &objects_[i];
+            capacities_[i] = 0;
+        }
+        free_count_ = size;
+    }
+
+    ~ObjectPool() {
+        for (size_t i = 0; i < size_; i++) {
+            objects_[i].~T();
+        }
+        heap_caps_free(objects_);
+    }
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    Handle Acquire() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (free_count_ > 0) {
+                T* object = free_list_[--free_count_];
+                size_t in_use = size_ - free_count_;
+                if (in_use > peak_in_use_) {
+                    peak_in_use_ = in_use;
+                }
+                return Handle(object, Deleter{this});
+            }
+            heap_allocations_++;
+        }
+        return Handle(new T(), Deleter{nullptr});
+    }
+
+    /*
+     * Calls grow(object) on every free object and takes the capacities it leaves as warm. The
+     * warm-up allocations then happen here instead of on the first frames that reach a new depth.
+     */
+    template <typename Grow>
+    void Warm(Grow grow) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < free_count_; i++) {
+            T* object = free_list_[i];
+            grow(*object);
+            size_t index = object - objects_;
+            if (object->buffer_capacity() > capacities_[index]) {
+                capacities_[index] = object->buffer_capacity();
+            }
+        }
+    }
+
+    size_t size() const { return size_; }
+    size_t in_use() const { return size_ - free_count_; }
+    size_t peak_in_use() const { return peak_in_use_; }
+    uint32_t heap_allocations() const { return heap_allocations_; }
+
+private:
+    T* objects_ = nullptr;
+    std::unique_ptr<T*[]> free_list_;
+    std::unique_ptr<size_t[]> capacities_;
+    size_t size_;
+    size_t free_count_ = 0;
+    size_t peak_in_use_ = 0;
+    uint32_t heap_allocations_ = 0;
+    std::mutex mutex_;
+
+    void Release(T* object) {
+        size_t index = object - objects_;
+        size_t capacity = object->buffer_capacity();
+        object->Reset();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (capacity > capacities_[index]) {
+            capacities_[index] = capacity;
+            heap_allocations_++;
+        }
+        free_list_[free_count_++] = object;
+    }
+};
+
+#endif // OBJECT_POOL_H
@@ -0,0 +1,342 @@
+#include "ogg_opus_file.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_random.h>
+#include <cstring>
+
+#define TAG "OggOpusFile"
+
+#define OGG_PAGE_HEADER_SIZE 27
+#define OGG_PAGE_MAX_HEADER_SIZE (OGG_PAGE_HEADER_SIZE + 255)
+#define OGG_PAGE_BODY_CAPACITY (OGG_OPUS_FILE_PAGE_SIZE - OGG_PAGE_MAX_HEADER_SIZE)
+#define OGG_FLAG_CONTINUED 0x01
+#define OGG_FLAG_BOS 0x02
+#define OGG_FLAG_EOS 0x04
+
+
+// Ogg CRC: polynomial 0x04c11db7, MSB first, no reflection and no final xor
+static uint32_t OggCrc(const uint8_t* data, size_t size) {
+    uint32_t crc = 0;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= (uint32_t)data[i] << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static void WriteLe32(uint8_t* p, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = value >> (i * 8);
+    }
+}
+
+static void WriteLe64(uint8_t* p, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = value >> (i * 8);
+    }
+}
+
+static uint64_t ReadLe64(const uint8_t* p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+OggOpusFileWriter::~OggOpusFileWriter() {
+    Close();
+    if (write_task_ != nullptr) {
+        vTaskDelete(write_task_);
+    }
+    for (auto& page : pages_) {
+        heap_caps_free(page.data);
+    }
+}
+
+bool OggOpusFileWriter::Open(const char* path, int sample_rate) {
+    Close();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (auto& page : pages_) {
+        if (page.data == nullptr) {
+            page.data = (uint8_t*)heap_caps_malloc(OGG_OPUS_FILE_PAGE_SIZE, MALLOC_CAP_SPIRAM);
+            if (page.data == nullptr) {
+                ESP_LOGE(TAG, "Failed to allocate the page buffers");
+                return false;
+            }
+        }
+    }
+    if (write_task_ == nullptr) {
+        xTaskCreate([](void* arg) {
+            auto this_ = (OggOpusFileWriter*)arg;
+            this_->WriteTask();
+            vTaskDelete(NULL);
+        }, "ogg_writer", 4096, this, 2, &write_task_);
+        if (write_task_ == nullptr) {
+            ESP_LOGE(TAG, "Failed to create the writer task");
+            return false;
+        }
+    }
+
+    file_ = fopen(path, "wb");
+    if (file_ == nullptr) {
+        ESP_LOGW(TAG, "Failed to create %s", path);
+        return false;
+    }
+    // Pages are written whole, stdio buffering would only add a copy
+    setvbuf(file_, nullptr, _IONBF, 0);
+    serial_ = esp_random();
+    page_sequence_ = 0;
+    granule_ = 0;
+    dropped_ = 0;
+    failed_ = false;
+    for (auto& page : pages_) {
+        page.segments = 0;
+        page.body_size = 0;
+    }
+
+    // OpusHead: version 1, mono, no pre-skip, the input rate, no gain, mapping family 0
+    uint8_t head[19] = {'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 1, 1, 0, 0};
+    WriteLe32(head + 12, sample_rate);
+    AppendPacket(pages_[active_], head, sizeof(head));
+    FinishPage(pages_[active_], OGG_FLAG_BOS);
+
+    static const char vendor[] = "xiaozhi";
+    uint8_t tags[8 + 4 + sizeof(vendor) - 1 + 4] = {'O', 'p', 'u', 's', 'T', 'a', 'g', 's'};
+    WriteLe32(tags + 8, sizeof(vendor) - 1);
+    memcpy(tags + 12, vendor, sizeof(vendor) - 1);
+    WriteLe32(tags + 12 + sizeof(vendor) - 1, 0);
+    AppendPacket(pages_[active_], tags, sizeof(tags));
+    FinishPage(pages_[active_], 0);
+
+    // Audio starts on a free page, and a file that cannot be written is reported right away
+    WaitForWriter(lock);
+    if (failed_) {
+        ESP_LOGW(TAG, "Failed to write %s", path);
+        fclose(file_);
+        file_ = nullptr;
+        return false;
+    }
+    ESP_LOGI(TAG, "Recording to %s", path);
+    return true;
+}
+
+bool OggOpusFileWriter::Write(const uint8_t* data, size_t size, int frame_duration_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_ == nullptr || failed_) {
+        return false;
+    }
+
+    Page* page = &pages_[active_];
+    if (!page->pending && !AppendPacket(*page, data, size)) {
+        FinishPage(*page, 0);
+        page = &pages_[active_];
+        if (!page->pending && !AppendPacket(*page, data, size)) {
+            ESP_LOGW(TAG, "Packet of %u bytes does not fit a page", size);
+            return true;
+        }
+    }
+    if (page->pending) {
+        // The writer is behind with both pages, the flash is slower than the stream
+        if (dropped_++ == 0) {
+            ESP_LOGW(TAG, "Writer is behind, dropping packets");
+        }
+        return true;
+    }
+    granule_ += frame_duration_ms * 48;
+    return true;
+}
+
+void OggOpusFileWriter::Close() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (file_ == nullptr) {
+        return;
+    }
+    Page& page = pages_[active_];
+    if (!page.pending) {
+        FinishPage(page, OGG_FLAG_EOS);
+    }
+    WaitForWriter(lock);
+    fclose(file_);
+    file_ = nullptr;
+    ESP_LOGI(TAG, "Recorded %lu pages, %lld ms, dropped %lu packets%s", page_sequence_, granule_ / 48,
+        dropped_, failed_ ? ", write failed" : "");
+}
+
+bool OggOpusFileWriter::is_open() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return file_ != nullptr;
+}
+
+bool OggOpusFileWriter::failed() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_;
+}
+
+bool OggOpusFileWriter::AppendPacket(Page& page, const uint8_t* data, size_t size) {
+    size_t segments = size / 255 + 1;
+    if (page.segments + segments > 255 || page.body_size + size > OGG_PAGE_BODY_CAPACITY) {
+        return false;
+    }
+    memcpy(page.data + OGG_PAGE_MAX_HEADER_SIZE + page.body_size, data, size);
+    page.body_size += size;
+    // A packet is laced as runs of 255 ended by a shorter value, possibly 0
+    for (size_t i = 0; i < segments - 1; i++) {
+        page.lacing[page.segments++] = 255;
+    }
+    page.lacing[page.segments++] = size % 255;
+    return true;
+}
+
+/* Put the header right in front of the body so the page is one contiguous write */
+void OggOpusFileWriter::FinishPage(Page& page, uint8_t flags) {
+    page.header_offset = OGG_PAGE_MAX_HEADER_SIZE - OGG_PAGE_HEADER_SIZE - page.segments;
+    uint8_t* header = page.data + page.header_offset;
+    memcpy(header, "OggS", 4);
+    header[4] = 0;
+    header[5] = flags;
+    // The packet that did not fit is not counted yet, the granule ends with the last one in the page
+    WriteLe64(header + 6, granule_);
+    WriteLe32(header + 14, serial_);
+    WriteLe32(header + 18, page_sequence_++);
+    WriteLe32(header + 22, 0);
+    header[26] = page.segments;
+    memcpy(header + OGG_PAGE_HEADER_SIZE, page.lacing, page.segments);
+    size_t page_size = OGG_PAGE_HEADER_SIZE + page.segments + page.body_size;
+    WriteLe32(header + 22, OggCrc(header, page_size));
+
+    page.pending = true;
+    active_ ^= 1;
+    cv_.notify_all();
+}
+
+void OggOpusFileWriter::WaitForWriter(std::unique_lock<std::mutex>& lock) {
+    cv_.wait(lock, [this]() { return !pages_[0].pending && !pages_[1].pending; });
+}
+
+void OggOpusFileWriter::WriteTask() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this]() { return pages_[write_next_].pending; });
+        Page& page = pages_[write_next_];
+        size_t page_size = OGG_PAGE_MAX_HEADER_SIZE - page.header_offset + page.body_size;
+        bool ok = !failed_;
+
+        // The page stays pending while it is written, the producers only touch the other one
+        lock.unlock();
+        if (ok) {
+            ok = fwrite(page.data + page.header_offset, 1, page_size, file_) == page_size;
+        }
+        lock.lock();
+
+        if (!ok && !failed_) {
+            ESP_LOGW(TAG, "Failed to write a page of %u bytes", page_size);
+            failed_ = true;
+        }
+        page.segments = 0;
+        page.body_size = 0;
+        page.pending = false;
+        write_next_ ^= 1;
+        cv_.notify_all();
+    }
+}
+
+OggOpusFileReader::~OggOpusFileReader() {
+    Close();
+}
+
+bool OggOpusFileReader::Open(const char* path) {
+    Close();
+    file_ = fopen(path, "rb");
+    if (file_ == nullptr) {
+        ESP_LOGW(TAG, "Failed to open %s", path);
+        return false;
+    }
+    body_.reserve(OGG_OPUS_FILE_PAGE_SIZE);
+    segments_ = 0;
+    segment_ = 0;
+    offset_ = 0;
+    continued_ = false;
+    granule_ = 0;
+    headers_ = 0;
+    return true;
+}
+
+void OggOpusFileReader::Close() {
+    if (file_ != nullptr) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+bool OggOpusFileReader::ReadPage() {
+    uint8_t header[OGG_PAGE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file_) != sizeof(header) || memcmp(header, "OggS", 4) != 0) {
+        return false;
+    }
+    segments_ = header[26];
+    if (fread(lacing_, 1, segments_, file_) != segments_) {
+        return false;
+    }
+    size_t body_size = 0;
+    size_t packets = 0;
+    for (size_t i = 0; i < segments_; i++) {
+        body_size += lacing_[i];
+        packets += lacing_[i] < 255;
+    }
+    body_.resize(body_size);
+    if (fread(body_.data(), 1, body_size, file_) != body_size) {
+        return false;
+    }
+    segment_ = 0;
+    offset_ = 0;
+    continued_ = (header[5] & OGG_FLAG_CONTINUED) != 0;
+
+    // The granule advance of the page spread over the packets ending in it gives their duration
+    int64_t granule = ReadLe64(header + 6);
+    if (packets > 0 && granule > granule_) {
+        frame_duration_ = (granule - granule_) / packets / 48;
+        granule_ = granule;
+    }
+    return true;
+}
+
+bool OggOpusFileReader::Read(std::vector<uint8_t>& packet, int& frame_duration_ms) {
+    packet.clear();
+    while (file_ != nullptr) {
+        if (segment_ == segments_) {
+            if (!ReadPage()) {
+                return false;
+            }
+            if (!continued_) {
+                packet.clear();
+            }
+            continue;
+        }
+
+        uint8_t lacing = lacing_[segment_++];
+        packet.insert(packet.end(), body_.data() + offset_, body_.data() + offset_ + lacing);
+        offset_ += lacing;
+        if (lacing == 255) {
+            continue;
+        }
+
+        if (headers_ == 0) {
+            if (packet.size() >= 19 && memcmp(packet.data(), "OpusHead", 8) == 0) {
+                sample_rate_ = packet[12] | (packet[13] << 8) | (packet[14] << 16) | (packet[15] << 24);
+                headers_++;
+            }
+        } else if (headers_ == 1) {
+            headers_++;     // OpusTags
+        } else if (!packet.empty()) {
+            frame_duration_ms = frame_duration_;
+            return true;
+        }
+        packet.clear();
+    }
+    return false;
+}
@@ -0,0 +1,109 @@
+#ifndef OGG_OPUS_FILE_H
+#define OGG_OPUS_FILE_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+
+// Every Ogg page is built in place in one of two buffers of this size, the header in front of the body
+#define OGG_OPUS_FILE_PAGE_SIZE 4096
+
+/*
+ * Streams Opus packets into an Ogg Opus file of any length with constant RAM.
+ *
+ * Packets are appended to the page being filled, a full page is handed to a writer task and the
+ * next packets go to the other buffer while it is written, so a slow flash write never blocks
+ * the caller. Only if the writer is still busy with the other page when this one is full, packets
+ * are dropped until it catches up.
+ *
+ * Open(), Write() and Close() may be called from different tasks.
+ */
+class OggOpusFileWriter {
+public:
+    OggOpusFileWriter() = default;
+    ~OggOpusFileWriter();
+    OggOpusFileWriter(const OggOpusFileWriter&) = delete;
+    OggOpusFileWriter& operator=(const OggOpusFileWriter&) = delete;
+
+    // Truncates the file and writes the Opus headers, false if it cannot be created
+    bool Open(const char* path, int sample_rate);
+    // False once the file is closed or a write failed, e.g. because the flash is full
+    bool Write(const uint8_t* data, size_t size, int frame_duration_ms);
+    // Writes the last page and returns once everything is on flash
+    void Close();
+
+    bool is_open();
+    bool failed();
+
+private:
+    struct Page {
+        uint8_t* data = nullptr;
+        uint8_t lacing[255];
+        size_t segments = 0;
+        size_t body_size = 0;
+        size_t header_offset = 0;   // Start of the finished page in data
+        bool pending = false;       // Finished, waiting for the writer task
+    };
+
+    FILE* file_ = nullptr;
+    Page pages_[2];
+    int active_ = 0;                // The page being filled
+    int write_next_ = 0;            // The page the writer task waits for
+    uint32_t serial_ = 0;
+    uint32_t page_sequence_ = 0;
+    int64_t granule_ = 0;           // 48 kHz samples written so far
+    uint32_t dropped_ = 0;
+    bool failed_ = false;
+
+    TaskHandle_t write_task_ = nullptr;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+
+    bool AppendPacket(Page& page, const uint8_t* data, size_t size);
+    void FinishPage(Page& page, uint8_t flags);
+    void WaitForWriter(std::unique_lock<std::mutex>& lock);
+    void WriteTask();
+};
+
+/*
+ * Reads the Opus packets of an Ogg Opus file one page at a time, so playback of a long recording
+ * keeps a single page in RAM. Only used by one task.
+ */
+class OggOpusFileReader {
+public:
+    OggOpusFileReader() = default;
+    ~OggOpusFileReader();
+    OggOpusFileReader(const OggOpusFileReader&) = delete;
+    OggOpusFileReader& operator=(const OggOpusFileReader&) = delete;
+
+    bool Open(const char* path);
+    void Close();
+    // The next audio packet, false at the end of the file or at a damaged page
+    bool Read(std::vector<uint8_t>& packet, int& frame_duration_ms);
+
+    bool is_open() const { return file_ != nullptr; }
+    int sample_rate() const { return sample_rate_; }
+
+private:
+    FILE* file_ = nullptr;
+    std::vector<uint8_t> body_;
+    uint8_t lacing_[255];
+    size_t segments_ = 0;
+    size_t segment_ = 0;
+    size_t offset_ = 0;
+    bool continued_ = false;
+    int64_t granule_ = 0;
+    int headers_ = 0;               // OpusHead and OpusTags seen
+    int sample_rate_ = 16000;
+    int frame_duration_ = 60;
+
+    bool ReadPage();
+};
+
+#endif // OGG_OPUS_FILE_H
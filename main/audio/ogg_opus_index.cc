@@ -0,0 +1,135 @@
+#include "ogg_opus_index.h"
+#include <esp_log.h>
+#include <cstring>
+
+#define TAG "OggOpusIndex"
+
+#define OGG_PAGE_HEADER_SIZE 27
+
+
+static uint32_t ReadLe32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Find the next capture pattern at or after offset, only needed to step over a damaged page
+static size_t FindPage(const uint8_t* buf, size_t size, size_t offset) {
+    while (offset + 4 <= size) {
+        auto p = static_cast<const uint8_t*>(memchr(buf + offset, 'O', size - offset - 3));
+        if (p == nullptr) {
+            break;
+        }
+        if (memcmp(p, "OggS", 4) == 0) {
+            return p - buf;
+        }
+        offset = p - buf + 1;
+    }
+    return size;
+}
+
+bool OggOpusIndex::Build(std::string_view ogg) {
+    const uint8_t* buf = reinterpret_cast<const uint8_t*>(ogg.data());
+    size_t size = ogg.size();
+    data_ = buf;
+    size_ = size;
+    packets_.clear();
+    joined_.clear();
+    pending_.clear();
+    seen_head_ = false;
+    seen_tags_ = false;
+    sample_rate_ = 16000; // 默认值
+    first_page_crc_ = size >= OGG_PAGE_HEADER_SIZE ? ReadLe32(buf + 22) : 0;
+
+    size_t offset = 0;
+    while (offset + OGG_PAGE_HEADER_SIZE <= size) {
+        const uint8_t* page = buf + offset;
+        if (memcmp(page, "OggS", 4) != 0) {
+            offset = FindPage(buf, size, offset + 1);
+            pending_.clear();
+            continue;
+        }
+
+        uint8_t page_segments = page[26];
+        size_t body_off = offset + OGG_PAGE_HEADER_SIZE + page_segments;
+        if (body_off > size) {
+            break;
+        }
+        size_t body_size = 0;
+        for (size_t i = 0; i < page_segments; ++i) {
+            body_size += page[OGG_PAGE_HEADER_SIZE + i];
+        }
+        if (body_off + body_size > size) {
+            break;
+        }
+
+        // A packet ends at the first lacing value below 255
+        bool continued = (page[5] & 0x01) != 0;
+        if (!continued) {
+            pending_.clear();
+        }
+        // The head of a packet lost with a damaged page, its tail is of no use
+        bool drop_first = continued && pending_.empty();
+        size_t pkt_start = body_off;
+        size_t cur = body_off;
+        for (size_t i = 0; i < page_segments; ++i) {
+            uint8_t lacing = page[OGG_PAGE_HEADER_SIZE + i];
+            cur += lacing;
+            if (lacing == 255) {
+                continue;
+            }
+            if (drop_first) {
+                drop_first = false;
+            } else if (!pending_.empty()) {
+                pending_.insert(pending_.end(), buf + pkt_start, buf + cur);
+                AddPacket(pending_.data(), pending_.size(), true);
+                pending_.clear();
+            } else if (cur > pkt_start) {
+                AddPacket(buf + pkt_start, cur - pkt_start, false);
+            }
+            pkt_start = cur;
+        }
+        if (cur > pkt_start && !drop_first) {
+            // The last packet goes on in the next page
+            pending_.insert(pending_.end(), buf + pkt_start, buf + cur);
+        }
+
+        offset = body_off + body_size;
+    }
+
+    if (!seen_tags_) {
+        ESP_LOGW(TAG, "No Opus stream found in %u bytes", size);
+        return false;
+    }
+    return true;
+}
+
+void OggOpusIndex::AddPacket(const uint8_t* data, size_t size, bool joined) {
+    if (!seen_head_) {
+        // OpusHead结构：[0-7] "OpusHead", [8] version, [9] channel_count, [10-11] pre_skip
+        // [12-15] input_sample_rate, [16-17] output_gain, [18] mapping_family
+        if (size >= 19 && memcmp(data, "OpusHead", 8) == 0) {
+            seen_head_ = true;
+            sample_rate_ = ReadLe32(data + 12);
+            ESP_LOGI(TAG, "OpusHead: version=%d, channels=%d, sample_rate=%d", data[8], data[9], sample_rate_);
+        }
+        return;
+    }
+    if (!seen_tags_) {
+        // Expect OpusTags in second packet
+        if (size >= 8 && memcmp(data, "OpusTags", 8) == 0) {
+            seen_tags_ = true;
+        }
+        return;
+    }
+
+    if (joined) {
+        joined_.emplace_back(data, data + size);
+        data = joined_.back().data();
+    }
+    packets_.push_back({data, size});
+}
+
+bool OggOpusIndex::Matches(std::string_view ogg) const {
+    const uint8_t* buf = reinterpret_cast<const uint8_t*>(ogg.data());
+    return buf == data_ && ogg.size() == size_ && size_ >= OGG_PAGE_HEADER_SIZE &&
+        ReadLe32(buf + 22) == first_page_crc_;
+}
@@ -0,0 +1,43 @@
+#ifndef OGG_OPUS_INDEX_H
+#define OGG_OPUS_INDEX_H
+
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "protocol.h"
+
+/*
+ * Index of the Opus audio packets in an Ogg Opus stream, built once without copying the stream.
+ *
+ * Pages are walked by their header sizes, the stream is only scanned for the capture pattern when
+ * a page is damaged. Every packet that lies in a single page is a view into the stream itself, so
+ * the stream must stay mapped as long as the index is used. Packets continued across pages are
+ * not contiguous; those few are joined into buffers owned by the index.
+ */
+class OggOpusIndex {
+public:
+    bool Build(std::string_view ogg);
+
+    // Cheap check that a cached index still describes this stream
+    bool Matches(std::string_view ogg) const;
+
+    int sample_rate() const { return sample_rate_; }
+    const std::vector<OpusPacketView>& packets() const { return packets_; }
+
+private:
+    std::vector<OpusPacketView> packets_;
+    std::vector<std::vector<uint8_t>> joined_;
+    std::vector<uint8_t> pending_;
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    uint32_t first_page_crc_ = 0;
+    int sample_rate_ = 16000;
+    bool seen_head_ = false;
+    bool seen_tags_ = false;
+
+    void AddPacket(const uint8_t* data, size_t size, bool joined);
+};
+
+#endif // OGG_OPUS_INDEX_H
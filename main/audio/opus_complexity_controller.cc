@@ -0,0 +1,61 @@
+#include "opus_complexity_controller.h"
+
+#include <esp_log.h>
+
+#define TAG "OpusComplexity"
+
+
+bool OpusComplexityController::Record(uint32_t encode_us, int frame_duration_ms) {
+    if (max_complexity_ <= 0 || frame_duration_ms <= 0) {
+        return false;
+    }
+    uint32_t load = encode_us / (frame_duration_ms * 10);
+    window_ms_ += frame_duration_ms;
+    window_load_ += (uint64_t)load * frame_duration_ms;
+    if (load > window_peak_) {
+        window_peak_ = load;
+    }
+    hold_ms_ = hold_ms_ > (uint32_t)frame_duration_ms ? hold_ms_ - frame_duration_ms : 0;
+
+    // A frame close to its deadline backs up the encode queue, do not wait for the window
+    if (load > OPUS_LOAD_PEAK_PERCENT && complexity_ > 0) {
+        StepDown("peak", load);
+        return true;
+    }
+    if (window_ms_ < OPUS_LOAD_WINDOW_MS) {
+        return false;
+    }
+
+    uint32_t average = window_load_ / window_ms_;
+    stats_.load_percent = average;
+    stats_.peak_percent = window_peak_;
+    if (average > OPUS_LOAD_HIGH_PERCENT && complexity_ > 0) {
+        StepDown("average", average);
+        return true;
+    }
+    bool step_up = average < OPUS_LOAD_LOW_PERCENT && window_peak_ <= OPUS_LOAD_HIGH_PERCENT &&
+        hold_ms_ == 0 && complexity_ < max_complexity_;
+    ResetWindow();
+    if (step_up) {
+        complexity_++;
+        stats_.steps_up++;
+        ESP_LOGI(TAG, "Complexity up to %d, load avg %lu%%, peak %lu%%", complexity_,
+            stats_.load_percent, stats_.peak_percent);
+    }
+    return step_up;
+}
+
+void OpusComplexityController::StepDown(const char* reason, uint32_t load_percent) {
+    complexity_--;
+    stats_.steps_down++;
+    hold_ms_ = OPUS_LOAD_UP_HOLD_MS;
+    ESP_LOGW(TAG, "Complexity down to %d, %s load %lu%%", complexity_, reason, load_percent);
+    // The frames measured at the old level say nothing about the new one
+    ResetWindow();
+}
+
+void OpusComplexityController::ResetWindow() {
+    window_ms_ = 0;
+    window_load_ = 0;
+    window_peak_ = 0;
+}
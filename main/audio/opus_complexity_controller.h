@@ -0,0 +1,57 @@
+#ifndef OPUS_COMPLEXITY_CONTROLLER_H
+#define OPUS_COMPLEXITY_CONTROLLER_H
+
+#include <cstdint>
+
+// Encode load is the encode time of a frame in percent of the frame duration
+#define OPUS_LOAD_WINDOW_MS 2000
+#define OPUS_LOAD_PEAK_PERCENT 80       // One frame above this steps down at once
+#define OPUS_LOAD_HIGH_PERCENT 50       // A window averaging above this steps down
+#define OPUS_LOAD_LOW_PERCENT 25        // A window averaging below this, with no frame above HIGH, steps up
+#define OPUS_LOAD_UP_HOLD_MS 10000      // Audio encoded after a step down before stepping up again
+
+struct OpusComplexityStats {
+    uint32_t steps_up = 0;
+    uint32_t steps_down = 0;
+    uint32_t load_percent = 0;      // Average of the last full window
+    uint32_t peak_percent = 0;      // Highest frame of the last full window
+};
+
+/*
+ * Picks the uplink Opus complexity from the encode time of every frame.
+ *
+ * Load is measured against the frame deadline, so it covers the encode itself and the time other
+ * tasks (AFE, display, camera) take the core away from the encoder. Overload steps down right away,
+ * spare time only steps up after a whole quiet window and a hold since the last step down, so the
+ * level does not flap around a threshold. Times are audio time, the sum of the frame durations.
+ *
+ * The bitrate is not adapted. At a given complexity it barely changes the encode time, and the
+ * esp-opus-encoder wrapper has no setter for it, so it stays at the encoder's default.
+ *
+ * Only the opus encode task calls Record().
+ */
+class OpusComplexityController {
+public:
+    explicit OpusComplexityController(int max_complexity) : max_complexity_(max_complexity) {}
+
+    // Returns true when the complexity changed and must be applied to the encoder
+    bool Record(uint32_t encode_us, int frame_duration_ms);
+
+    int complexity() const { return complexity_; }
+    int max_complexity() const { return max_complexity_; }
+    const OpusComplexityStats& stats() const { return stats_; }
+
+private:
+    const int max_complexity_;
+    int complexity_ = 0;
+    OpusComplexityStats stats_;
+    uint32_t window_ms_ = 0;
+    uint64_t window_load_ = 0;      // Sum of percent times ms
+    uint32_t window_peak_ = 0;
+    uint32_t hold_ms_ = 0;
+
+    void StepDown(const char* reason, uint32_t load_percent);
+    void ResetWindow();
+};
+
+#endif // OPUS_COMPLEXITY_CONTROLLER_H
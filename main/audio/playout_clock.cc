@@ -0,0 +1,78 @@
+#include "playout_clock.h"
+
+// A write that takes longer than this waited for DMA room, the queue was full when it returned
+#define PLAYOUT_CLOCK_BLOCKED_US 1000
+
+
+void PlayoutClock::Configure(int sample_rate, size_t dma_samples, size_t dma_frame_samples) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sample_rate_ = sample_rate;
+    dma_us_ = (uint64_t)dma_samples * 1000000 / sample_rate;
+    dma_frame_samples_ = dma_frame_samples;
+    dma_frame_us_ = (uint64_t)dma_frame_samples * 1000000 / sample_rate;
+    dma_frame_fill_ = 0;
+    playing_ = false;
+    segment_count_ = 0;
+    segment_next_ = 0;
+}
+
+void PlayoutClock::OnWrite(uint32_t timestamp_ms, size_t samples, uint32_t delay_us, uint32_t start_us, uint32_t end_us) {
+    if (sample_rate_ == 0 || samples == 0) {
+        return;
+    }
+    uint32_t duration_us = (uint64_t)samples * 1000000 / sample_rate_;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint32_t playout_end_us;
+    if ((int32_t)(end_us - start_us) > PLAYOUT_CLOCK_BLOCKED_US) {
+        playout_end_us = end_us + dma_us_;
+    } else if (playing_ && (int32_t)(playout_end_us_ - start_us) >= 0) {
+        playout_end_us = playout_end_us_ + duration_us;
+    } else {
+        /*
+         * The queue ran dry. The rest of the last descriptor was padded with silence and the DMA kept
+         * sending descriptors since, the block goes into the one after the descriptor playing now
+         */
+        uint32_t residual_us = 0;
+        if (playing_ && dma_frame_us_ > 0) {
+            uint32_t padding = (dma_frame_samples_ - dma_frame_fill_) % dma_frame_samples_;
+            uint32_t boundary_us = playout_end_us_ + (uint64_t)padding * 1000000 / sample_rate_;
+            int32_t idle_us = start_us - boundary_us;
+            residual_us = idle_us <= 0 ? -idle_us : (dma_frame_us_ - idle_us % dma_frame_us_) % dma_frame_us_;
+        }
+        playout_end_us = start_us + residual_us + duration_us;
+        dma_frame_fill_ = 0;
+    }
+    playout_end_us_ = playout_end_us;
+    playing_ = true;
+    if (dma_frame_samples_ > 0) {
+        dma_frame_fill_ = (dma_frame_fill_ + samples) % dma_frame_samples_;
+    }
+
+    if (timestamp_ms == 0) {
+        return;
+    }
+    Segment& segment = segments_[segment_next_];
+    segment.start_us = playout_end_us - duration_us;
+    segment.duration_us = duration_us;
+    segment.timestamp_ms = timestamp_ms;
+    segment.delay_us = delay_us;
+    segment_next_ = (segment_next_ + 1) % PLAYOUT_CLOCK_SEGMENTS;
+    if (segment_count_ < PLAYOUT_CLOCK_SEGMENTS) {
+        segment_count_++;
+    }
+}
+
+uint32_t PlayoutClock::TimestampAt(uint32_t time_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Newest first, a later write wins where a resync made segments overlap
+    for (size_t i = 1; i <= segment_count_; i++) {
+        const Segment& segment = segments_[(segment_next_ + PLAYOUT_CLOCK_SEGMENTS - i) % PLAYOUT_CLOCK_SEGMENTS];
+        int32_t offset_us = time_us - segment.start_us;
+        if (offset_us >= 0 && offset_us < (int32_t)segment.duration_us) {
+            int32_t stream_us = offset_us - (int32_t)segment.delay_us;
+            return segment.timestamp_ms + stream_us / 1000;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef PLAYOUT_CLOCK_H
+#define PLAYOUT_CLOCK_H
+
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+
+#define PLAYOUT_CLOCK_SEGMENTS 32
+
+/*
+ * Maps wall time to the downlink stream timestamp the speaker was emitting, for server side AEC.
+ *
+ * Every block written to the codec becomes a segment of the play-out timeline. A write that blocks
+ * returns once its last sample is in a full DMA queue, so that sample plays dma_samples later; a
+ * write that does not block follows the previous block. After an underrun the DMA has kept cycling
+ * its descriptors of dma_frame_samples with silence, so the block starts when the descriptor that
+ * is playing ends, not when it is written. Filter delay in the PCM shifts the segment's stream
+ * time back.
+ *
+ * Times are 32-bit microseconds from AudioLatencyTracer::Now(), compared by signed difference.
+ */
+class PlayoutClock {
+public:
+    void Configure(int sample_rate, size_t dma_samples, size_t dma_frame_samples);
+
+    // Called by the output task around every codec write
+    void OnWrite(uint32_t timestamp_ms, size_t samples, uint32_t delay_us, uint32_t start_us, uint32_t end_us);
+    // Stream timestamp in ms of the sample playing at time_us, 0 if no timestamped audio was playing
+    uint32_t TimestampAt(uint32_t time_us);
+
+private:
+    struct Segment {
+        uint32_t start_us;
+        uint32_t duration_us;
+        uint32_t timestamp_ms;
+        uint32_t delay_us;
+    };
+
+    std::mutex mutex_;
+    Segment segments_[PLAYOUT_CLOCK_SEGMENTS];
+    size_t segment_count_ = 0;
+    size_t segment_next_ = 0;
+    int sample_rate_ = 0;
+    uint32_t dma_us_ = 0;
+    size_t dma_frame_samples_ = 0;
+    uint32_t dma_frame_us_ = 0;
+    size_t dma_frame_fill_ = 0;     // Samples in the descriptor the last write ended in
+    bool playing_ = false;
+    uint32_t playout_end_us_ = 0;   // When the last written sample leaves the speaker
+};
+
+#endif // PLAYOUT_CLOCK_H
@@ -0,0 +1,161 @@
+#include "polyphase_resampler.h"
+#include "audio_kernels.h"
+#include <esp_log.h>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <utility>
+
+#define TAG "PolyphaseResampler"
+
+// Passband edge as a fraction of the lower Nyquist frequency, and the Kaiser window shape
+#define RESAMPLER_ROLLOFF 0.92
+#define RESAMPLER_KAISER_BETA 8.0
+
+static_assert(POLYPHASE_RESAMPLER_TAPS % 16 == 0, "the vector dot product takes taps in blocks of 16");
+
+struct PolyphaseResampler::Table {
+    uint32_t up;        // L
+    uint32_t down;      // M
+    uint32_t taps;      // Per phase, a multiple of 16
+    // Phase p holds its taps reversed, so the dot product walks the delay line forward. Every
+    // phase starts aligned for the vector path of AudioKernels::DotProduct().
+    int16_t* coeffs;
+    std::unique_ptr<int16_t[]> storage;
+};
+
+// Zeroth order modified Bessel function of the first kind, for the Kaiser window
+static double BesselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+static std::shared_ptr<const PolyphaseResampler::Table> BuildTable(uint32_t up, uint32_t down) {
+    // Decimation narrows the passband, the filter gets longer by the same factor to keep its slope
+    const uint32_t taps = POLYPHASE_RESAMPLER_TAPS * std::max(1u, (down + up - 1) / up);
+    const size_t length = up * taps;
+    // Cutoff in cycles per sample of the upsampled stream
+    const double cutoff = 0.5 * RESAMPLER_ROLLOFF / std::max(up, down);
+    const double center = (length - 1) / 2.0;
+    const double i0_beta = BesselI0(RESAMPLER_KAISER_BETA);
+
+    auto table = std::make_shared<PolyphaseResampler::Table>();
+    table->up = up;
+    table->down = down;
+    table->taps = taps;
+    const size_t alignment = AUDIO_KERNELS_ALIGNMENT / sizeof(int16_t);
+    table->storage = std::make_unique<int16_t[]>(length + alignment);
+    table->coeffs = table->storage.get() +
+        (alignment - (uintptr_t)table->storage.get() % AUDIO_KERNELS_ALIGNMENT / sizeof(int16_t)) % alignment;
+    for (size_t n = 0; n < length; n++) {
+        double t = n - center;
+        double sinc = t == 0 ? 2.0 * cutoff : std::sin(2.0 * M_PI * cutoff * t) / (M_PI * t);
+        double r = t / center;
+        double window = BesselI0(RESAMPLER_KAISER_BETA * std::sqrt(std::max(0.0, 1.0 - r * r))) / i0_beta;
+        // Zero stuffing divides the level by L, the filter makes up for it
+        double value = std::round(sinc * window * up * 32768.0);
+        value = std::min(32767.0, std::max(-32768.0, value));
+        size_t phase = n % up;
+        size_t tap = n / up;
+        table->coeffs[phase * taps + (taps - 1 - tap)] = (int16_t)value;
+    }
+    return table;
+}
+
+static std::shared_ptr<const PolyphaseResampler::Table> GetTable(uint32_t up, uint32_t down) {
+    static std::mutex mutex;
+    static std::map<std::pair<uint32_t, uint32_t>, std::shared_ptr<const PolyphaseResampler::Table>> tables;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& table = tables[std::make_pair(up, down)];
+    if (table == nullptr) {
+        table = BuildTable(up, down);
+        ESP_LOGI(TAG, "Built %lu/%lu filter table, %lu taps", up, down, up * table->taps);
+    }
+    return table;
+}
+
+void PolyphaseResampler::Configure(int input_sample_rate, int output_sample_rate) {
+    if (input_sample_rate <= 0 || output_sample_rate <= 0) {
+        ESP_LOGE(TAG, "Invalid sample rates %d -> %d", input_sample_rate, output_sample_rate);
+        return;
+    }
+    uint32_t divisor = std::gcd(input_sample_rate, output_sample_rate);
+    table_ = GetTable(output_sample_rate / divisor, input_sample_rate / divisor);
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+    Reset();
+}
+
+void PolyphaseResampler::Reset() {
+    line_.assign(table_ != nullptr ? table_->taps - 1 : 0, 0);
+    time_ = 0;
+}
+
+size_t PolyphaseResampler::GetOutputSamples(size_t samples) const {
+    if (table_ == nullptr) {
+        return 0;
+    }
+    uint64_t end = (uint64_t)samples * table_->up;
+    if (end <= time_) {
+        return 0;
+    }
+    return (end - time_ + table_->down - 1) / table_->down;
+}
+
+uint32_t PolyphaseResampler::delay_us() const {
+    if (table_ == nullptr) {
+        return 0;
+    }
+    // The prototype is linear phase, its centre is (up * taps - 1) / 2 samples in at up times the input rate
+    return (uint64_t)(table_->up * table_->taps - 1) * 1000000 / (2ull * table_->up * input_sample_rate_);
+}
+
+size_t PolyphaseResampler::Process(const int16_t* in, size_t samples, int16_t* out) {
+    if (table_ == nullptr) {
+        return 0;
+    }
+    const uint32_t taps = table_->taps;
+    const size_t history = taps - 1;
+    const uint32_t up = table_->up;
+    const uint32_t down = table_->down;
+    const int16_t* coeffs = table_->coeffs;
+
+    // The padding after the block is read, never used, by the vector loads of the dot product
+    line_.resize(history + samples + AUDIO_KERNELS_PADDING);
+    memcpy(line_.data() + history, in, samples * sizeof(int16_t));
+    const int16_t* line = line_.data();
+
+    size_t count = 0;
+    uint32_t end = samples * up;
+    uint32_t time = time_;
+    while (time < end) {
+        uint32_t index = time / up;
+        uint32_t phase = time - index * up;
+        out[count++] = AudioKernels::DotProduct(line + index, coeffs + phase * taps, taps);
+        time += down;
+    }
+    time_ = time - end;
+
+    memmove(line_.data(), line_.data() + samples, history * sizeof(int16_t));
+    line_.resize(history);
+    return count;
+}
+
+void PolyphaseResampler::Process(std::vector<int16_t>& pcm) {
+    size_t samples = pcm.size();
+    size_t output_samples = GetOutputSamples(samples);
+    if (output_samples > samples) {
+        pcm.resize(output_samples);
+    }
+    pcm.resize(Process(pcm.data(), samples, pcm.data()));
+}
@@ -0,0 +1,48 @@
+#ifndef POLYPHASE_RESAMPLER_H
+#define POLYPHASE_RESAMPLER_H
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#define POLYPHASE_RESAMPLER_TAPS 32
+
+/*
+ * Streaming rational resampler for 16-bit mono PCM, a polyphase FIR with Q15 coefficients.
+ *
+ * The ratio is reduced to L/M (24k -> 16k is 2/3, 24k -> 44.1k is 147/80) and every phase of the
+ * Kaiser windowed sinc prototype gets POLYPHASE_RESAMPLER_TAPS taps, M/L times that when decimating.
+ * The tables are built the first time a ratio is configured and shared by all resamplers, so
+ * switching rates back and forth costs nothing after that.
+ *
+ * The filter history is carried across calls, a stream may be fed in blocks of any size.
+ * Process() copies its input into the delay line before writing any output, so out may alias in.
+ */
+class PolyphaseResampler {
+public:
+    struct Table;
+
+    void Configure(int input_sample_rate, int output_sample_rate);
+    void Reset();
+
+    // Exact number of samples the next Process() call produces for `samples` input samples
+    size_t GetOutputSamples(size_t samples) const;
+    // Group delay of the filter, the output lags the input by this much
+    uint32_t delay_us() const;
+    size_t Process(const int16_t* in, size_t samples, int16_t* out);
+    // In place, pcm is resized to the output
+    void Process(std::vector<int16_t>& pcm);
+
+    int input_sample_rate() const { return input_sample_rate_; }
+    int output_sample_rate() const { return output_sample_rate_; }
+
+private:
+    std::shared_ptr<const Table> table_;
+    std::vector<int16_t> line_;     // taps - 1 samples of history, then the input block and padding
+    uint32_t time_ = 0;             // Next output position in 1/L input samples, from the start of the next block
+    int input_sample_rate_ = 0;
+    int output_sample_rate_ = 0;
+};
+
+#endif // POLYPHASE_RESAMPLER_H
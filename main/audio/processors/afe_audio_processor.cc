@@ -1,5 +1,6 @@
 #include "afe_audio_processor.h"
 #include <esp_log.h>
+#include <esp_heap_caps.h>
 #include "settings.h"
 
 #define PROCESSOR_RUNNING 0x01
@@ -13,10 +14,6 @@ AfeAudioProcessor::AfeAudioProcessor()
 
 void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) {
     codec_ = codec;
-    frame_samples_ = frame_duration_ms * 16000 / 1000;
-
-    // Pre-allocate output buffer capacity
-    output_buffer_.reserve(frame_samples_);
 
     int ref_num = codec_->input_reference() ? 1 : 0;
 
@@ -72,6 +69,11 @@ void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srm
     afe_iface_ = esp_afe_handle_from_config(afe_config);
     afe_data_ = afe_iface_->create_from_config(afe_config);
 
+    // The fetch size rarely divides the frame size (512 vs 960 samples), the framer carries the remainder
+    framer_.Initialize(AFE_MAX_FRAME_DURATION_MS * 16000 / 1000, afe_iface_->get_fetch_chunksize(afe_data_),
+        MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    framer_.SetFrameSamples(frame_duration_ms * 16000 / 1000);
+
     xTaskCreatePinnedToCore([](void* arg) {
         auto this_ = (AfeAudioProcessor*)arg;
         this_->AudioProcessorTask();
@@ -100,6 +102,11 @@ void AfeAudioProcessor::Feed(std::vector<int16_t>&& data) {
     afe_iface_->feed(afe_data_, data.data());
 }
 
+void AfeAudioProcessor::SetFrameDuration(int frame_duration_ms) {
+    // The task may be inside framer_.Push(), it switches between two fetches
+    pending_frame_duration_ = frame_duration_ms;
+}
+
 void AfeAudioProcessor::Start() {
     xEventGroupSetBits(event_group_, PROCESSOR_RUNNING);
 }
@@ -154,25 +161,12 @@ void AfeAudioProcessor::AudioProcessorTask() {
             }
         }
 
+        int frame_duration_ms = pending_frame_duration_.exchange(0);
+        if (frame_duration_ms != 0) {
+            framer_.SetFrameSamples(frame_duration_ms * 16000 / 1000);
+        }
         if (output_callback_) {
-            size_t samples = res->data_size / sizeof(int16_t);
-            
-            // Add data to buffer
-            output_buffer_.insert(output_buffer_.end(), res->data, res->data + samples);
-            
-            // Output complete frames when buffer has enough data
-            while (output_buffer_.size() >= frame_samples_) {
-                if (output_buffer_.size() == frame_samples_) {
-                    // If buffer size equals frame size, move the entire buffer
-                    output_callback_(std::move(output_buffer_));
-                    output_buffer_.clear();
-                    output_buffer_.reserve(frame_samples_);
-                } else {
-                    // If buffer size exceeds frame size, copy one frame and remove it
-                    output_callback_(std::vector<int16_t>(output_buffer_.begin(), output_buffer_.begin() + frame_samples_));
-                    output_buffer_.erase(output_buffer_.begin(), output_buffer_.begin() + frame_samples_);
-                }
-            }
+            framer_.Push(res->data, res->data_size / sizeof(int16_t), output_callback_);
         }
     }
 }
@@ -6,12 +6,17 @@
 #include <freertos/task.h>
 #include <freertos/event_groups.h>
 
+#include <atomic>
 #include <string>
 #include <vector>
 #include <functional>
 
 #include "audio_processor.h"
 #include "audio_codec.h"
+#include "audio_framer.h"
+
+// Longest uplink frame the processor is asked to emit
+#define AFE_MAX_FRAME_DURATION_MS 60
 
 class AfeAudioProcessor : public AudioProcessor {
 public:
@@ -19,6 +24,7 @@ public:
     ~AfeAudioProcessor();
 
     void Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) override;
+    void SetFrameDuration(int frame_duration_ms) override;
     void Feed(std::vector<int16_t>&& data) override;
     void Start() override;
     void Stop() override;
@@ -35,9 +41,9 @@ private:
     std::function<void(std::vector<int16_t>&& data)> output_callback_;
     std::function<void(bool speaking)> vad_state_change_callback_;
     AudioCodec* codec_ = nullptr;
-    int frame_samples_ = 0;
     bool is_speaking_ = false;
-    std::vector<int16_t> output_buffer_;
+    AudioFramer framer_;    // Owned by the processor task once it runs
+    std::atomic<int> pending_frame_duration_ = 0;
 
     void AudioProcessorTask();
 };
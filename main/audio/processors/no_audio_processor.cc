@@ -0,0 +1,61 @@
+#include "no_audio_processor.h"
+#include <esp_log.h>
+
+#define TAG "NoAudioProcessor"
+
+void NoAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms, srmodel_list_t* models_list) {
+    codec_ = codec;
+    frame_samples_ = frame_duration_ms * 16000 / 1000;
+}
+
+void NoAudioProcessor::SetFrameDuration(int frame_duration_ms) {
+    frame_samples_ = frame_duration_ms * 16000 / 1000;
+}
+
+/* The input task feeds the mic and the reference channel interleaved, only the mic is kept */
+void NoAudioProcessor::Feed(std::vector<int16_t>&& data) {
+    if (!is_running_ || !output_callback_) {
+        return;
+    }
+
+    // Compact the mic channel in place, the vector keeps its capacity for the next frame
+    size_t frames = data.size() / 2;
+    for (size_t i = 0; i < frames; i++) {
+        data[i] = data[i * 2];
+    }
+    data.resize(frames);
+    output_callback_(std::move(data));
+}
+
+void NoAudioProcessor::Start() {
+    is_running_ = true;
+}
+
+void NoAudioProcessor::Stop() {
+    is_running_ = false;
+}
+
+bool NoAudioProcessor::IsRunning() {
+    return is_running_;
+}
+
+void NoAudioProcessor::OnOutput(std::function<void(std::vector<int16_t>&& data)> callback) {
+    output_callback_ = callback;
+}
+
+void NoAudioProcessor::OnVadStateChange(std::function<void(bool speaking)> callback) {
+    vad_state_change_callback_ = callback;
+}
+
+size_t NoAudioProcessor::GetFeedSize() {
+    if (!codec_) {
+        return 0;
+    }
+    return frame_samples_;
+}
+
+void NoAudioProcessor::EnableDeviceAec(bool enable) {
+    if (enable) {
+        ESP_LOGE(TAG, "Device AEC is not supported");
+    }
+}
@@ -0,0 +1,144 @@
+#include "wake_word_preroll.h"
+#include "audio_service.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cassert>
+
+#define TAG "WakeWordPreroll"
+
+
+WakeWordPreroll::~WakeWordPreroll() {
+    if (encode_task_ != nullptr) {
+        vTaskDelete(encode_task_);
+    }
+    if (encode_task_stack_ != nullptr) {
+        heap_caps_free(encode_task_stack_);
+    }
+    if (encode_task_buffer_ != nullptr) {
+        heap_caps_free(encode_task_buffer_);
+    }
+}
+
+bool WakeWordPreroll::Initialize() {
+    if (encode_task_ != nullptr) {
+        return true;
+    }
+
+    frame_samples_ = 16000 * OPUS_FRAME_DURATION_MS / 1000;
+    if (!pcm_.Allocate(16000 * WAKE_WORD_PCM_BACKLOG_MS / 1000, MALLOC_CAP_SPIRAM)) {
+        ESP_LOGE(TAG, "Failed to allocate the PCM buffer");
+        return false;
+    }
+    packet_capacity_ = WAKE_WORD_PREROLL_MS / OPUS_FRAME_DURATION_MS;
+    packets_ = std::make_unique<std::vector<uint8_t>[]>(packet_capacity_);
+
+    encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
+    encoder_->SetComplexity(0); // 0 is the fastest
+
+    const size_t stack_size = 4096 * 7;
+    encode_task_stack_ = (StackType_t*)heap_caps_malloc(stack_size, MALLOC_CAP_SPIRAM);
+    encode_task_buffer_ = (StaticTask_t*)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL);
+    assert(encode_task_stack_ != nullptr && encode_task_buffer_ != nullptr);
+    encode_task_ = xTaskCreateStatic([](void* arg) {
+        auto this_ = (WakeWordPreroll*)arg;
+        this_->EncodeTask();
+        vTaskDelete(NULL);
+    }, "encode_wake_word", stack_size, this, 2, encode_task_stack_, encode_task_buffer_);
+    return true;
+}
+
+void WakeWordPreroll::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    generation_++;
+    pcm_.Clear();
+    packet_head_ = 0;
+    packet_count_ = 0;
+    handoff_requested_ = false;
+    handed_over_ = false;
+    reset_encoder_ = true;
+    cv_.notify_all();
+}
+
+void WakeWordPreroll::Store(const int16_t* data, size_t samples) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pcm_.capacity() == 0 || handoff_requested_ || handed_over_) {
+        return;
+    }
+    pcm_.Write(data, samples);
+    if (pcm_.size() >= frame_samples_) {
+        cv_.notify_all();
+    }
+}
+
+void WakeWordPreroll::Encode() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (encode_task_ == nullptr) {
+        handed_over_ = true;
+    } else if (!handed_over_) {
+        handoff_requested_ = true;
+    }
+    cv_.notify_all();
+}
+
+bool WakeWordPreroll::GetOpus(std::vector<uint8_t>& opus) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() {
+        return handed_over_;
+    });
+    if (packet_count_ == 0) {
+        return false;
+    }
+    // The slot gets the caller's buffer in exchange, no packet is copied
+    opus.swap(packets_[packet_head_]);
+    packet_head_ = (packet_head_ + 1) % packet_capacity_;
+    packet_count_--;
+    return true;
+}
+
+void WakeWordPreroll::EncodeTask() {
+    std::vector<int16_t> frame;
+    std::vector<uint8_t> opus;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this]() {
+            return reset_encoder_ || handoff_requested_ || pcm_.size() >= frame_samples_;
+        });
+
+        if (reset_encoder_) {
+            reset_encoder_ = false;
+            lock.unlock();
+            encoder_->ResetState();
+            lock.lock();
+            continue;
+        }
+
+        if (pcm_.size() >= frame_samples_) {
+            frame.resize(frame_samples_);
+            pcm_.Read(frame.data(), frame_samples_);
+            uint32_t generation = generation_;
+
+            lock.unlock();
+            bool encoded = encoder_->Encode(std::move(frame), opus);
+            lock.lock();
+
+            // Keep the last WAKE_WORD_PREROLL_MS, a frame that was captured before Reset() is dropped
+            if (encoded && generation == generation_) {
+                if (packet_count_ == packet_capacity_) {
+                    packet_head_ = (packet_head_ + 1) % packet_capacity_;
+                    packet_count_--;
+                }
+                packets_[(packet_head_ + packet_count_) % packet_capacity_].swap(opus);
+                packet_count_++;
+            }
+            continue;
+        }
+
+        // Every complete frame is encoded, the partial one at the end is dropped
+        handoff_requested_ = false;
+        handed_over_ = true;
+        pcm_.Clear();
+        ESP_LOGI(TAG, "Wake word pre-roll ready, %u packets", packet_count_);
+        cv_.notify_all();
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef WAKE_WORD_PREROLL_H
+#define WAKE_WORD_PREROLL_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <opus_encoder.h>
+
+#include "audio_framer.h"
+
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Audio kept ahead of a wake word, and the PCM backlog the encoder may fall behind by
+#define WAKE_WORD_PREROLL_MS 2000
+#define WAKE_WORD_PCM_BACKLOG_MS 480
+
+/*
+ * Opus pre-roll of the audio leading up to a wake word, encoded while the detector listens.
+ *
+ * Store() appends 16 kHz mono PCM to a fixed circular buffer, a background task encodes every
+ * complete frame with one persistent encoder and keeps the last WAKE_WORD_PREROLL_MS of packets in
+ * a ring. After detection Encode() only waits for the frame in flight, and GetOpus() swaps the
+ * packets out of the ring one by one.
+ */
+class WakeWordPreroll {
+public:
+    WakeWordPreroll() = default;
+    ~WakeWordPreroll();
+
+    bool Initialize();
+    // Drop the pre-roll, called when detection starts
+    void Reset();
+    void Store(const int16_t* data, size_t samples);
+    // Stop capturing and hand over the packets once the stored frames are encoded
+    void Encode();
+    bool GetOpus(std::vector<uint8_t>& opus);
+
+private:
+    std::unique_ptr<OpusEncoderWrapper> encoder_;
+    TaskHandle_t encode_task_ = nullptr;
+    StaticTask_t* encode_task_buffer_ = nullptr;
+    StackType_t* encode_task_stack_ = nullptr;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+
+    PcmRingBuffer pcm_;             // Overwrites the oldest samples when the encoder falls behind
+    size_t frame_samples_ = 0;
+
+    std::unique_ptr<std::vector<uint8_t>[]> packets_;
+    size_t packet_capacity_ = 0;
+    size_t packet_head_ = 0;
+    size_t packet_count_ = 0;
+
+    uint32_t generation_ = 0;       // Bumped by Reset(), a frame encoded across it is stale
+    bool reset_encoder_ = false;
+    bool handoff_requested_ = false;
+    bool handed_over_ = false;
+
+    void EncodeTask();
+};
+
+#endif // WAKE_WORD_PREROLL_H
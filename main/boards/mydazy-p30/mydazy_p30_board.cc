@@ -272,6 +272,7 @@ private:
         touch_driver_->SetTouchCallback([]() {
             auto& board = Board::GetInstance();
             board.WakeUP();
+            Application::GetInstance().GetAudioService().PrepareAudioPower(kAudioPowerHintTouch);
         });
 
         // 设置手势回调：单击唤醒/打断/退出对话，滑动调节音量
@@ -530,6 +531,13 @@ private:
     }
 
     void InitializeButtons() {
+        // 按下即预先打开音频通路，松开时已可直接播放/录音
+        boot_button_.OnPressDown([]() {
+            auto& app = Application::GetInstance();
+            app.GetAudioService().PrepareAudioPower(kAudioPowerHintButton);
+            app.PreConnect();
+        });
+
         boot_button_.OnClick([this]() {
             auto& app = Application::GetInstance();
             auto status = app.GetDeviceState();
@@ -158,6 +158,82 @@ void McpServer::AddUserOnlyTools() {
             return board.GetSystemInfoJson();
         });
 
+    AddUserOnlyTool("self.audio.get_latency_stats",
+        "Get the per-stage audio latency histograms, the jitter buffer, uplink gate and sound cache counters and the opus codec frame times and the adaptive encoder complexity",
+        PropertyList({
+            Property("reset", kPropertyTypeBoolean, false)
+        }),
+        [this](const PropertyList& properties) -> ReturnValue {
+            auto& audio_service = Application::GetInstance().GetAudioService();
+            auto& latency_tracer = audio_service.GetLatencyTracer();
+            cJSON* json = latency_tracer.ToJson();
+
+            auto& jitter = audio_service.GetJitterBufferStats();
+            cJSON* jitter_json = cJSON_CreateObject();
+            cJSON_AddNumberToObject(jitter_json, "late", jitter.late);
+            cJSON_AddNumberToObject(jitter_json, "duplicates", jitter.duplicates);
+            cJSON_AddNumberToObject(jitter_json, "lost", jitter.lost);
+            cJSON_AddNumberToObject(jitter_json, "concealed", jitter.concealed);
+            cJSON_AddNumberToObject(jitter_json, "underruns", jitter.underruns);
+            cJSON_AddNumberToObject(jitter_json, "resyncs", jitter.resyncs);
+            cJSON_AddNumberToObject(jitter_json, "jitter_ms", jitter.jitter_ms);
+            cJSON_AddNumberToObject(jitter_json, "target_delay_ms", jitter.target_delay_ms);
+            cJSON_AddItemToObject(json, "jitter_buffer", jitter_json);
+
+            auto add_codec_stats = [json](const char* name, const CodecTaskStatistics& stats) {
+                cJSON* stats_json = cJSON_CreateObject();
+                cJSON_AddNumberToObject(stats_json, "frames", stats.frames);
+                cJSON_AddNumberToObject(stats_json, "avg_us", stats.average_us());
+                cJSON_AddNumberToObject(stats_json, "max_us", stats.max_us);
+                cJSON_AddNumberToObject(stats_json, "deadline_misses", stats.deadline_misses);
+                cJSON_AddItemToObject(json, name, stats_json);
+            };
+            add_codec_stats("opus_encode", audio_service.GetEncodeStatistics());
+            add_codec_stats("opus_decode", audio_service.GetDecodeStatistics());
+
+            auto& complexity = audio_service.GetComplexityController();
+            cJSON* complexity_json = cJSON_CreateObject();
+            cJSON_AddNumberToObject(complexity_json, "complexity", complexity.complexity());
+            cJSON_AddNumberToObject(complexity_json, "max_complexity", complexity.max_complexity());
+            cJSON_AddNumberToObject(complexity_json, "load_percent", complexity.stats().load_percent);
+            cJSON_AddNumberToObject(complexity_json, "peak_percent", complexity.stats().peak_percent);
+            cJSON_AddNumberToObject(complexity_json, "steps_up", complexity.stats().steps_up);
+            cJSON_AddNumberToObject(complexity_json, "steps_down", complexity.stats().steps_down);
+            cJSON_AddItemToObject(json, "opus_complexity", complexity_json);
+
+            auto& gate = audio_service.GetUplinkGateStatistics();
+            cJSON* gate_json = cJSON_CreateObject();
+            cJSON_AddBoolToObject(gate_json, "active", audio_service.IsUplinkGateActive());
+            cJSON_AddNumberToObject(gate_json, "sent", gate.sent);
+            cJSON_AddNumberToObject(gate_json, "suppressed", gate.suppressed);
+            cJSON_AddNumberToObject(gate_json, "keepalive", gate.keepalive);
+            cJSON_AddNumberToObject(gate_json, "preroll", gate.preroll);
+            cJSON_AddItemToObject(json, "uplink_gate", gate_json);
+
+            auto sound_cache = audio_service.GetDecodedSoundCacheStats();
+            cJSON* sound_cache_json = cJSON_CreateObject();
+            cJSON_AddNumberToObject(sound_cache_json, "hits", sound_cache.hits);
+            cJSON_AddNumberToObject(sound_cache_json, "misses", sound_cache.misses);
+            cJSON_AddNumberToObject(sound_cache_json, "evictions", sound_cache.evictions);
+            cJSON_AddNumberToObject(sound_cache_json, "entries", sound_cache.entries);
+            cJSON_AddNumberToObject(sound_cache_json, "bytes", sound_cache.bytes);
+            cJSON_AddItemToObject(json, "sound_cache", sound_cache_json);
+
+            auto& power = audio_service.GetAudioPowerStatistics();
+            cJSON* power_json = cJSON_CreateObject();
+            cJSON_AddNumberToObject(power_json, "hints", power.hints);
+            cJSON_AddNumberToObject(power_json, "power_ups", power.power_ups);
+            cJSON_AddNumberToObject(power_json, "used", power.used);
+            cJSON_AddNumberToObject(power_json, "wasted", power.wasted);
+            cJSON_AddNumberToObject(power_json, "warmups_skipped", power.warmups_skipped);
+            cJSON_AddItemToObject(json, "power", power_json);
+
+            if (properties["reset"].value<bool>()) {
+                latency_tracer.Reset();
+            }
+            return json;
+        });
+
     AddUserOnlyTool("self.reboot", "Reboot the system",
         PropertyList(),
         [this](const PropertyList& properties) -> ReturnValue {
@@ -0,0 +1,272 @@
+#include "json_message.h"
+
+#include <cstring>
+#include <strings.h>
+
+namespace {
+
+class Scanner {
+public:
+    Scanner(const char* data, size_t len, char* buffer, size_t buffer_size)
+        : p_(data), end_(data + len), out_(buffer), out_end_(buffer + buffer_size) {}
+
+    bool ScanObject(JsonMessage& message);
+
+private:
+    const char* p_;
+    const char* end_;
+    char* out_;
+    char* out_end_;
+
+    void SkipSpace() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+            p_++;
+        }
+    }
+    bool Consume(char c) {
+        SkipSpace();
+        if (p_ < end_ && *p_ == c) {
+            p_++;
+            return true;
+        }
+        return false;
+    }
+    bool ReadKey(const char*& key, size_t& size);
+    bool SkipString();
+    bool SkipValue();
+    bool DecodeString(const char*& value);
+    bool AppendUtf8(uint32_t code);
+    bool ReadHex4(uint32_t& value);
+};
+
+/* Keys are compared raw, the ones we look for never contain escapes, and ignoring case like cJSON_GetObjectItem() */
+bool Scanner::ReadKey(const char*& key, size_t& size) {
+    if (!Consume('"')) {
+        return false;
+    }
+    key = p_;
+    if (!SkipString()) {
+        return false;
+    }
+    size = p_ - 1 - key;
+    return true;
+}
+
+// Called behind the opening quote, stops behind the closing one
+bool Scanner::SkipString() {
+    while (p_ < end_) {
+        char c = *p_++;
+        if (c == '"') {
+            return true;
+        }
+        if (c == '\\') {
+            p_++;
+        }
+    }
+    return false;
+}
+
+/* Nested containers only need their brackets matched, strings are skipped so they cannot confuse the count */
+bool Scanner::SkipValue() {
+    SkipSpace();
+    if (p_ >= end_) {
+        return false;
+    }
+    if (*p_ == '"') {
+        p_++;
+        return SkipString();
+    }
+    if (*p_ == '{' || *p_ == '[') {
+        int depth = 0;
+        while (p_ < end_) {
+            char c = *p_++;
+            if (c == '"') {
+                if (!SkipString()) {
+                    return false;
+                }
+            } else if (c == '{' || c == '[') {
+                depth++;
+            } else if (c == '}' || c == ']') {
+                if (--depth == 0) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+    // Number, true, false or null
+    const char* start = p_;
+    while (p_ < end_ && *p_ != ',' && *p_ != '}' && *p_ != ' ' && *p_ != '\n' && *p_ != '\r' && *p_ != '\t') {
+        p_++;
+    }
+    return p_ > start;
+}
+
+bool Scanner::ReadHex4(uint32_t& value) {
+    if (end_ - p_ < 4) {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = *p_++;
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Scanner::AppendUtf8(uint32_t code) {
+    char bytes[4];
+    size_t size;
+    if (code < 0x80) {
+        bytes[0] = code;
+        size = 1;
+    } else if (code < 0x800) {
+        bytes[0] = 0xc0 | (code >> 6);
+        bytes[1] = 0x80 | (code & 0x3f);
+        size = 2;
+    } else if (code < 0x10000) {
+        bytes[0] = 0xe0 | (code >> 12);
+        bytes[1] = 0x80 | ((code >> 6) & 0x3f);
+        bytes[2] = 0x80 | (code & 0x3f);
+        size = 3;
+    } else {
+        bytes[0] = 0xf0 | (code >> 18);
+        bytes[1] = 0x80 | ((code >> 12) & 0x3f);
+        bytes[2] = 0x80 | ((code >> 6) & 0x3f);
+        bytes[3] = 0x80 | (code & 0x3f);
+        size = 4;
+    }
+    if (out_end_ - out_ < (ptrdiff_t)size) {
+        return false;
+    }
+    memcpy(out_, bytes, size);
+    out_ += size;
+    return true;
+}
+
+/* Unescapes the string into the buffer and terminates it, like cJSON's valuestring */
+bool Scanner::DecodeString(const char*& value) {
+    value = out_;
+    while (p_ < end_) {
+        char c = *p_++;
+        if (c == '"') {
+            if (out_ == out_end_) {
+                return false;
+            }
+            *out_++ = '\0';
+            return true;
+        }
+        if (c != '\\') {
+            if (out_ == out_end_) {
+                return false;
+            }
+            *out_++ = c;
+            continue;
+        }
+        if (p_ >= end_) {
+            return false;
+        }
+        uint32_t code;
+        switch (*p_++) {
+        case '"': code = '"'; break;
+        case '\\': code = '\\'; break;
+        case '/': code = '/'; break;
+        case 'b': code = '\b'; break;
+        case 'f': code = '\f'; break;
+        case 'n': code = '\n'; break;
+        case 'r': code = '\r'; break;
+        case 't': code = '\t'; break;
+        case 'u':
+            if (!ReadHex4(code)) {
+                return false;
+            }
+            // Characters beyond the BMP come as a surrogate pair
+            if (code >= 0xd800 && code < 0xdc00) {
+                uint32_t low;
+                if (end_ - p_ < 2 || p_[0] != '\\' || p_[1] != 'u') {
+                    return false;
+                }
+                p_ += 2;
+                if (!ReadHex4(low) || low < 0xdc00 || low >= 0xe000) {
+                    return false;
+                }
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+            }
+            if (code == 0) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+        }
+        if (!AppendUtf8(code)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool Scanner::ScanObject(JsonMessage& message) {
+    static const struct {
+        const char* name;
+        size_t size;
+        const char* JsonMessage::* field;
+    } fields[] = {
+        {"type", 4, &JsonMessage::type},
+        {"state", 5, &JsonMessage::state},
+        {"text", 4, &JsonMessage::text},
+        {"session_id", 10, &JsonMessage::session_id},
+        {"emotion", 7, &JsonMessage::emotion},
+    };
+
+    message = JsonMessage();
+    if (!Consume('{')) {
+        return false;
+    }
+    if (Consume('}')) {
+        return true;
+    }
+    uint32_t seen = 0;
+    do {
+        const char* key;
+        size_t key_size;
+        if (!ReadKey(key, key_size) || !Consume(':')) {
+            return false;
+        }
+        // Like cJSON_GetObjectItem(), the first occurrence of a key wins even if it is not a string
+        const char** field = nullptr;
+        for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+            if (fields[i].size == key_size && strncasecmp(fields[i].name, key, key_size) == 0) {
+                if ((seen & (1u << i)) == 0) {
+                    seen |= 1u << i;
+                    field = &(message.*fields[i].field);
+                }
+                break;
+            }
+        }
+        if (field != nullptr && Consume('"')) {
+            if (!DecodeString(*field)) {
+                return false;
+            }
+        } else if (!SkipValue()) {
+            return false;
+        }
+    } while (Consume(','));
+    return Consume('}');
+}
+
+} // namespace
+
+bool ScanJsonMessage(const char* data, size_t len, JsonMessage& message, char* buffer, size_t buffer_size) {
+    Scanner scanner(data, len, buffer, buffer_size);
+    return scanner.ScanObject(message);
+}
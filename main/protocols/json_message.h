@@ -0,0 +1,41 @@
+#ifndef JSON_MESSAGE_H
+#define JSON_MESSAGE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Holds the decoded strings of one message, a longer message goes through cJSON instead
+#define JSON_MESSAGE_BUFFER_SIZE 512
+
+/*
+ * The top level fields of a server message that the frequent types (tts, stt, llm) need.
+ * A field is nullptr when it is missing or not a string. The strings live in the buffer
+ * passed to ScanJsonMessage(), or in the cJSON tree the message was taken from.
+ */
+struct JsonMessage {
+    const char* type = nullptr;
+    const char* state = nullptr;
+    const char* text = nullptr;
+    const char* session_id = nullptr;
+    const char* emotion = nullptr;
+};
+
+/*
+ * Extracts the JsonMessage fields from a JSON object in one pass without allocating. Other
+ * values, nested objects and arrays included, are skipped. Keys are looked up like
+ * cJSON_GetObjectItem() does, ignoring case and taking the first occurrence, so a message gives
+ * the same fields whichever path it takes. Returns false when the text is not an object, is
+ * truncated, or its strings do not fit the buffer, the caller then uses cJSON.
+ */
+bool ScanJsonMessage(const char* data, size_t len, JsonMessage& message, char* buffer, size_t buffer_size);
+
+// FNV-1a, used to index the message handlers by type
+constexpr uint32_t HashJsonType(const char* type) {
+    uint32_t hash = 2166136261u;
+    while (*type != '\0') {
+        hash = (hash ^ (uint8_t)*type++) * 16777619u;
+    }
+    return hash;
+}
+
+#endif // JSON_MESSAGE_H
@@ -99,6 +99,10 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     });
 
     mqtt_->OnMessage([this](const std::string& topic, const std::string& payload) {
+        if (DispatchJson(payload.data(), payload.size())) {
+            last_incoming_time_ = std::chrono::steady_clock::now();
+            return;
+        }
         cJSON* root = cJSON_Parse(payload.c_str());
         if (root == nullptr) {
             ESP_LOGE(TAG, "Failed to parse json message %s", payload.c_str());
@@ -121,8 +125,8 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
                     CloseAudioChannel();
                 });
             }
-        } else if (on_incoming_json_ != nullptr) {
-            on_incoming_json_(root);
+        } else {
+            DispatchJson(root);
         }
         cJSON_Delete(root);
         last_incoming_time_ = std::chrono::steady_clock::now();
@@ -160,36 +164,63 @@ bool MqttProtocol::SendText(const std::string& text) {
     return true;
 }
 
-bool MqttProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+bool MqttProtocol::SendDatagram() {
+    return packetizer_.Seal() && udp_->Send(packetizer_.datagram()) > 0;
+}
+
+bool MqttProtocol::SendAudio(AudioStreamPacketPtr packet) {
     std::lock_guard<std::mutex> lock(channel_mutex_);
     if (udp_ == nullptr) {
         return false;
     }
 
-    std::string nonce(aes_nonce_);
-    *(uint16_t*)&nonce[2] = htons(packet->payload.size());
-    *(uint32_t*)&nonce[8] = htonl(packet->timestamp);
-    *(uint32_t*)&nonce[12] = htonl(++local_sequence_);
+    auto payload = packetizer_.Begin(0x01, packet->payload.size(), packet->timestamp, ++local_sequence_);
+    memcpy(payload, packet->payload.data(), packet->payload.size());
+    return SendDatagram();
+}
 
-    std::string encrypted;
-    encrypted.resize(aes_nonce_.size() + packet->payload.size());
-    memcpy(encrypted.data(), nonce.data(), nonce.size());
+/*
+ * Batched packets have type 2, the header carries the timestamp and sequence of the first frame and
+ * the following frames take the next sequence numbers. A batch larger than AUDIO_BATCH_MAX_PAYLOAD
+ * is sent as several datagrams, an IP fragment lost on the way would drop all of it.
+ */
+bool MqttProtocol::SendAudioBatch(std::vector<AudioStreamPacketPtr>& packets) {
+    if (packets.size() <= 1 || uplink_batch_frames_ <= 1) {
+        return Protocol::SendAudioBatch(packets);
+    }
 
-    size_t nc_off = 0;
-    uint8_t stream_block[16] = {0};
-    if (mbedtls_aes_crypt_ctr(&aes_ctx_, packet->payload.size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
-        (uint8_t*)packet->payload.data(), (uint8_t*)&encrypted[nonce.size()]) != 0) {
-        ESP_LOGE(TAG, "Failed to encrypt audio data");
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    if (udp_ == nullptr) {
         return false;
     }
 
-    return udp_->Send(encrypted) > 0;
+    for (size_t sent = 0; sent < packets.size();) {
+        const AudioStreamPacketPtr* batch = packets.data() + sent;
+        size_t count = CountAudioBatchFrames(batch, packets.size() - sent, AUDIO_BATCH_MAX_PAYLOAD);
+        auto payload = packetizer_.Begin(0x02, GetAudioBatchSize(batch, count), batch[0]->timestamp, local_sequence_ + 1);
+        local_sequence_ += count;
+        WriteAudioBatch(batch, count, payload);
+        if (!SendDatagram()) {
+            return false;
+        }
+        sent += count;
+    }
+    return true;
 }
 
 void MqttProtocol::CloseAudioChannel() {
+    std::unique_ptr<Udp> udp;
+    ReplayWindowStats stats;
     {
         std::lock_guard<std::mutex> lock(channel_mutex_);
-        udp_.reset();
+        udp = std::move(udp_);
+        stats = replay_window_.stats();
+    }
+    // Destroyed outside the lock, its receive task may be waiting for the lock
+    udp.reset();
+    if (stats.received > 0) {
+        ESP_LOGI(TAG, "Downlink packets: %lu received, %lu reordered, %lu duplicates, %lu too old, %lu lost",
+            stats.received, stats.reordered, stats.duplicates, stats.too_old, stats.lost);
     }
 
     std::string message = "{";
@@ -228,6 +259,14 @@ bool MqttProtocol::OpenAudioChannel() {
         return false;
     }
 
+    // A channel still open is destroyed outside the lock, its receive task may be waiting for it
+    std::unique_ptr<Udp> previous_udp;
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        previous_udp = std::move(udp_);
+    }
+    previous_udp.reset();
+
     std::lock_guard<std::mutex> lock(channel_mutex_);
     auto network = Board::GetInstance().GetNetwork();
     udp_ = network->CreateUdp(2);
@@ -236,8 +275,9 @@ bool MqttProtocol::OpenAudioChannel() {
          * UDP Encrypted OPUS Packet Format:
          * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
          * |payload payload_len|
+         * Type 1 carries one frame, type 2 (uplink only) a batch of frames
          */
-        if (data.size() < sizeof(aes_nonce_)) {
+        if (data.size() < MQTT_UDP_HEADER_SIZE) {
             ESP_LOGE(TAG, "Invalid audio packet size: %u", data.size());
             return;
         }
@@ -247,33 +287,28 @@ bool MqttProtocol::OpenAudioChannel() {
         }
         uint32_t timestamp = ntohl(*(uint32_t*)&data[8]);
         uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
-        if (sequence < remote_sequence_) {
-            ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_);
-            return;
-        }
-        if (sequence != remote_sequence_ + 1) {
-            ESP_LOGW(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
-        }
 
-        size_t decrypted_size = data.size() - aes_nonce_.size();
-        size_t nc_off = 0;
-        uint8_t stream_block[16] = {0};
-        auto nonce = (uint8_t*)data.data();
-        auto encrypted = (uint8_t*)data.data() + aes_nonce_.size();
-        auto packet = std::make_unique<AudioStreamPacket>();
+        // Decrypted straight into a pooled packet
+        auto packet = GetAudioStreamPacketPool().Acquire();
         packet->sample_rate = server_sample_rate_;
         packet->frame_duration = server_frame_duration_;
         packet->timestamp = timestamp;
-        packet->payload.resize(decrypted_size);
-        int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, (uint8_t*)packet->payload.data());
-        if (ret != 0) {
-            ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
-            return;
+        packet->sequence = sequence;
+        packet->payload.resize(data.size() - MQTT_UDP_HEADER_SIZE);
+        {
+            // A server hello resets the window and rekeys the packetizer under the same lock
+            std::lock_guard<std::mutex> lock(channel_mutex_);
+            // Late packets are passed on once, the jitter buffer puts them back in order
+            if (!replay_window_.Accept(sequence)) {
+                return;
+            }
+            if (!packetizer_.Open(data, packet->payload.data())) {
+                return;
+            }
         }
         if (on_incoming_audio_ != nullptr) {
             on_incoming_audio_(std::move(packet));
         }
-        remote_sequence_ = sequence;
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
@@ -301,7 +336,8 @@ std::string MqttProtocol::GetHelloMessage() {
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    cJSON_AddNumberToObject(audio_params, "frame_duration", preferred_uplink_frame_duration_);
+    AddUplinkBatchFrames(audio_params);
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -335,6 +371,8 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
             server_frame_duration_ = frame_duration->valueint;
         }
     }
+    uplink_frame_duration_ = ParseUplinkFrameDuration(audio_params);
+    uplink_batch_frames_ = ParseUplinkBatchFrames(audio_params);
 
     auto udp = cJSON_GetObjectItem(root, "udp");
     if (!cJSON_IsObject(udp)) {
@@ -348,11 +386,15 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
 
     // auto encryption = cJSON_GetObjectItem(udp, "encryption")->valuestring;
     // ESP_LOGI(TAG, "UDP server: %s, port: %d, encryption: %s", udp_server_.c_str(), udp_port_, encryption);
-    aes_nonce_ = DecodeHexString(nonce);
-    mbedtls_aes_init(&aes_ctx_);
-    mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)DecodeHexString(key).c_str(), 128);
-    local_sequence_ = 0;
-    remote_sequence_ = 0;
+    {
+        // The key is expanded once per session, every packet reuses the context
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        if (!packetizer_.SetKey(DecodeHexString(key), DecodeHexString(nonce))) {
+            return;
+        }
+        local_sequence_ = 0;
+        replay_window_.Reset();
+    }
     xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
 }
 
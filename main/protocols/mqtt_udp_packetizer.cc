@@ -0,0 +1,71 @@
+#include "mqtt_udp_packetizer.h"
+
+#include <esp_log.h>
+#include <arpa/inet.h>
+#include <cstring>
+
+#define TAG "MqttUdpPacketizer"
+
+
+MqttUdpPacketizer::MqttUdpPacketizer() {
+    mbedtls_aes_init(&aes_ctx_);
+}
+
+MqttUdpPacketizer::~MqttUdpPacketizer() {
+    mbedtls_aes_free(&aes_ctx_);
+}
+
+bool MqttUdpPacketizer::SetKey(const std::string& key, const std::string& nonce) {
+    if (nonce.size() != MQTT_UDP_HEADER_SIZE) {
+        ESP_LOGE(TAG, "Invalid nonce size: %u", nonce.size());
+        return false;
+    }
+    if (key.size() != 16 || mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)key.data(), 128) != 0) {
+        ESP_LOGE(TAG, "Invalid key size: %u", key.size());
+        return false;
+    }
+    datagram_.reserve(MQTT_UDP_DATAGRAM_RESERVE);
+    datagram_.assign(nonce);
+    return true;
+}
+
+uint8_t* MqttUdpPacketizer::Begin(uint8_t type, size_t payload_size, uint32_t timestamp, uint32_t sequence) {
+    datagram_.resize(MQTT_UDP_HEADER_SIZE + payload_size);
+    auto header = (uint8_t*)datagram_.data();
+    header[0] = type;
+    *(uint16_t*)&header[2] = htons(payload_size);
+    *(uint32_t*)&header[8] = htonl(timestamp);
+    *(uint32_t*)&header[12] = htonl(sequence);
+    return header + MQTT_UDP_HEADER_SIZE;
+}
+
+bool MqttUdpPacketizer::Seal() {
+    // CTR mode advances a copy of the header
+    uint8_t counter[MQTT_UDP_HEADER_SIZE];
+    memcpy(counter, datagram_.data(), sizeof(counter));
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    auto payload = (uint8_t*)datagram_.data() + MQTT_UDP_HEADER_SIZE;
+    size_t payload_size = datagram_.size() - MQTT_UDP_HEADER_SIZE;
+    if (mbedtls_aes_crypt_ctr(&aes_ctx_, payload_size, &nc_off, counter, stream_block, payload, payload) != 0) {
+        ESP_LOGE(TAG, "Failed to encrypt audio data");
+        return false;
+    }
+    return true;
+}
+
+bool MqttUdpPacketizer::Open(const std::string& data, uint8_t* payload) {
+    // The counter block is a copy of the received header, the received string stays untouched
+    uint8_t counter[MQTT_UDP_HEADER_SIZE];
+    memcpy(counter, data.data(), sizeof(counter));
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    auto encrypted = (const uint8_t*)data.data() + MQTT_UDP_HEADER_SIZE;
+    int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, data.size() - MQTT_UDP_HEADER_SIZE, &nc_off, counter, stream_block,
+        encrypted, payload);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
+        return false;
+    }
+    return true;
+}
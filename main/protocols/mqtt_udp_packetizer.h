@@ -0,0 +1,51 @@
+#ifndef MQTT_UDP_PACKETIZER_H
+#define MQTT_UDP_PACKETIZER_H
+
+#include <mbedtls/aes.h>
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// The UDP audio header doubles as the AES-CTR nonce
+#define MQTT_UDP_HEADER_SIZE 16
+// Initial capacity of the send buffer, a batch larger than this grows it once
+#define MQTT_UDP_DATAGRAM_RESERVE 1536
+
+/*
+ * AES-CTR framing of the MQTT UDP audio datagrams:
+ * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|payload payload_len|
+ *
+ * The header is the initial counter block. Datagrams are built in one buffer that keeps the nonce
+ * from the server hello as its header template and keeps its capacity: only the type, size,
+ * timestamp and sequence are patched in and the payload is encrypted in place, so sending
+ * allocates nothing. Received payloads are decrypted straight into the caller's buffer. The key is
+ * expanded once per session, every packet reuses the context.
+ *
+ * Not thread safe, MqttProtocol guards it with its channel lock.
+ */
+class MqttUdpPacketizer {
+public:
+    MqttUdpPacketizer();
+    ~MqttUdpPacketizer();
+    MqttUdpPacketizer(const MqttUdpPacketizer&) = delete;
+    MqttUdpPacketizer& operator=(const MqttUdpPacketizer&) = delete;
+
+    // The 16 byte AES-128 key and nonce of the server hello
+    bool SetKey(const std::string& key, const std::string& nonce);
+
+    // Starts a datagram, returns where its payload_size bytes of plain payload go
+    uint8_t* Begin(uint8_t type, size_t payload_size, uint32_t timestamp, uint32_t sequence);
+    // Encrypts the payload in place, datagram() is then ready to send
+    bool Seal();
+    const std::string& datagram() const { return datagram_; }
+
+    // Decrypts the payload of a received datagram, payload has room for data.size() - MQTT_UDP_HEADER_SIZE bytes
+    bool Open(const std::string& data, uint8_t* payload);
+
+private:
+    mbedtls_aes_context aes_ctx_;
+    std::string datagram_;
+};
+
+#endif // MQTT_UDP_PACKETIZER_H
@@ -1,14 +1,141 @@
 #include "protocol.h"
 
 #include <esp_log.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cstring>
 
 #define TAG "Protocol"
 
+AudioStreamPacketPool& GetAudioStreamPacketPool() {
+    static AudioStreamPacketPool pool(AUDIO_STREAM_PACKET_POOL_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    return pool;
+}
+
+size_t GetAudioBatchSize(const AudioStreamPacketPtr* packets, size_t count) {
+    size_t size = 1 + count * sizeof(uint16_t);
+    for (size_t i = 0; i < count; i++) {
+        size += packets[i]->payload.size();
+    }
+    return size;
+}
+
+void WriteAudioBatch(const AudioStreamPacketPtr* packets, size_t count, uint8_t* out) {
+    *out++ = count;
+    for (size_t i = 0; i < count; i++) {
+        uint16_t frame_size = htons(packets[i]->payload.size());
+        memcpy(out, &frame_size, sizeof(frame_size));
+        out += sizeof(frame_size);
+    }
+    for (size_t i = 0; i < count; i++) {
+        memcpy(out, packets[i]->payload.data(), packets[i]->payload.size());
+        out += packets[i]->payload.size();
+    }
+}
+
+size_t CountAudioBatchFrames(const AudioStreamPacketPtr* packets, size_t count, size_t max_size) {
+    size_t size = 1;
+    size_t frames = 0;
+    // The frame count is a single byte
+    while (frames < count && frames < UINT8_MAX) {
+        size_t frame_size = sizeof(uint16_t) + packets[frames]->payload.size();
+        if (frames > 0 && size + frame_size > max_size) {
+            break;
+        }
+        size += frame_size;
+        frames++;
+    }
+    return frames;
+}
+
+bool ParseBinaryAudio(int version, const uint8_t* data, size_t len, BinaryAudioFrame& frame) {
+    frame.payload = data;
+    frame.payload_size = len;
+    frame.timestamp = 0;
+    if (version == 2) {
+        if (len < sizeof(BinaryProtocol2)) {
+            ESP_LOGE(TAG, "Invalid binary message size: %u", len);
+            return false;
+        }
+        auto bp2 = (const BinaryProtocol2*)data;
+        frame.payload = bp2->payload;
+        frame.payload_size = ntohl(bp2->payload_size);
+        frame.timestamp = ntohl(bp2->timestamp);
+        if (frame.payload_size > len - sizeof(BinaryProtocol2)) {
+            ESP_LOGE(TAG, "Invalid binary message, payload %u of %u bytes", frame.payload_size, len);
+            return false;
+        }
+    } else if (version == 3) {
+        if (len < sizeof(BinaryProtocol3)) {
+            ESP_LOGE(TAG, "Invalid binary message size: %u", len);
+            return false;
+        }
+        auto bp3 = (const BinaryProtocol3*)data;
+        frame.payload = bp3->payload;
+        frame.payload_size = ntohs(bp3->payload_size);
+        if (frame.payload_size > len - sizeof(BinaryProtocol3)) {
+            ESP_LOGE(TAG, "Invalid binary message, payload %u of %u bytes", frame.payload_size, len);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ParseBinaryProtocol4(const uint8_t* data, size_t len, int frame_duration,
+    const std::function<void(const BinaryAudioFrame& frame)>& on_frame) {
+    if (len < sizeof(BinaryProtocol4) + 1) {
+        ESP_LOGE(TAG, "Invalid binary message size: %u", len);
+        return false;
+    }
+    auto bp4 = (const BinaryProtocol4*)data;
+    size_t payload_size = ntohs(bp4->payload_size);
+    const uint8_t* payload = bp4->payload;
+    size_t count = payload[0];
+    size_t offset = 1 + count * sizeof(uint16_t);
+    if (bp4->type != 0 || sizeof(BinaryProtocol4) + payload_size > len || offset > payload_size) {
+        ESP_LOGE(TAG, "Invalid binary message, type %u, payload %u of %u bytes", bp4->type, payload_size, len);
+        return false;
+    }
+
+    BinaryAudioFrame frame;
+    frame.timestamp = ntohl(bp4->timestamp);
+    for (size_t i = 0; i < count; i++) {
+        uint16_t frame_size;
+        memcpy(&frame_size, payload + 1 + i * sizeof(uint16_t), sizeof(frame_size));
+        frame_size = ntohs(frame_size);
+        if (offset + frame_size > payload_size) {
+            ESP_LOGE(TAG, "Frame %u of %u exceeds the payload", i, count);
+            return false;
+        }
+        frame.payload = payload + offset;
+        frame.payload_size = frame_size;
+        on_frame(frame);
+        frame.timestamp += frame_duration;
+        offset += frame_size;
+    }
+    return true;
+}
+
 void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
     on_incoming_json_ = callback;
 }
 
-void Protocol::OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback) {
+bool Protocol::OnIncomingMessage(const char* type, std::function<void(const JsonMessage& message)> callback) {
+    uint32_t hash = HashJsonType(type);
+    for (size_t i = 0; i < JSON_MESSAGE_HANDLER_SLOTS; i++) {
+        auto& slot = json_handlers_[(hash + i) % JSON_MESSAGE_HANDLER_SLOTS];
+        if (slot.callback == nullptr || slot.type == type) {
+            slot.hash = hash;
+            slot.type = type;
+            slot.callback = callback;
+            return true;
+        }
+    }
+    ESP_LOGE(TAG, "No slot left for message type %s", type);
+    return false;
+}
+
+void Protocol::OnIncomingAudio(std::function<void(AudioStreamPacketPtr packet)> callback) {
     on_incoming_audio_ = callback;
 }
 
@@ -32,6 +159,136 @@ void Protocol::OnDisconnected(std::function<void()> callback) {
     on_disconnected_ = callback;
 }
 
+int Protocol::ParseUplinkFrameDuration(const cJSON* audio_params) const {
+    int uplink_frame_duration = preferred_uplink_frame_duration_;
+    auto frame_duration = cJSON_GetObjectItem(audio_params, "uplink_frame_duration");
+    if (cJSON_IsNumber(frame_duration)) {
+        int value = frame_duration->valueint;
+        if (value == 20 || value == 40 || value == 60) {
+            uplink_frame_duration = value;
+        } else {
+            ESP_LOGW(TAG, "Unsupported uplink frame duration: %d", value);
+        }
+    }
+    ESP_LOGI(TAG, "Uplink frame duration: %d ms", uplink_frame_duration);
+    return uplink_frame_duration;
+}
+
+void Protocol::AddUplinkBatchFrames(cJSON* audio_params) {
+    if (preferred_uplink_batch_frames_ > 1) {
+        cJSON_AddNumberToObject(audio_params, "uplink_batch", preferred_uplink_batch_frames_);
+    }
+}
+
+/* A server that does not know batching leaves uplink_batch out and gets one frame per message */
+int Protocol::ParseUplinkBatchFrames(const cJSON* audio_params) const {
+    int uplink_batch_frames = 1;
+    auto batch = cJSON_GetObjectItem(audio_params, "uplink_batch");
+    if (cJSON_IsNumber(batch) && batch->valueint > 1 && preferred_uplink_batch_frames_ > 1) {
+        uplink_batch_frames = std::min(batch->valueint, preferred_uplink_batch_frames_);
+    }
+    if (uplink_batch_frames > 1) {
+        ESP_LOGI(TAG, "Uplink batch: up to %d frames per message", uplink_batch_frames);
+    }
+    return uplink_batch_frames;
+}
+
+const Protocol::JsonMessageHandler* Protocol::FindJsonHandler(const char* type) const {
+    uint32_t hash = HashJsonType(type);
+    for (size_t i = 0; i < JSON_MESSAGE_HANDLER_SLOTS; i++) {
+        auto& slot = json_handlers_[(hash + i) % JSON_MESSAGE_HANDLER_SLOTS];
+        if (slot.callback == nullptr) {
+            return nullptr;
+        }
+        if (slot.hash == hash && slot.type == type) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+/*
+ * The frequent messages (tts, stt, llm) are scanned in place, no cJSON tree is built for them.
+ * Returns false when the message needs the tree: its type has no handler, e.g. mcp, or it did
+ * not scan, e.g. a text longer than the buffer. The caller then parses it and uses the tree.
+ */
+bool Protocol::DispatchJson(const char* data, size_t len) {
+    JsonMessage message;
+    if (!ScanJsonMessage(data, len, message, json_buffer_, sizeof(json_buffer_)) || message.type == nullptr) {
+        return false;
+    }
+    auto handler = FindJsonHandler(message.type);
+    if (handler == nullptr) {
+        return false;
+    }
+    handler->callback(message);
+    return true;
+}
+
+void Protocol::DispatchJson(const cJSON* root) {
+    auto type = cJSON_GetObjectItem(root, "type");
+    auto handler = cJSON_IsString(type) ? FindJsonHandler(type->valuestring) : nullptr;
+    if (handler == nullptr) {
+        if (on_incoming_json_ != nullptr) {
+            on_incoming_json_(root);
+        }
+        return;
+    }
+
+    auto get_string = [root](const char* name) -> const char* {
+        auto item = cJSON_GetObjectItem(root, name);
+        return cJSON_IsString(item) ? item->valuestring : nullptr;
+    };
+    JsonMessage message;
+    message.type = type->valuestring;
+    message.state = get_string("state");
+    message.text = get_string("text");
+    message.session_id = get_string("session_id");
+    message.emotion = get_string("emotion");
+    handler->callback(message);
+}
+
+/* For protocols that translate their own events, a type without a handler still reaches OnIncomingJson */
+void Protocol::DispatchJson(const JsonMessage& message) {
+    auto handler = message.type != nullptr ? FindJsonHandler(message.type) : nullptr;
+    if (handler != nullptr) {
+        handler->callback(message);
+        return;
+    }
+    if (on_incoming_json_ == nullptr) {
+        return;
+    }
+    cJSON* root = cJSON_CreateObject();
+    const std::pair<const char*, const char*> fields[] = {
+        {"type", message.type},
+        {"state", message.state},
+        {"text", message.text},
+        {"session_id", message.session_id},
+        {"emotion", message.emotion},
+    };
+    for (auto& field : fields) {
+        if (field.second != nullptr) {
+            cJSON_AddStringToObject(root, field.first, field.second);
+        }
+    }
+    on_incoming_json_(root);
+    cJSON_Delete(root);
+}
+
+/* Protocols without a speculative connect open the channel when it is needed */
+bool Protocol::PreConnect() {
+    return false;
+}
+
+bool Protocol::SendAudioBatch(std::vector<AudioStreamPacketPtr>& packets) {
+    for (auto& packet : packets) {
+        if (!SendAudio(std::move(packet))) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void Protocol::SetError(const std::string& message) {
     error_occurred_ = true;
     if (on_network_error_ != nullptr) {
@@ -2,18 +2,63 @@
 #define PROTOCOL_H
 
 #include <cJSON.h>
+#include <atomic>
 #include <string>
 #include <functional>
 #include <chrono>
 #include <vector>
+#include <memory>
+
+#include "object_pool.h"
+#include "json_message.h"
+
+#define AUDIO_STREAM_PACKET_POOL_SIZE 64
+// Open addressed by HashJsonType(), a few more slots than message types keep the probes short
+#define JSON_MESSAGE_HANDLER_SLOTS 8
+// A batch payload larger than this is split, so a UDP datagram with its headers fits a 1500 byte MTU
+// with room to spare for tunnels and the cellular link
+#define AUDIO_BATCH_MAX_PAYLOAD 1400
+
+// Non-owning view of an Opus packet in memory that stays mapped, such as built-in sounds in flash
+struct OpusPacketView {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+struct DecodedSound;
 
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
+    uint32_t sequence = 0;  // 0: unsequenced, played in arrival order
+    uint32_t origin_us = 0; // Latency tracing: captured or received
+    uint32_t queued_us = 0; // Latency tracing: entered the current queue
     std::vector<uint8_t> payload;
+    OpusPacketView view;    // Used instead of payload when view.data is set
+    // Local sounds only: the cached PCM to play instead of decoding, or the one this packet fills
+    std::shared_ptr<DecodedSound> decoded_sound;
+
+    void Reset() {
+        sample_rate = 0;
+        frame_duration = 0;
+        timestamp = 0;
+        sequence = 0;
+        origin_us = 0;
+        queued_us = 0;
+        payload.clear();
+        view = OpusPacketView();
+        decoded_sound.reset();
+    }
+    size_t buffer_capacity() const { return payload.capacity(); }
 };
 
+using AudioStreamPacketPool = ObjectPool<AudioStreamPacket>;
+using AudioStreamPacketPtr = AudioStreamPacketPool::Handle;
+
+// Opus packets are small, so they are pooled in internal RAM
+AudioStreamPacketPool& GetAudioStreamPacketPool();
+
 struct BinaryProtocol2 {
     uint16_t version;
     uint16_t type;          // Message type (0: OPUS, 1: JSON)
@@ -30,6 +75,40 @@ struct BinaryProtocol3 {
     uint8_t payload[];
 } __attribute__((packed));
 
+// Version 3 with several Opus frames per message, see WriteAudioBatch() for the payload
+struct BinaryProtocol4 {
+    uint8_t type;           // Message type (0: OPUS, 1: JSON)
+    uint8_t reserved;
+    uint16_t payload_size;
+    uint32_t timestamp;     // Of the first frame in milliseconds, the others follow one frame duration apart
+    uint8_t payload[];
+} __attribute__((packed));
+
+/*
+ * Batched audio payload of binary protocol 4 and of UDP packets of type 2:
+ * |frame_count 1u|frame_size 2u x frame_count|frames|, sizes in network byte order
+ */
+size_t GetAudioBatchSize(const AudioStreamPacketPtr* packets, size_t count);
+void WriteAudioBatch(const AudioStreamPacketPtr* packets, size_t count, uint8_t* out);
+// Frames from the start of packets that one batch payload of at most max_size bytes holds, at least 1
+size_t CountAudioBatchFrames(const AudioStreamPacketPtr* packets, size_t count, size_t max_size);
+
+// An Opus frame of a received binary message, payload points into the message
+struct BinaryAudioFrame {
+    const uint8_t* payload = nullptr;
+    size_t payload_size = 0;
+    uint32_t timestamp = 0;
+};
+
+/*
+ * Headers are read where they lie, the message is never written to, and every size is checked
+ * against len before a payload is handed out. Version 1 has no header.
+ */
+bool ParseBinaryAudio(int version, const uint8_t* data, size_t len, BinaryAudioFrame& frame);
+// Calls on_frame for each frame of a version 4 message in order, false at the first one that does not fit
+bool ParseBinaryProtocol4(const uint8_t* data, size_t len, int frame_duration,
+    const std::function<void(const BinaryAudioFrame& frame)>& on_frame);
+
 enum AbortReason {
     kAbortReasonNone,
     kAbortReasonWakeWordDetected
@@ -51,12 +130,29 @@ public:
     inline int server_frame_duration() const {
         return server_frame_duration_;
     }
+    inline int uplink_frame_duration() const {
+        return uplink_frame_duration_;
+    }
+    // Proposed in the next hello, the server hello may select another supported duration
+    inline void SetUplinkFrameDuration(int frame_duration) {
+        preferred_uplink_frame_duration_ = frame_duration;
+    }
+    // Frames one SendAudioBatch() may carry, 1 unless the server hello accepted batching
+    inline int uplink_batch_frames() const {
+        return uplink_batch_frames_;
+    }
+    // Proposed in the next hello when above 1, the server hello may lower it
+    inline void SetUplinkBatchFrames(int frames) {
+        preferred_uplink_batch_frames_ = frames;
+    }
     inline const std::string& session_id() const {
         return session_id_;
     }
 
-    void OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback);
+    void OnIncomingAudio(std::function<void(AudioStreamPacketPtr packet)> callback);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
+    // Messages of this type skip the cJSON tree, others and unscannable ones go to OnIncomingJson
+    bool OnIncomingMessage(const char* type, std::function<void(const JsonMessage& message)> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
     void OnNetworkError(std::function<void(const std::string& message)> callback);
@@ -67,7 +163,11 @@ public:
     virtual bool OpenAudioChannel() = 0;
     virtual void CloseAudioChannel() = 0;
     virtual bool IsAudioChannelOpened() const = 0;
-    virtual bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) = 0;
+    // Early hint that the channel will be needed soon, returns false when the protocol ignores it
+    virtual bool PreConnect();
+    virtual bool SendAudio(AudioStreamPacketPtr packet) = 0;
+    // Up to uplink_batch_frames() packets in one transport write, the packets are consumed
+    virtual bool SendAudioBatch(std::vector<AudioStreamPacketPtr>& packets);
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
@@ -76,7 +176,7 @@ public:
 
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
-    std::function<void(std::unique_ptr<AudioStreamPacket> packet)> on_incoming_audio_;
+    std::function<void(AudioStreamPacketPtr packet)> on_incoming_audio_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
     std::function<void(const std::string& message)> on_network_error_;
@@ -85,13 +185,37 @@ protected:
 
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
-    bool error_occurred_ = false;
+    int preferred_uplink_frame_duration_ = 60;
+    int uplink_frame_duration_ = 60;
+    int preferred_uplink_batch_frames_ = 1;
+    int uplink_batch_frames_ = 1;
+    std::atomic<bool> error_occurred_ = false;    // Set by SetError() from any task
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
 
+    // Dispatch of incoming text, only called from the receive task of the transport
+    bool DispatchJson(const char* data, size_t len);
+    void DispatchJson(const cJSON* root);
+    void DispatchJson(const JsonMessage& message);
+
     virtual bool SendText(const std::string& text) = 0;
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
+    // The uplink settings a server hello selected, the transport applies them to its session
+    int ParseUplinkFrameDuration(const cJSON* audio_params) const;
+    void AddUplinkBatchFrames(cJSON* audio_params);
+    int ParseUplinkBatchFrames(const cJSON* audio_params) const;
+
+private:
+    struct JsonMessageHandler {
+        uint32_t hash = 0;
+        std::string type;
+        std::function<void(const JsonMessage& message)> callback;
+    };
+    JsonMessageHandler json_handlers_[JSON_MESSAGE_HANDLER_SLOTS];
+    char json_buffer_[JSON_MESSAGE_BUFFER_SIZE];
+
+    const JsonMessageHandler* FindJsonHandler(const char* type) const;
 };
 
 #endif // PROTOCOL_H
@@ -0,0 +1,78 @@
+#include "replay_window.h"
+
+#include <esp_log.h>
+
+#define TAG "ReplayWindow"
+
+
+bool ReplayWindow::Accept(uint32_t sequence) {
+    if (!started_ || (int32_t)(sequence - highest_) > REPLAY_WINDOW_MAX_JUMP) {
+        if (started_) {
+            ESP_LOGW(TAG, "Sequence jumped from %lu to %lu, restarting", highest_, sequence);
+            stats_.resyncs++;
+        }
+        // Nothing before the first packet is missing until a packet older than it arrives
+        started_ = true;
+        first_ = sequence;
+        highest_ = sequence;
+        bitmap_ = ~0ULL;
+        stats_.received++;
+        return true;
+    }
+
+    int32_t ahead = (int32_t)(sequence - highest_);
+    if (ahead > 0) {
+        Advance(ahead);
+        highest_ = sequence;
+        bitmap_ |= 1;
+        if (highest_ - first_ >= REPLAY_WINDOW_SIZE) {
+            // The start has left the window, keep first_ close so the comparison cannot wrap
+            first_ = highest_ - REPLAY_WINDOW_SIZE + 1;
+        }
+        stats_.received++;
+        return true;
+    }
+
+    uint32_t behind = -ahead;
+    if (behind >= REPLAY_WINDOW_SIZE) {
+        stats_.too_old++;
+        ESP_LOGW(TAG, "Dropped packet %lu, %lu behind %lu", sequence, behind, highest_);
+        return false;
+    }
+    uint64_t bit = 1ULL << behind;
+    if ((int32_t)(sequence - first_) < 0) {
+        // The stream started earlier than its first packet, the sequences in between are now missing
+        for (uint32_t missing = sequence + 1; missing != first_; missing++) {
+            bitmap_ &= ~(1ULL << (highest_ - missing));
+        }
+        first_ = sequence;
+    } else if (bitmap_ & bit) {
+        stats_.duplicates++;
+        return false;
+    }
+    bitmap_ |= bit;
+    stats_.received++;
+    stats_.reordered++;
+    return true;
+}
+
+void ReplayWindow::Reset() {
+    started_ = false;
+    first_ = 0;
+    highest_ = 0;
+    bitmap_ = 0;
+    stats_ = ReplayWindowStats();
+}
+
+/* The sequences shifted out at the old end that never arrived are lost */
+void ReplayWindow::Advance(uint32_t shift) {
+    if (shift >= REPLAY_WINDOW_SIZE) {
+        // Besides the unset bits, the gap older than the new window never got a bit
+        stats_.lost += REPLAY_WINDOW_SIZE - __builtin_popcountll(bitmap_) + (shift - REPLAY_WINDOW_SIZE);
+        bitmap_ = 0;
+        return;
+    }
+    uint64_t shifted_out = bitmap_ >> (REPLAY_WINDOW_SIZE - shift);
+    stats_.lost += shift - __builtin_popcountll(shifted_out);
+    bitmap_ <<= shift;
+}
@@ -0,0 +1,47 @@
+#ifndef REPLAY_WINDOW_H
+#define REPLAY_WINDOW_H
+
+#include <cstdint>
+
+// Sequences up to this far behind the highest one are still accepted once
+#define REPLAY_WINDOW_SIZE 64
+// A forward jump larger than this is a restarted stream, not a burst of loss
+#define REPLAY_WINDOW_MAX_JUMP 1000
+
+struct ReplayWindowStats {
+    uint32_t received = 0;
+    uint32_t reordered = 0;     // Accepted behind the highest sequence
+    uint32_t duplicates = 0;    // Already received inside the window, dropped
+    uint32_t too_old = 0;       // Behind the window, dropped since it cannot be told from a replay
+    uint32_t lost = 0;          // Left the window without arriving
+    uint32_t resyncs = 0;
+};
+
+/*
+ * Sliding window over the received downlink sequence numbers.
+ *
+ * Bit i of the bitmap is set when highest - i was received. A late packet is accepted once as
+ * long as its bit is still in the window, so a Wi-Fi reorder is not a lost frame, while a
+ * duplicate or a replay of an older packet is rejected before it is decrypted. Ordering is left
+ * to the jitter buffer of the decoder.
+ *
+ * Only the UDP receive task calls Accept(), Reset() is called with the server hello of a new channel.
+ */
+class ReplayWindow {
+public:
+    bool Accept(uint32_t sequence);
+    void Reset();
+
+    const ReplayWindowStats& stats() const { return stats_; }
+
+private:
+    bool started_ = false;
+    uint32_t first_ = 0;        // Oldest sequence received since the start, while it is in the window
+    uint32_t highest_ = 0;
+    uint64_t bitmap_ = 0;
+    ReplayWindowStats stats_;
+
+    void Advance(uint32_t shift);
+};
+
+#endif // REPLAY_WINDOW_H
@@ -27,7 +27,7 @@ bool WebsocketJoeaiProtocol::Start() {
     return true;
 }
 
-bool WebsocketJoeaiProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+bool WebsocketJoeaiProtocol::SendAudio(AudioStreamPacketPtr packet) {
     if (!IsAudioChannelOpened() || !websocket_) {
         return false;
     }
@@ -222,9 +222,7 @@ void WebsocketJoeaiProtocol::HandleTextMessage(const char* data, size_t len) {
     }
     auto type = cJSON_GetObjectItem(root, "type");
     if (cJSON_IsString(type)) {
-        if (on_incoming_json_ != nullptr) {
-            on_incoming_json_(root);
-        }
+        DispatchJson(root);
     } else {
         // Joyai 文本事件为 contentType/EVENT 或 AUDIO 结构
         auto contentType = cJSON_GetObjectItem(root, "contentType");
@@ -267,14 +265,11 @@ void WebsocketJoeaiProtocol::HandleTextMessage(const char* data, size_t len) {
 
                     // 将 Joyai 事件映射为系统通用 JSON（type: tts/stt）上抛
                     auto emit_tts = [this](const char* state, const char* text){
-                        cJSON* fake = cJSON_CreateObject();
-                        cJSON_AddStringToObject(fake, "type", "tts");
-                        cJSON_AddStringToObject(fake, "state", state);
-                        if (text != nullptr) {
-                            cJSON_AddStringToObject(fake, "text", text);
-                        }
-                        if (on_incoming_json_ != nullptr) on_incoming_json_(fake);
-                        cJSON_Delete(fake);
+                        JsonMessage message;
+                        message.type = "tts";
+                        message.state = state;
+                        message.text = text;
+                        DispatchJson(message);
                     };
 
                     // 常见事件映射
@@ -307,26 +302,23 @@ void WebsocketJoeaiProtocol::HandleTextMessage(const char* data, size_t len) {
                     auto dataj = cJSON_GetObjectItem(content, "data");
                     if (cJSON_IsString(dataj)) {
                         const char* b64 = dataj->valuestring;
-                        std::vector<uint8_t> payload;
+                        auto packet = GetAudioStreamPacketPool().Acquire();
+                        auto& payload = packet->payload;
                         size_t in_len = strlen(b64);
-                        // 预估最大输出长度并解码
+                        // 预估最大输出长度并直接解码到池化的 packet 中
                         payload.resize((in_len * 3) / 4 + 4);
                         size_t out_len = 0;
                         int rc = mbedtls_base64_decode(payload.data(), payload.size(), &out_len, (const unsigned char*)b64, in_len);
                         if (rc == 0 && out_len > 0) {
                             payload.resize(out_len);
                             // 下发音频前，若上层未切 speaking，主动发出 tts start，避免音频被丢弃
-                            cJSON* fake = cJSON_CreateObject();
-                            cJSON_AddStringToObject(fake, "type", "tts");
-                            cJSON_AddStringToObject(fake, "state", "start");
-                            if (on_incoming_json_ != nullptr) on_incoming_json_(fake);
-                            cJSON_Delete(fake);
-                            on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                                .sample_rate = sr,
-                                .frame_duration = fm,
-                                .timestamp = 0,
-                                .payload = std::move(payload)
-                            }));
+                            JsonMessage message;
+                            message.type = "tts";
+                            message.state = "start";
+                            DispatchJson(message);
+                            packet->sample_rate = sr;
+                            packet->frame_duration = fm;
+                            on_incoming_audio_(std::move(packet));
                         } else {
                             ESP_LOGE(TAG, "base64 decode failed: %d", rc);
                         }
@@ -339,11 +331,10 @@ void WebsocketJoeaiProtocol::HandleTextMessage(const char* data, size_t len) {
                     auto t = cJSON_GetObjectItem(content, "text");
                     if (cJSON_IsString(t)) txt = t->valuestring;
                     if (txt != nullptr) {
-                        cJSON* fake = cJSON_CreateObject();
-                        cJSON_AddStringToObject(fake, "type", "stt");
-                        cJSON_AddStringToObject(fake, "text", txt);
-                        if (on_incoming_json_ != nullptr) on_incoming_json_(fake);
-                        cJSON_Delete(fake);
+                        JsonMessage message;
+                        message.type = "stt";
+                        message.text = txt;
+                        DispatchJson(message);
                     }
                 }
             }
@@ -355,16 +346,15 @@ void WebsocketJoeaiProtocol::HandleTextMessage(const char* data, size_t len) {
 }
 
 void WebsocketJoeaiProtocol::HandleBinaryMessage(const char* data, size_t len) {
-    if (on_incoming_audio_ == nullptr) {
+    if (on_incoming_audio_ == nullptr || len == 0) {
         return;
     }
-    // 可按需添加更详细日志
-    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-        .sample_rate = server_sample_rate_,
-        .frame_duration = server_frame_duration_,
-        .timestamp = 0,
-        .payload = std::vector<uint8_t>((const uint8_t*)data, (const uint8_t*)data + len)
-    }));
+    // 帧没有头部，整条消息即为 Opus 数据；接收缓冲区属于 websocket，只拷贝一次到池化的包中
+    auto packet = GetAudioStreamPacketPool().Acquire();
+    packet->sample_rate = server_sample_rate_;
+    packet->frame_duration = server_frame_duration_;
+    packet->payload.assign((const uint8_t*)data, (const uint8_t*)data + len);
+    on_incoming_audio_(std::move(packet));
 }
 
 void WebsocketJoeaiProtocol::HandleErrorMessage(const char* data, size_t len) {
@@ -14,17 +14,41 @@
 
 WebsocketProtocol::WebsocketProtocol() {
     event_group_handle_ = xEventGroupCreate();
+    xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_PRECONNECT_IDLE_EVENT);
+
+    esp_timer_create_args_t warm_timer_args = {
+        .callback = [](void* arg) {
+            auto this_ = (WebsocketProtocol*)arg;
+            Application::GetInstance().Schedule([this_]() {
+                this_->ReleaseWarmChannel();
+            });
+        },
+        .arg = this,
+    };
+    esp_timer_create(&warm_timer_args, &warm_timer_);
 }
 
 WebsocketProtocol::~WebsocketProtocol() {
+    if (warm_timer_ != nullptr) {
+        esp_timer_stop(warm_timer_);
+        esp_timer_delete(warm_timer_);
+    }
+    // A pre-connect in progress finishes before the socket goes away
+    xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_PRECONNECT_IDLE_EVENT, pdFALSE, pdTRUE, portMAX_DELAY);
+    std::shared_ptr<WebSocket> websocket;
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        websocket = std::move(websocket_);
+    }
+
     // 优雅关闭 WebSocket 连接
-    if (websocket_ != nullptr && websocket_->IsConnected()) {
+    if (websocket != nullptr && websocket->IsConnected()) {
         ESP_LOGI(TAG, "Gracefully closing WebSocket...");
-        websocket_->Close();
+        websocket->Close();
         // 等待关闭帧发送完成
         vTaskDelay(pdMS_TO_TICKS(500));
     }
-    websocket_.reset();
+    websocket.reset();
 
     vEventGroupDelete(event_group_handle_);
 }
@@ -34,24 +58,52 @@ bool WebsocketProtocol::Start() {
     return true;
 }
 
-bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
-    if (websocket_ == nullptr || !websocket_->IsConnected()) {
+/*
+ * The socket the senders use, and the protocol version it negotiated. The copy keeps it alive if
+ * the channel is closed meanwhile, the send then fails on a closed socket instead of touching a
+ * freed one.
+ */
+std::shared_ptr<WebSocket> WebsocketProtocol::GetWebSocket(int* version) const {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    if (version != nullptr) {
+        *version = session_.version;
+    }
+    return websocket_;
+}
+
+/*
+ * Makes the session of websocket_ the one the application sees. Called with channel_mutex_ held
+ * on the main task, which reads these fields, once the channel opens; a warm socket greeted in
+ * the background never touches them before that.
+ */
+void WebsocketProtocol::ApplySession() {
+    session_id_ = session_.session_id;
+    server_sample_rate_ = session_.server_sample_rate;
+    server_frame_duration_ = session_.server_frame_duration;
+    uplink_frame_duration_ = session_.uplink_frame_duration;
+    uplink_batch_frames_ = session_.uplink_batch_frames;
+}
+
+bool WebsocketProtocol::SendAudio(AudioStreamPacketPtr packet) {
+    int version;
+    auto websocket = GetWebSocket(&version);
+    if (websocket == nullptr || !websocket->IsConnected()) {
         return false;
     }
 
-    if (version_ == 2) {
+    if (version == 2) {
         std::string serialized;
         serialized.resize(sizeof(BinaryProtocol2) + packet->payload.size());
         auto bp2 = (BinaryProtocol2*)serialized.data();
-        bp2->version = htons(version_);
+        bp2->version = htons(version);
         bp2->type = 0;
         bp2->reserved = 0;
         bp2->timestamp = htonl(packet->timestamp);
         bp2->payload_size = htonl(packet->payload.size());
         memcpy(bp2->payload, packet->payload.data(), packet->payload.size());
 
-        return websocket_->Send(serialized.data(), serialized.size(), true);
-    } else if (version_ == 3) {
+        return websocket->Send(serialized.data(), serialized.size(), true);
+    } else if (version == 3) {
         std::string serialized;
         serialized.resize(sizeof(BinaryProtocol3) + packet->payload.size());
         auto bp3 = (BinaryProtocol3*)serialized.data();
@@ -60,18 +112,86 @@ bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
         bp3->payload_size = htons(packet->payload.size());
         memcpy(bp3->payload, packet->payload.data(), packet->payload.size());
 
-        return websocket_->Send(serialized.data(), serialized.size(), true);
+        return websocket->Send(serialized.data(), serialized.size(), true);
+    } else if (version == 4) {
+        return SendBinaryProtocol4(websocket.get(), &packet, 1);
     } else {
-        return websocket_->Send(packet->payload.data(), packet->payload.size(), true);
+        return websocket->Send(packet->payload.data(), packet->payload.size(), true);
+    }
+}
+
+bool WebsocketProtocol::SendAudioBatch(std::vector<AudioStreamPacketPtr>& packets) {
+    int version;
+    auto websocket = GetWebSocket(&version);
+    if (version != 4) {
+        return Protocol::SendAudioBatch(packets);
+    }
+    if (websocket == nullptr || !websocket->IsConnected()) {
+        return false;
+    }
+    // Split like the UDP batches, so a message never carries more than AUDIO_BATCH_MAX_PAYLOAD
+    for (size_t sent = 0; sent < packets.size();) {
+        const AudioStreamPacketPtr* batch = packets.data() + sent;
+        size_t count = CountAudioBatchFrames(batch, packets.size() - sent, AUDIO_BATCH_MAX_PAYLOAD);
+        if (!SendBinaryProtocol4(websocket.get(), batch, count)) {
+            return false;
+        }
+        sent += count;
+    }
+    return true;
+}
+
+bool WebsocketProtocol::SendBinaryProtocol4(WebSocket* websocket, const AudioStreamPacketPtr* packets, size_t count) {
+    size_t payload_size = GetAudioBatchSize(packets, count);
+    std::string serialized;
+    serialized.resize(sizeof(BinaryProtocol4) + payload_size);
+    auto bp4 = (BinaryProtocol4*)serialized.data();
+    bp4->type = 0;
+    bp4->reserved = 0;
+    bp4->payload_size = htons(payload_size);
+    bp4->timestamp = htonl(packets[0]->timestamp);
+    WriteAudioBatch(packets, count, bp4->payload);
+
+    return websocket->Send(serialized.data(), serialized.size(), true);
+}
+
+/*
+ * The header is read where it lies and never swapped in place, the receive buffer belongs to the
+ * websocket client. The payload is copied once into a pooled packet, whose buffer keeps its
+ * capacity, because the frame is decoded after this callback has returned.
+ */
+void WebsocketProtocol::ReceiveBinaryAudio(const WebsocketSession& session, const uint8_t* data, size_t len) {
+    BinaryAudioFrame frame;
+    if (!ParseBinaryAudio(session.version, data, len, frame) || frame.payload_size == 0) {
+        return;
     }
+    auto packet = GetAudioStreamPacketPool().Acquire();
+    packet->sample_rate = session.server_sample_rate;
+    packet->frame_duration = session.server_frame_duration;
+    packet->timestamp = frame.timestamp;
+    packet->payload.assign(frame.payload, frame.payload + frame.payload_size);
+    on_incoming_audio_(std::move(packet));
+}
+
+/* A version 4 message may carry several frames, each one becomes a packet of its own */
+void WebsocketProtocol::ReceiveBinaryProtocol4(const WebsocketSession& session, const uint8_t* data, size_t len) {
+    ParseBinaryProtocol4(data, len, session.server_frame_duration, [this, &session](const BinaryAudioFrame& frame) {
+        auto packet = GetAudioStreamPacketPool().Acquire();
+        packet->sample_rate = session.server_sample_rate;
+        packet->frame_duration = session.server_frame_duration;
+        packet->timestamp = frame.timestamp;
+        packet->payload.assign(frame.payload, frame.payload + frame.payload_size);
+        on_incoming_audio_(std::move(packet));
+    });
 }
 
 bool WebsocketProtocol::SendText(const std::string& text) {
-    if (websocket_ == nullptr || !websocket_->IsConnected()) {
+    auto websocket = GetWebSocket();
+    if (websocket == nullptr || !websocket->IsConnected()) {
         return false;
     }
 
-    if (!websocket_->Send(text)) {
+    if (!websocket->Send(text)) {
         ESP_LOGE(TAG, "Failed to send text: %s", text.c_str());
         SetError(Lang::Strings::SERVER_ERROR);
         return false;
@@ -81,29 +201,200 @@ bool WebsocketProtocol::SendText(const std::string& text) {
 }
 
 bool WebsocketProtocol::IsAudioChannelOpened() const {
-    return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
+    std::shared_ptr<WebSocket> websocket;
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        if (warm_) {
+            return false;
+        }
+        websocket = websocket_;
+    }
+    return websocket != nullptr && websocket->IsConnected() && !error_occurred_ && !IsTimeout();
+}
+
+/*
+ * Closes a socket taken out of websocket_. Runs without channel_mutex_, the receive task of the
+ * socket may be waiting for it in OnDisconnected() while the destructor waits for that task.
+ */
+void WebsocketProtocol::DestroyWebSocket(std::shared_ptr<WebSocket>& websocket) {
+    if (websocket == nullptr) {
+        return;
+    }
+    const WebSocket* raw = websocket.get();
+    websocket.reset();
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    if (silent_websocket_ == raw) {
+        silent_websocket_ = nullptr;
+    }
 }
 
 void WebsocketProtocol::CloseAudioChannel() {
-    websocket_.reset();
+    std::shared_ptr<WebSocket> websocket;
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        if (warm_) {
+            warm_ = false;
+            esp_timer_stop(warm_timer_);
+        }
+        websocket = std::move(websocket_);
+    }
+    DestroyWebSocket(websocket);
+}
+
+/*
+ * Speculative connect on an early hint, called on the main task. The handshake runs in a task of
+ * its own, the channel is kept warm, connected and greeted but invisible to the application, until
+ * OpenAudioChannel() takes it or the warm budget runs out. Failures are not reported, the wake
+ * word path retries.
+ *
+ * There is no socket kept warm for the whole idle time: every hello opens a server session, which
+ * the server drops after 120 s, so it would mean a reconnect every 100 s for as long as the device
+ * sits idle. Audio captured during the handshake is the wake word pre-roll, sent once the channel
+ * is open; voice processing starts only after the listen command, which needs the session.
+ */
+bool WebsocketProtocol::PreConnect() {
+#if CONFIG_AUDIO_CHANNEL_WARM_SECONDS > 0
+    if (!(xEventGroupGetBits(event_group_handle_) & WEBSOCKET_PROTOCOL_PRECONNECT_IDLE_EVENT)) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        if (websocket_ != nullptr) {
+            return false;
+        }
+    }
+    xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_PRECONNECT_IDLE_EVENT);
+
+    auto task = [](void* arg) {
+        auto this_ = (WebsocketProtocol*)arg;
+        int64_t start_time = esp_timer_get_time();
+        WebsocketSession session;
+        auto websocket = this_->Connect(false, session);
+        if (websocket != nullptr) {
+            std::lock_guard<std::mutex> lock(this_->channel_mutex_);
+            // OpenAudioChannel() waits for this task, nothing else publishes a socket meanwhile
+            if (this_->websocket_ == nullptr) {
+                this_->websocket_ = std::move(websocket);
+                this_->session_ = session;
+                this_->warm_ = true;
+                esp_timer_start_once(this_->warm_timer_, CONFIG_AUDIO_CHANNEL_WARM_SECONDS * 1000000LL);
+                ESP_LOGI(TAG, "Pre-connected in %lld ms", (esp_timer_get_time() - start_time) / 1000);
+            }
+        }
+        this_->DestroyWebSocket(websocket);
+        ESP_LOGI(TAG, "Pre-connect task stack high water mark: %u", (unsigned)uxTaskGetStackHighWaterMark(NULL));
+        xEventGroupSetBits(this_->event_group_handle_, WEBSOCKET_PROTOCOL_PRECONNECT_IDLE_EVENT);
+        vTaskDelete(NULL);
+    };
+    // DNS, TLS and the cJSON hello, with margin over the 8 KB of the main task, see the log above
+    if (xTaskCreate(task, "ws_preconnect", 4096 * 3, this, 3, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the pre-connect task");
+        xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_PRECONNECT_IDLE_EVENT);
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* Runs on the main task, like OpenAudioChannel(), so it cannot close a channel being taken */
+void WebsocketProtocol::ReleaseWarmChannel() {
+    std::shared_ptr<WebSocket> websocket;
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        if (!warm_) {
+            return;
+        }
+        warm_ = false;
+        warm_expired_++;
+        ESP_LOGI(TAG, "Pre-connected channel unused, closing (used %lu, expired %lu)", warm_used_, warm_expired_);
+        websocket = std::move(websocket_);
+    }
+    DestroyWebSocket(websocket);
 }
 
 bool WebsocketProtocol::OpenAudioChannel() {
+    // Waits for a pre-connect in progress, its handshake is then already done or failed
+    xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_PRECONNECT_IDLE_EVENT, pdFALSE, pdTRUE, portMAX_DELAY);
+
+    std::shared_ptr<WebSocket> websocket;
+    bool taken = false;
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        if (warm_) {
+            warm_ = false;
+            esp_timer_stop(warm_timer_);
+            // The warm socket reports no errors, a flag still set belongs to the last session
+            error_occurred_ = false;
+            if (websocket_ != nullptr && websocket_->IsConnected() && !IsTimeout()) {
+                warm_used_++;
+                silent_websocket_ = nullptr;
+                ApplySession();
+                taken = true;
+                ESP_LOGI(TAG, "Using the pre-connected channel (used %lu, expired %lu)", warm_used_, warm_expired_);
+            } else {
+                ESP_LOGW(TAG, "Pre-connected channel was lost, connecting again");
+            }
+        }
+        if (!taken) {
+            websocket = std::move(websocket_);
+        }
+    }
+    if (taken) {
+        if (on_audio_channel_opened_ != nullptr) {
+            on_audio_channel_opened_();
+        }
+        return true;
+    }
+    DestroyWebSocket(websocket);
+
+    WebsocketSession session;
+    websocket = Connect(true, session);
+    if (websocket == nullptr) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        websocket_ = std::move(websocket);
+        session_ = session;
+        ApplySession();
+    }
+    if (on_audio_channel_opened_ != nullptr) {
+        on_audio_channel_opened_();
+    }
+    return true;
+}
+
+/*
+ * DNS, TCP, TLS, the HTTP upgrade and the hello round trip, without channel_mutex_. The caller
+ * publishes the returned socket together with the session it negotiated. Without report_error
+ * this is the pre-connect, whose errors and disconnects stay silent until OpenAudioChannel()
+ * takes the socket, and which leaves every field of the live session alone.
+ */
+std::shared_ptr<WebSocket> WebsocketProtocol::Connect(bool report_error, WebsocketSession& session) {
     Settings settings("websocket", false);
     std::string url = settings.GetString("url");
     std::string token = settings.GetString("token");
     int version = settings.GetInt("version");
     if (version != 0) {
-        version_ = version;
+        session.version = version;
     }
 
-    error_occurred_ = false;
+    if (report_error) {
+        error_occurred_ = false;
+    }
 
     auto network = Board::GetInstance().GetNetwork();
-    websocket_ = network->CreateWebSocket(1);
-    if (websocket_ == nullptr) {
+    std::shared_ptr<WebSocket> websocket = network->CreateWebSocket(1);
+    if (websocket == nullptr) {
         ESP_LOGE(TAG, "Failed to create websocket");
-        return false;
+        return nullptr;
+    }
+    const WebSocket* raw = websocket.get();
+    if (!report_error) {
+        std::lock_guard<std::mutex> lock(channel_mutex_);
+        silent_websocket_ = raw;
     }
 
     if (!token.empty()) {
@@ -111,59 +402,32 @@ bool WebsocketProtocol::OpenAudioChannel() {
         if (token.find(" ") == std::string::npos) {
             token = "Bearer " + token;
         }
-        websocket_->SetHeader("Authorization", token.c_str());
+        websocket->SetHeader("Authorization", token.c_str());
     }
-    websocket_->SetHeader("Protocol-Version", std::to_string(version_).c_str());
-    websocket_->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
-    websocket_->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
+    websocket->SetHeader("Protocol-Version", std::to_string(session.version).c_str());
+    websocket->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
+    websocket->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
 
-    websocket_->OnData([this](const char* data, size_t len, bool binary) {
-        if (binary) {
+    // The receive task fills its own copy of the session, the caller reads it once the hello arrived
+    auto receive_session = std::make_shared<WebsocketSession>(session);
+    websocket->OnData([this, receive_session](const char* data, size_t len, bool binary) {
+        if (binary && receive_session->version == 4) {
             if (on_incoming_audio_ != nullptr) {
-                if (version_ == 2) {
-                    BinaryProtocol2* bp2 = (BinaryProtocol2*)data;
-                    bp2->version = ntohs(bp2->version);
-                    bp2->type = ntohs(bp2->type);
-                    bp2->timestamp = ntohl(bp2->timestamp);
-                    bp2->payload_size = ntohl(bp2->payload_size);
-                    auto payload = (uint8_t*)bp2->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = bp2->timestamp,
-                        .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
-                    }));
-                } else if (version_ == 3) {
-                    BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
-                    bp3->type = bp3->type;
-                    bp3->payload_size = ntohs(bp3->payload_size);
-                    auto payload = (uint8_t*)bp3->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
-                    }));
-                } else {
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>((uint8_t*)data, (uint8_t*)data + len)
-                    }));
-                }
+                ReceiveBinaryProtocol4(*receive_session, (const uint8_t*)data, len);
             }
-        } else {
+        } else if (binary) {
+            if (on_incoming_audio_ != nullptr) {
+                ReceiveBinaryAudio(*receive_session, (const uint8_t*)data, len);
+            }
+        } else if (!DispatchJson(data, len)) {
             // Parse JSON data
             auto root = cJSON_Parse(data);
             auto type = cJSON_GetObjectItem(root, "type");
             if (cJSON_IsString(type)) {
                 if (strcmp(type->valuestring, "hello") == 0) {
-                    ParseServerHello(root);
+                    ParseServerHello(root, *receive_session);
                 } else {
-                    if (on_incoming_json_ != nullptr) {
-                        on_incoming_json_(root);
-                    }
+                    DispatchJson(root);
                 }
             } else {
                 ESP_LOGE(TAG, "Missing message type, data: %s", data);
@@ -173,46 +437,58 @@ bool WebsocketProtocol::OpenAudioChannel() {
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
-    websocket_->OnDisconnected([this]() {
+    websocket->OnDisconnected([this, raw]() {
         ESP_LOGI(TAG, "Websocket disconnected");
+        {
+            // The application never saw a warm channel open, OpenAudioChannel() notices it is gone
+            std::lock_guard<std::mutex> lock(channel_mutex_);
+            if (raw == silent_websocket_) {
+                return;
+            }
+        }
         if (on_audio_channel_closed_ != nullptr) {
             on_audio_channel_closed_();
         }
     });
 
-    ESP_LOGI(TAG, "Connecting to websocket server: %s with version: %d", url.c_str(), version_);
-    if (!websocket_->Connect(url.c_str())) {
-        ESP_LOGE(TAG, "Failed to connect to websocket server, code=%d", websocket_->GetLastError());
-        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
-        return false;
+    ESP_LOGI(TAG, "Connecting to websocket server: %s with version: %d", url.c_str(), session.version);
+    if (!websocket->Connect(url.c_str())) {
+        ESP_LOGE(TAG, "Failed to connect to websocket server, code=%d", websocket->GetLastError());
+        if (report_error) {
+            SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        }
+        return nullptr;
     }
 
     // Send hello message to describe the client
-    auto message = GetHelloMessage();
-    if (!SendText(message)) {
-        return false;
+    xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
+    auto message = GetHelloMessage(session);
+    if (!websocket->Send(message)) {
+        ESP_LOGE(TAG, "Failed to send hello");
+        if (report_error) {
+            SetError(Lang::Strings::SERVER_ERROR);
+        }
+        return nullptr;
     }
 
     // Wait for server hello
     EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
     if (!(bits & WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT)) {
         ESP_LOGE(TAG, "Failed to receive server hello");
-        SetError(Lang::Strings::SERVER_TIMEOUT);
-        return false;
-    }
-
-    if (on_audio_channel_opened_ != nullptr) {
-        on_audio_channel_opened_();
+        if (report_error) {
+            SetError(Lang::Strings::SERVER_TIMEOUT);
+        }
+        return nullptr;
     }
-
-    return true;
+    session = *receive_session;
+    return websocket;
 }
 
-std::string WebsocketProtocol::GetHelloMessage() {
+std::string WebsocketProtocol::GetHelloMessage(const WebsocketSession& session) {
     // keys: message type, version, audio_params (format, sample_rate, channels)
     cJSON* root = cJSON_CreateObject();
     cJSON_AddStringToObject(root, "type", "hello");
-    cJSON_AddNumberToObject(root, "version", version_);
+    cJSON_AddNumberToObject(root, "version", session.version);
     cJSON* features = cJSON_CreateObject();
 #if CONFIG_USE_SERVER_AEC
     cJSON_AddBoolToObject(features, "aec", true);
@@ -224,7 +500,11 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    cJSON_AddNumberToObject(audio_params, "frame_duration", preferred_uplink_frame_duration_);
+    // Only binary protocol 4 can carry several frames in one message
+    if (session.version == 4) {
+        AddUplinkBatchFrames(audio_params);
+    }
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -233,7 +513,7 @@ std::string WebsocketProtocol::GetHelloMessage() {
     return message;
 }
 
-void WebsocketProtocol::ParseServerHello(const cJSON* root) {
+void WebsocketProtocol::ParseServerHello(const cJSON* root, WebsocketSession& session) {
     auto transport = cJSON_GetObjectItem(root, "transport");
     if (transport == nullptr || strcmp(transport->valuestring, "websocket") != 0) {
         ESP_LOGE(TAG, "Unsupported transport: %s", transport->valuestring);
@@ -242,21 +522,23 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
 
     auto session_id = cJSON_GetObjectItem(root, "session_id");
     if (cJSON_IsString(session_id)) {
-        session_id_ = session_id->valuestring;
-        ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
+        session.session_id = session_id->valuestring;
+        ESP_LOGI(TAG, "Session ID: %s", session.session_id.c_str());
     }
 
     auto audio_params = cJSON_GetObjectItem(root, "audio_params");
     if (cJSON_IsObject(audio_params)) {
         auto sample_rate = cJSON_GetObjectItem(audio_params, "sample_rate");
         if (cJSON_IsNumber(sample_rate)) {
-            server_sample_rate_ = sample_rate->valueint;
+            session.server_sample_rate = sample_rate->valueint;
         }
         auto frame_duration = cJSON_GetObjectItem(audio_params, "frame_duration");
         if (cJSON_IsNumber(frame_duration)) {
-            server_frame_duration_ = frame_duration->valueint;
+            session.server_frame_duration = frame_duration->valueint;
         }
     }
+    session.uplink_frame_duration = ParseUplinkFrameDuration(audio_params);
+    session.uplink_batch_frames = ParseUplinkBatchFrames(audio_params);
 
     xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
 }
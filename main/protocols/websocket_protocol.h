@@ -7,8 +7,24 @@
 #include <web_socket.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#include <esp_timer.h>
+
+#include <memory>
+#include <mutex>
 
 #define WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
+#define WEBSOCKET_PROTOCOL_PRECONNECT_IDLE_EVENT (1 << 1)
+
+// What one socket negotiated in its handshake. Filled by the receive task of that socket, the
+// protocol takes a copy when it publishes the socket.
+struct WebsocketSession {
+    int version = 1;
+    std::string session_id;
+    int server_sample_rate = 24000;
+    int server_frame_duration = 60;
+    int uplink_frame_duration = 60;
+    int uplink_batch_frames = 1;
+};
 
 class WebsocketProtocol : public Protocol {
 public:
@@ -16,19 +32,37 @@ public:
     ~WebsocketProtocol();
 
     bool Start() override;
-    bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override;
+    bool SendAudio(AudioStreamPacketPtr packet) override;
+    bool SendAudioBatch(std::vector<AudioStreamPacketPtr>& packets) override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
+    bool PreConnect() override;
 
 private:
     EventGroupHandle_t event_group_handle_;
-    std::unique_ptr<WebSocket> websocket_;
-    int version_ = 1;
+    // Guards websocket_, its session and the warm state, never held across a handshake or a socket destruction
+    mutable std::mutex channel_mutex_;
+    std::shared_ptr<WebSocket> websocket_;      // Senders use a snapshot, see GetWebSocket()
+    WebsocketSession session_;                  // Negotiated by websocket_
+    bool warm_ = false;                         // Pre-connected, not yet taken by OpenAudioChannel()
+    const WebSocket* silent_websocket_ = nullptr; // Pre-connect socket, its disconnect is not reported
+    esp_timer_handle_t warm_timer_ = nullptr;
+    uint32_t warm_used_ = 0;
+    uint32_t warm_expired_ = 0;
+
+    std::shared_ptr<WebSocket> Connect(bool report_error, WebsocketSession& session);
+    std::shared_ptr<WebSocket> GetWebSocket(int* version = nullptr) const;
+    void DestroyWebSocket(std::shared_ptr<WebSocket>& websocket);
+    void ReleaseWarmChannel();
+    void ApplySession();
 
-    void ParseServerHello(const cJSON* root);
+    void ParseServerHello(const cJSON* root, WebsocketSession& session);
+    bool SendBinaryProtocol4(WebSocket* websocket, const AudioStreamPacketPtr* packets, size_t count);
+    void ReceiveBinaryAudio(const WebsocketSession& session, const uint8_t* data, size_t len);
+    void ReceiveBinaryProtocol4(const WebsocketSession& session, const uint8_t* data, size_t len);
     bool SendText(const std::string& text) override;
-    std::string GetHelloMessage();
+    std::string GetHelloMessage(const WebsocketSession& session);
 };
 
 #endif
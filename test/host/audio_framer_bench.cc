@@ -0,0 +1,228 @@
+#include "audio_framer.h"
+#include "wake_words/wake_word_preroll.h"
+#include "host_bench.h"
+
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+/*
+ * Framing of AFE fetch chunks into encoder frames, and the wake word to first packet latency.
+ *
+ *   audio_framer_bench [--chunks N] [--wakes N] [--encode-load percent]
+ *
+ * The first part cuts N chunks into frames with AudioFramer and with the vector append and erase
+ * that AfeAudioProcessor used before, for matching and mismatched fetch and frame sizes such as 512
+ * vs 960 samples. The consumer swaps every frame with its own buffer, as PushTaskToEncodeQueue
+ * does with a pooled task. Reports cycles and operator new calls per frame.
+ *
+ * The second part feeds WakeWordPreroll 512-sample chunks in real time, detects a wake word after a
+ * random 1 to 2 s, and times Encode() to the first packet out of GetOpus() and to the last one.
+ * --encode-load charges the stand-in encoder that share of every frame (host_codec_load.h).
+ */
+
+#define WAKE_CHUNK_SAMPLES 512
+
+static std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations++;
+    void* ptr = malloc(size > 0 ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+struct FramingResult {
+    uint64_t cycles = 0;
+    size_t allocations = 0;
+    size_t frames = 0;
+};
+
+// AfeAudioProcessor before AudioFramer: append, then move the buffer out or copy a frame and erase it
+static FramingResult RunVector(const std::vector<int16_t>& chunk, size_t frame_samples, int chunks) {
+    std::vector<int16_t> output_buffer;
+    output_buffer.reserve(frame_samples);
+    std::vector<int16_t> consumer;
+    consumer.reserve(frame_samples);
+    auto output_callback = [&](std::vector<int16_t>&& frame) {
+        consumer.swap(frame);
+        HostKeep(consumer[0]);
+    };
+
+    FramingResult result;
+    size_t start_allocations = allocations;
+    uint64_t start = HostCycles();
+    for (int n = 0; n < chunks; n++) {
+        output_buffer.insert(output_buffer.end(), chunk.begin(), chunk.end());
+        while (output_buffer.size() >= frame_samples) {
+            if (output_buffer.size() == frame_samples) {
+                output_callback(std::move(output_buffer));
+                output_buffer.clear();
+                output_buffer.reserve(frame_samples);
+            } else {
+                output_callback(std::vector<int16_t>(output_buffer.begin(), output_buffer.begin() + frame_samples));
+                output_buffer.erase(output_buffer.begin(), output_buffer.begin() + frame_samples);
+            }
+            result.frames++;
+        }
+    }
+    result.cycles = HostCycles() - start;
+    result.allocations = allocations - start_allocations;
+    return result;
+}
+
+static FramingResult RunFramer(const std::vector<int16_t>& chunk, size_t frame_samples, int chunks) {
+    AudioFramer framer;
+    framer.Initialize(frame_samples, chunk.size(), MALLOC_CAP_SPIRAM);
+    framer.SetFrameSamples(frame_samples);
+    std::vector<int16_t> consumer;
+    consumer.reserve(frame_samples);
+
+    FramingResult result;
+    auto on_frame = [&](std::vector<int16_t>&& frame) {
+        consumer.swap(frame);
+        HostKeep(consumer[0]);
+        result.frames++;
+    };
+    size_t start_allocations = allocations;
+    uint64_t start = HostCycles();
+    for (int n = 0; n < chunks; n++) {
+        framer.Push(chunk.data(), chunk.size(), on_frame);
+    }
+    result.cycles = HostCycles() - start;
+    result.allocations = allocations - start_allocations;
+    return result;
+}
+
+static void ReportFraming(int chunks) {
+    struct Sizes {
+        size_t chunk;
+        size_t frame;
+    };
+    const Sizes sizes[] = {{512, 960}, {512, 320}, {480, 960}, {1024, 960}, {960, 960}, {320, 960}};
+
+    printf("Framing %d chunks\n", chunks);
+    printf("%6s %6s %-8s %10s %12s %12s\n", "chunk", "frame", "method", "frames", "cycles/frm", "allocs/frm");
+    for (auto& size : sizes) {
+        std::vector<int16_t> chunk(size.chunk);
+        for (size_t i = 0; i < chunk.size(); i++) {
+            chunk[i] = (int16_t)(i * 31);
+        }
+        auto vector = RunVector(chunk, size.frame, chunks);
+        auto framer = RunFramer(chunk, size.frame, chunks);
+        for (auto [name, result] : {std::pair{"vector", &vector}, std::pair{"framer", &framer}}) {
+            size_t frames = std::max<size_t>(result->frames, 1);
+            printf("%6zu %6zu %-8s %10zu %12.0f %12.2f\n", size.chunk, size.frame, name, result->frames,
+                (double)result->cycles / frames, (double)result->allocations / frames);
+        }
+    }
+}
+
+static void ReportWakeToFirstPacket(int wakes) {
+    // Its encode task runs for good, like on the device, so the pre-roll is never destroyed
+    WakeWordPreroll& preroll = *new WakeWordPreroll();
+    if (!preroll.Initialize()) {
+        printf("Failed to initialize the pre-roll\n");
+        return;
+    }
+
+    std::mt19937 random(1);
+    std::uniform_int_distribution<int> listen_ms(1000, 2000);
+    std::vector<int16_t> chunk(WAKE_CHUNK_SAMPLES);
+    for (size_t i = 0; i < chunk.size(); i++) {
+        chunk[i] = (int16_t)((i * 7919) & 0x3fff) - 0x2000;
+    }
+    const auto chunk_interval = std::chrono::microseconds(WAKE_CHUNK_SAMPLES * 1000000LL / 16000);
+
+    std::vector<int64_t> first_us, last_us;
+    size_t total_packets = 0;
+    for (int wake = 0; wake < wakes; wake++) {
+        preroll.Reset();
+        auto next = std::chrono::steady_clock::now();
+        auto detect = next + std::chrono::milliseconds(listen_ms(random));
+        // The detector runs on the chunk just stored, so a frame it completed may still be encoding
+        while (true) {
+            preroll.Store(chunk.data(), chunk.size());
+            if (next >= detect) {
+                break;
+            }
+            next += chunk_interval;
+            std::this_thread::sleep_until(next);
+        }
+
+        int64_t start_us = esp_timer_get_time();
+        preroll.Encode();
+        std::vector<uint8_t> opus;
+        size_t packets = 0;
+        while (preroll.GetOpus(opus)) {
+            if (packets++ == 0) {
+                first_us.push_back(esp_timer_get_time() - start_us);
+            }
+        }
+        last_us.push_back(esp_timer_get_time() - start_us);
+        total_packets += packets;
+    }
+
+    auto report = [](const char* name, std::vector<int64_t>& values) {
+        if (values.empty()) {
+            printf("%-14s none\n", name);
+            return;
+        }
+        std::sort(values.begin(), values.end());
+        int64_t total = 0;
+        for (auto value : values) {
+            total += value;
+        }
+        printf("%-14s avg %6lld us, p50 %6lld us, max %6lld us\n", name, (long long)(total / (int64_t)values.size()),
+            (long long)values[values.size() / 2], (long long)values.back());
+    };
+    printf("\nWake word to pre-roll packets, %d wakes, %zu packets, %d%% encode load\n", wakes, total_packets,
+        host_codec_load.encode_percent);
+    report("first packet", first_us);
+    report("last packet", last_us);
+}
+
+int main(int argc, char** argv) {
+    int chunks = 100000;
+    int wakes = 10;
+    host_codec_load.encode_percent = 30;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--chunks") == 0) {
+            chunks = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--wakes") == 0) {
+            wakes = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--encode-load") == 0) {
+            host_codec_load.encode_percent = atoi(argv[i + 1]);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    ReportFraming(chunks);
+    ReportWakeToFirstPacket(wakes);
+    // Leave without joining the pre-roll's encode task
+    fflush(stdout);
+    _exit(0);
+}
@@ -0,0 +1,123 @@
+#include "audio_kernels.h"
+#include "polyphase_resampler.h"
+#include "host_bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+/*
+ * Cycles per 60 ms capture frame of the ReadAudioData() path, for 1, 2 and 4 capture channels at
+ * 16, 24 and 48 kHz. Like the service, two slots are kept and brought to 16 kHz: compacted in place
+ * at 16 kHz, otherwise split into planar buffers, resampled, and interleaved in place. One channel
+ * is only resampled.
+ *
+ *   audio_kernels_bench [--frames N]
+ *
+ * Each stage reports the median over N frames, the host runs the scalar kernels.
+ */
+
+#define FRAME_MS 60
+#define OUTPUT_SAMPLE_RATE 16000
+
+struct StageCycles {
+    std::vector<uint64_t> shuffle;
+    std::vector<uint64_t> resample;
+    std::vector<uint64_t> interleave;
+    std::vector<uint64_t> total;
+};
+
+static uint64_t Median(std::vector<uint64_t>& values) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+static void Run(int channels, int sample_rate, int frames_to_run) {
+    size_t frames = sample_rate * FRAME_MS / 1000;
+    std::vector<int16_t> capture(frames * channels);
+    for (size_t i = 0; i < capture.size(); i++) {
+        capture[i] = (int16_t)((i * 7919) & 0x3fff) - 0x2000;
+    }
+    PolyphaseResampler mic_resampler;
+    PolyphaseResampler reference_resampler;
+    mic_resampler.Configure(sample_rate, OUTPUT_SAMPLE_RATE);
+    reference_resampler.Configure(sample_rate, OUTPUT_SAMPLE_RATE);
+    std::vector<int16_t> data;
+    data.reserve(capture.size() + AUDIO_KERNELS_PADDING);
+    std::vector<int16_t> mic(frames);
+    std::vector<int16_t> reference(frames);
+    std::vector<int16_t> resampled_reference;
+    resampled_reference.reserve(frames * 2);
+
+    StageCycles cycles;
+    for (int n = 0; n < frames_to_run; n++) {
+        data.assign(capture.begin(), capture.end());
+        uint64_t start = HostCycles();
+        uint64_t shuffle = 0, resample = 0, interleave = 0;
+        if (channels == 1) {
+            if (sample_rate != OUTPUT_SAMPLE_RATE) {
+                mic_resampler.Process(data);
+            }
+            resample = HostCycles() - start;
+        } else if (sample_rate == OUTPUT_SAMPLE_RATE) {
+            AudioKernels::SelectChannels(data.data(), channels, 0, 1, frames);
+            data.resize(frames * 2);
+            shuffle = HostCycles() - start;
+        } else {
+            AudioKernels::SplitChannels(data.data(), channels, 0, 1, mic.data(), reference.data(), frames);
+            uint64_t split_end = HostCycles();
+            size_t output_frames = mic_resampler.GetOutputSamples(frames);
+            resampled_reference.resize(reference_resampler.GetOutputSamples(frames));
+            data.resize(output_frames * 2);
+            mic_resampler.Process(mic.data(), frames, data.data() + output_frames);
+            reference_resampler.Process(reference.data(), frames, resampled_reference.data());
+            uint64_t resample_end = HostCycles();
+            AudioKernels::InterleaveChannels(data.data() + output_frames, resampled_reference.data(), data.data(),
+                output_frames);
+            uint64_t interleave_end = HostCycles();
+            shuffle = split_end - start;
+            resample = resample_end - split_end;
+            interleave = interleave_end - resample_end;
+        }
+        uint64_t total = HostCycles() - start;
+        HostKeep(data[0]);
+        cycles.shuffle.push_back(shuffle);
+        cycles.resample.push_back(resample);
+        cycles.interleave.push_back(interleave);
+        cycles.total.push_back(total);
+    }
+
+    printf("%8d %8d %10llu %10llu %10llu %10llu %10.1f\n", channels, sample_rate,
+        (unsigned long long)Median(cycles.shuffle), (unsigned long long)Median(cycles.resample),
+        (unsigned long long)Median(cycles.interleave), (unsigned long long)Median(cycles.total),
+        (double)Median(cycles.total) / frames);
+}
+
+int main(int argc, char** argv) {
+    int frames = 500;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--frames") == 0) {
+            frames = atoi(argv[i + 1]);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    printf("Cycles per %d ms capture frame to 16 kHz, median of %d\n", FRAME_MS, frames);
+    printf("%8s %8s %10s %10s %10s %10s %10s\n", "channels", "rate", "shuffle", "resample", "interleave",
+        "total", "per_input");
+    const int channel_counts[] = {1, 2, 4};
+    const int sample_rates[] = {16000, 24000, 48000};
+    for (int channels : channel_counts) {
+        for (int sample_rate : sample_rates) {
+            Run(channels, sample_rate, frames);
+        }
+    }
+    return 0;
+}
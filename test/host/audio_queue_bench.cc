@@ -0,0 +1,173 @@
+#include "audio_queue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+/*
+ * Two threads move frames through an AudioQueue the way the audio tasks do: the producer pushes
+ * one frame per frame duration and waits on the writable bit when the queue is full, the consumer
+ * waits on the readable bit, then pops everything queued and spends --work-us on each frame.
+ *
+ *   audio_queue_bench [--frames N] [--capacity N] [--work-us N]
+ *
+ * Runs at 60 ms and 20 ms frames, then unpaced to stress the wakeups. Reports:
+ *   - lost wakeups: the consumer's wait timed out although a frame was queued
+ *   - contention: producer waits on a full queue, consumer wakeups that found nothing, and the
+ *     cost of Push() and Pop(), whose only shared state besides the indices is the event group
+ *   - enqueue to dequeue latency percentiles
+ */
+
+#define READABLE_BIT (1 << 0)
+#define WRITABLE_BIT (1 << 1)
+// A wait this much longer than a frame only times out if a wakeup was lost
+#define WAKEUP_TIMEOUT_MS 500
+
+struct Frame {
+    int64_t pushed_ns = 0;
+    std::vector<int16_t> pcm;
+};
+
+struct RunResult {
+    int frames = 0;
+    int lost_wakeups = 0;
+    int producer_waits = 0;
+    int empty_wakeups = 0;
+    int64_t push_total_ns = 0;
+    int64_t push_max_ns = 0;
+    int64_t pop_total_ns = 0;
+    int64_t pop_max_ns = 0;
+    std::vector<int64_t> latencies_ns;
+    int64_t wall_ns = 0;
+};
+
+static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Spin(int64_t ns) {
+    int64_t end = NowNs() + ns;
+    while (NowNs() < end) {
+    }
+}
+
+static RunResult Run(int frame_ms, int frames, size_t capacity, int work_us) {
+    AudioQueue<Frame> queue(capacity);
+    EventGroupHandle_t event_group = xEventGroupCreate();
+    queue.BindEvents(event_group, READABLE_BIT, WRITABLE_BIT);
+
+    RunResult result;
+    result.frames = frames;
+    result.latencies_ns.reserve(frames);
+    int64_t start_ns = NowNs();
+
+    std::thread consumer([&]() {
+        int received = 0;
+        Frame frame;
+        while (received < frames) {
+            EventBits_t bits = xEventGroupWaitBits(event_group, READABLE_BIT, pdTRUE, pdFALSE, WAKEUP_TIMEOUT_MS);
+            bool woken = (bits & READABLE_BIT) != 0;
+            if (!woken && !queue.empty()) {
+                result.lost_wakeups++;
+            }
+            bool popped = false;
+            while (true) {
+                int64_t pop_start = NowNs();
+                if (!queue.Pop(frame)) {
+                    break;
+                }
+                int64_t now = NowNs();
+                result.pop_total_ns += now - pop_start;
+                result.pop_max_ns = std::max(result.pop_max_ns, now - pop_start);
+                result.latencies_ns.push_back(now - frame.pushed_ns);
+                popped = true;
+                received++;
+                Spin(work_us * 1000LL);
+            }
+            if (woken && !popped) {
+                result.empty_wakeups++;
+            }
+        }
+    });
+
+    std::vector<int16_t> pcm(frame_ms > 0 ? frame_ms * 16 : 960);
+    int64_t next_ns = NowNs();
+    for (int i = 0; i < frames; i++) {
+        if (frame_ms > 0) {
+            next_ns += frame_ms * 1000000LL;
+            std::this_thread::sleep_for(std::chrono::nanoseconds(next_ns - NowNs()));
+        }
+        Frame frame;
+        frame.pcm = pcm;
+        while (true) {
+            frame.pushed_ns = NowNs();
+            bool pushed = queue.Push(std::move(frame));
+            int64_t push_ns = NowNs() - frame.pushed_ns;
+            if (pushed) {
+                result.push_total_ns += push_ns;
+                result.push_max_ns = std::max(result.push_max_ns, push_ns);
+                break;
+            }
+            result.producer_waits++;
+            xEventGroupWaitBits(event_group, WRITABLE_BIT, pdTRUE, pdFALSE, WAKEUP_TIMEOUT_MS);
+        }
+    }
+    consumer.join();
+    result.wall_ns = NowNs() - start_ns;
+    vEventGroupDelete(event_group);
+    return result;
+}
+
+static int64_t Percentile(std::vector<int64_t>& values, int percent) {
+    if (values.empty()) {
+        return 0;
+    }
+    size_t index = std::min(values.size() - 1, values.size() * percent / 100);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static void Report(const char* name, RunResult& result) {
+    int64_t max_latency = result.latencies_ns.empty() ? 0 :
+        *std::max_element(result.latencies_ns.begin(), result.latencies_ns.end());
+    printf("%-10s %7d %6d %7d %7d %8lld %8lld %8lld %8lld %9lld %9lld %9lld %9lld\n", name, result.frames,
+        result.lost_wakeups, result.producer_waits, result.empty_wakeups,
+        (long long)(result.push_total_ns / std::max(result.frames, 1)), (long long)result.push_max_ns,
+        (long long)(result.pop_total_ns / std::max(result.frames, 1)), (long long)result.pop_max_ns,
+        (long long)Percentile(result.latencies_ns, 50) / 1000, (long long)Percentile(result.latencies_ns, 99) / 1000,
+        (long long)max_latency / 1000, (long long)(result.wall_ns / 1000000));
+}
+
+int main(int argc, char** argv) {
+    int frames = 100;
+    size_t capacity = 4;
+    int work_us = 2000;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--frames") == 0) {
+            frames = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--capacity") == 0) {
+            capacity = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--work-us") == 0) {
+            work_us = atoi(argv[i + 1]);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    printf("capacity %zu, %d us of work per frame\n", capacity, work_us);
+    printf("%-10s %7s %6s %7s %7s %8s %8s %8s %8s %9s %9s %9s %9s\n", "frames", "count", "lost", "p_wait",
+        "c_empty", "push_ns", "push_max", "pop_ns", "pop_max", "p50_us", "p99_us", "max_us", "wall_ms");
+    auto paced60 = Run(60, frames, capacity, work_us);
+    Report("60 ms", paced60);
+    auto paced20 = Run(20, frames, capacity, work_us);
+    Report("20 ms", paced20);
+    // Unpaced, the producer runs into a full queue all the time and every wakeup is exercised
+    auto unpaced = Run(0, frames * 1000, capacity, 0);
+    Report("unpaced", unpaced);
+    return 0;
+}
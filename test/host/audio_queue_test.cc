@@ -0,0 +1,210 @@
+#include "audio_queue.h"
+#include "host_test.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#define READABLE_BIT (1 << 0)
+#define WRITABLE_BIT (1 << 1)
+
+static void TestPushPop() {
+    AudioQueue<int> queue(4);
+    for (int i = 0; i < 4; i++) {
+        CHECK(queue.Push(int(i)));
+    }
+    CHECK(queue.full());
+    int item = 100;
+    CHECK(!queue.Push(std::move(item)));
+    CHECK_EQ(item, 100);
+    CHECK_EQ(queue.size(), 4);
+
+    // Wrap around the slots several times, order is kept
+    int expected = 0;
+    for (int i = 4; i < 40; i++) {
+        CHECK(queue.Pop(item));
+        CHECK_EQ(item, expected++);
+        CHECK(queue.Push(int(i)));
+    }
+    while (queue.Pop(item)) {
+        CHECK_EQ(item, expected++);
+    }
+    CHECK_EQ(expected, 40);
+    CHECK(queue.empty());
+}
+
+static void TestSetCapacity() {
+    AudioQueue<int> queue(2, 6);
+    CHECK(queue.Push(1));
+    CHECK(queue.Push(2));
+    CHECK(!queue.Push(3));
+
+    queue.set_capacity(6);
+    CHECK_EQ(queue.capacity(), 6);
+    for (int i = 3; i <= 6; i++) {
+        CHECK(queue.Push(int(i)));
+    }
+    CHECK(!queue.Push(7));
+
+    // Lowering it keeps what is queued, the producer waits until the consumer is below it again
+    queue.set_capacity(3);
+    CHECK_EQ(queue.size(), 6);
+    CHECK(!queue.Push(7));
+    int item;
+    for (int i = 0; i < 3; i++) {
+        CHECK(queue.Pop(item));
+    }
+    CHECK(!queue.Push(7));
+    CHECK(queue.Pop(item));
+    CHECK(queue.Push(7));
+
+    queue.set_capacity(0);
+    CHECK_EQ(queue.capacity(), 1);
+}
+
+static void TestClear() {
+    AudioQueue<std::shared_ptr<int>> queue(4);
+    auto item = std::make_shared<int>(1);
+    CHECK(queue.Push(std::shared_ptr<int>(item)));
+    CHECK(queue.Push(std::make_shared<int>(2)));
+    queue.Clear();
+    CHECK_EQ(queue.size(), 0);
+    CHECK(queue.empty());
+
+    // The consumer drops the cleared items and releases them
+    CHECK(queue.Push(std::make_shared<int>(3)));
+    std::shared_ptr<int> popped;
+    CHECK(queue.Pop(popped));
+    CHECK_EQ(*popped, 3);
+    CHECK_EQ(item.use_count(), 1);
+    CHECK(!queue.Pop(popped));
+}
+
+static void TestClearFullQueue() {
+    // Nothing pops while the queue is cleared, like the testing queue between two recordings
+    AudioQueue<int> queue(4, 8);
+    for (int i = 0; i < 4; i++) {
+        CHECK(queue.Push(int(i)));
+    }
+    CHECK(queue.full());
+    queue.Clear();
+    CHECK(!queue.full());
+    for (int i = 10; i < 14; i++) {
+        CHECK(queue.Push(int(i)));
+    }
+    CHECK(queue.full());
+    CHECK(!queue.Push(14));
+    int item;
+    for (int i = 10; i < 14; i++) {
+        CHECK(queue.Pop(item));
+        CHECK_EQ(item, i);
+    }
+
+    // The same at the largest capacity
+    queue.set_capacity(8);
+    while (queue.Push(0)) {
+    }
+    CHECK_EQ(queue.size(), 8);
+    queue.Clear();
+    for (int i = 20; i < 28; i++) {
+        CHECK(queue.Push(int(i)));
+    }
+    CHECK(queue.full());
+    for (int i = 20; i < 28; i++) {
+        CHECK(queue.Pop(item));
+        CHECK_EQ(item, i);
+    }
+    CHECK(!queue.Pop(item));
+}
+
+static void TestClearWakesProducer() {
+    EventGroupHandle_t events = xEventGroupCreate();
+    AudioQueue<int> queue(2);
+    queue.BindEvents(events, READABLE_BIT, WRITABLE_BIT);
+    CHECK(queue.Push(1));
+    CHECK(queue.Push(2));
+    xEventGroupClearBits(events, WRITABLE_BIT);
+    queue.Clear();
+    CHECK(xEventGroupWaitBits(events, WRITABLE_BIT, pdTRUE, pdFALSE, 0) & WRITABLE_BIT);
+    CHECK(queue.Push(3));
+    vEventGroupDelete(events);
+}
+
+/*
+ * One producer and one consumer thread blocking on the event bits, while a third thread keeps
+ * clearing the queue and changing its capacity during the first half of the stream. The consumer
+ * must see strictly increasing items, and every item of the second half.
+ */
+static void TestConcurrentStress() {
+    const uint32_t count = 200000;
+    EventGroupHandle_t events = xEventGroupCreate();
+    AudioQueue<uint32_t> queue(8, 32);
+    queue.BindEvents(events, READABLE_BIT, WRITABLE_BIT);
+    std::atomic<bool> disturb = true;
+    std::atomic<bool> disturbed = false;
+
+    std::thread producer([&] {
+        for (uint32_t i = 1; i <= count; i++) {
+            if (i == count / 2) {
+                disturb = false;
+                while (!disturbed) {
+                    std::this_thread::yield();
+                }
+            }
+            uint32_t item = i;
+            while (!queue.Push(std::move(item))) {
+                xEventGroupWaitBits(events, WRITABLE_BIT, pdTRUE, pdFALSE, 10);
+            }
+        }
+    });
+
+    std::thread clearer([&] {
+        size_t capacity = 1;
+        while (disturb) {
+            queue.Clear();
+            queue.set_capacity(capacity);
+            capacity = capacity % 32 + 1;
+            std::this_thread::yield();
+        }
+        queue.set_capacity(32);
+        disturbed = true;
+    });
+
+    uint32_t last = 0;
+    uint32_t received = 0;
+    uint32_t out_of_order = 0;
+    uint32_t second_half = 0;
+    while (last != count) {
+        uint32_t item;
+        if (!queue.Pop(item)) {
+            xEventGroupWaitBits(events, READABLE_BIT, pdTRUE, pdFALSE, 10);
+            continue;
+        }
+        if (item <= last) {
+            out_of_order++;
+        }
+        if (item >= count / 2) {
+            second_half++;
+        }
+        last = item;
+        received++;
+    }
+    producer.join();
+    clearer.join();
+    vEventGroupDelete(events);
+
+    CHECK_EQ(out_of_order, 0);
+    CHECK_EQ(second_half, count - count / 2 + 1);
+    CHECK(received <= count);
+    CHECK(queue.empty());
+}
+
+int main() {
+    TestPushPop();
+    TestSetCapacity();
+    TestClear();
+    TestClearFullQueue();
+    TestClearWakesProducer();
+    TestConcurrentStress();
+    return TEST_RESULT();
+}
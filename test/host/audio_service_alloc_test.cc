@@ -0,0 +1,144 @@
+#include "audio_service.h"
+#include "wav_audio_codec.h"
+#include "host_test.h"
+
+#include <freertos/task.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <vector>
+
+/*
+ * Runs AudioService with the WAV codec and loops every uplink packet back as downlink, then checks
+ * that once the pools and buffers are warm a frame allocates nothing on the whole encode, send,
+ * decode and playback path. The test links with --wrap for malloc, calloc and realloc, which
+ * covers heap_caps_malloc, and replaces operator new, so every allocation is counted.
+ */
+
+#define INPUT_SAMPLE_RATE 16000
+#define OUTPUT_SAMPLE_RATE 24000
+#define INPUT_SECONDS 6
+#define WARMUP_PACKETS 10
+#define MEASURED_PACKETS 50
+// The input task reads all four capture slots of a 60 ms frame into a buffer that tasks trade
+#define TASK_PCM_SAMPLES (60 * INPUT_SAMPLE_RATE / 1000 * 4)
+#define PACKET_PAYLOAD_BYTES 1500
+
+static std::atomic<size_t> allocations{0};
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    allocations++;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+}
+
+void* operator new(size_t size) {
+    allocations++;
+    void* ptr = __real_malloc(size > 0 ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+static std::vector<int16_t> MakeTone(int seconds) {
+    std::vector<int16_t> samples(seconds * INPUT_SAMPLE_RATE);
+    for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] = (i / 8) % 2 ? -8000 : 8000;
+    }
+    return samples;
+}
+
+int main() {
+    WavAudioCodec codec(INPUT_SAMPLE_RATE, OUTPUT_SAMPLE_RATE);
+    codec.SetInput(MakeTone(INPUT_SECONDS));
+    // The recording grows with every block, room for all of it keeps it out of the count
+    codec.ReserveOutput((INPUT_SECONDS + 2) * OUTPUT_SAMPLE_RATE);
+
+    AudioService service;
+    service.Initialize(&codec);
+    // Which pooled objects a run touches depends on how deep the queues get, so all are warmed
+    service.WarmTaskPool(TASK_PCM_SAMPLES);
+    GetAudioStreamPacketPool().Warm([](AudioStreamPacket& packet) {
+        packet.payload.reserve(PACKET_PAYLOAD_BYTES);
+    });
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool available = false;
+    AudioServiceCallbacks callbacks;
+    callbacks.on_send_queue_available = [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        available = true;
+        cv.notify_one();
+    };
+    service.SetCallbacks(callbacks);
+    service.Start();
+    service.EnableVoiceProcessing(true);
+
+    uint32_t sequence = 0;
+    size_t warm_allocations = 0;
+    int64_t deadline_us = esp_timer_get_time() + INPUT_SECONDS * 1000000LL;
+    while (sequence < WARMUP_PACKETS + MEASURED_PACKETS && esp_timer_get_time() < deadline_us) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait_for(lock, std::chrono::milliseconds(20), [&]() { return available; });
+            available = false;
+        }
+        while (auto packet = service.PopPacketFromSendQueue()) {
+            packet->sequence = ++sequence;
+            service.PushPacketToDecodeQueue(std::move(packet));
+            if (sequence == WARMUP_PACKETS) {
+                warm_allocations = allocations;
+            }
+        }
+    }
+    size_t measured_allocations = allocations - warm_allocations;
+    CHECK(sequence >= WARMUP_PACKETS + MEASURED_PACKETS);
+    CHECK(codec.output().size() > 0);
+
+    service.EnableVoiceProcessing(false);
+    service.Stop();
+    HostJoinTasks();
+
+    printf("%lu packets looped back, %zu allocations after warm-up\n", (unsigned long)sequence, measured_allocations);
+    CHECK_EQ(measured_allocations, 0);
+    return TEST_RESULT();
+}
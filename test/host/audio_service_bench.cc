@@ -0,0 +1,278 @@
+#include "audio_service.h"
+#include "wav_audio_codec.h"
+
+#include <freertos/task.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+/*
+ * Runs AudioService on the host with the WAV codec and the G.711 stand-in for Opus. Every uplink
+ * packet is looped back as downlink, like a server echoing the user, so both directions run at once
+ * as in a full-duplex session. Reports the latency tracer stages, the CPU time of every audio task,
+ * the codec statistics and the queue high-water marks.
+ *
+ *   audio_service_bench [--seconds N] [--frame-ms 20|40|60] [--input in.wav] [--output out.wav]
+ *                       [--layout split|single|both] [--encode-load percent] [--decode-load percent]
+ *
+ * Without an input file the mic hears a 1 kHz burst every 500 ms. The bursts found again in the
+ * recorded speaker output give the mouth-to-ear latency through the whole pipeline, DMA included.
+ *
+ * The stand-in codec costs next to nothing unless --encode-load and --decode-load charge it a share
+ * of every frame duration (host_codec_load.h), the defaults are an Opus encoder at a raised
+ * complexity and a 24 kHz decoder. The split layout is the service as built, encode and decode each
+ * on their own task and core. The single layout makes them take turns on one core, as the codec
+ * task that ran both loops did; a frame waiting for the other codec then counts toward its deadline.
+ * Each layout runs in its own process so the tasks, timers and pools start fresh. The CPU times
+ * exclude the modelled codec load, they are those of the pipeline itself.
+ */
+
+#define INPUT_SAMPLE_RATE 16000
+#define OUTPUT_SAMPLE_RATE 24000
+#define BURST_INTERVAL_MS 500
+#define BURST_DURATION_MS 20
+#define ONSET_THRESHOLD 4000
+// A burst only counts as a new onset after this much silence
+#define ONSET_MIN_GAP_MS 200
+
+static std::vector<int16_t> MakeBursts(int seconds) {
+    std::vector<int16_t> samples(seconds * INPUT_SAMPLE_RATE);
+    for (size_t start = INPUT_SAMPLE_RATE / 5; start < samples.size(); start += BURST_INTERVAL_MS * INPUT_SAMPLE_RATE / 1000) {
+        for (size_t i = 0; i < BURST_DURATION_MS * INPUT_SAMPLE_RATE / 1000 && start + i < samples.size(); i++) {
+            // 1 kHz square wave, it survives the companding and the resampler with a sharp edge
+            samples[start + i] = (i / 8) % 2 ? -16000 : 16000;
+        }
+    }
+    return samples;
+}
+
+static std::vector<size_t> FindOnsets(const std::vector<int16_t>& samples, int sample_rate) {
+    std::vector<size_t> onsets;
+    size_t min_gap = ONSET_MIN_GAP_MS * sample_rate / 1000;
+    size_t last_loud = 0;
+    bool seen_loud = false;
+    for (size_t i = 0; i < samples.size(); i++) {
+        if (abs(samples[i]) < ONSET_THRESHOLD) {
+            continue;
+        }
+        if (!seen_loud || i - last_loud > min_gap) {
+            onsets.push_back(i);
+        }
+        seen_loud = true;
+        last_loud = i;
+    }
+    return onsets;
+}
+
+static void ReportMouthToEar(const WavAudioCodec& codec) {
+    auto input_onsets = FindOnsets(codec.input(), INPUT_SAMPLE_RATE);
+    auto output_onsets = FindOnsets(codec.output(), OUTPUT_SAMPLE_RATE);
+    int64_t captured_end = codec.input_start_us() + (int64_t)codec.input_position() * 1000000 / INPUT_SAMPLE_RATE;
+
+    int matched = 0, missed = 0;
+    int64_t total_us = 0, min_us = INT64_MAX, max_us = 0;
+    size_t next = 0;
+    for (auto onset : input_onsets) {
+        int64_t captured_us = codec.input_start_us() + (int64_t)onset * 1000000 / INPUT_SAMPLE_RATE;
+        if (captured_us > captured_end) {
+            break;
+        }
+        while (next < output_onsets.size() &&
+            codec.output_start_us() + (int64_t)output_onsets[next] * 1000000 / OUTPUT_SAMPLE_RATE < captured_us) {
+            next++;
+        }
+        if (next == output_onsets.size()) {
+            missed++;
+            continue;
+        }
+        int64_t played_us = codec.output_start_us() + (int64_t)output_onsets[next] * 1000000 / OUTPUT_SAMPLE_RATE;
+        int64_t latency_us = played_us - captured_us;
+        if (latency_us > 2000000) {
+            missed++;
+            continue;
+        }
+        matched++;
+        total_us += latency_us;
+        min_us = std::min(min_us, latency_us);
+        max_us = std::max(max_us, latency_us);
+        next++;
+    }
+    if (matched == 0) {
+        printf("mouth to ear: no burst made it through (%d missed)\n", missed);
+        return;
+    }
+    printf("mouth to ear: %d bursts, avg %lld ms, min %lld ms, max %lld ms, %d missed\n", matched,
+        (long long)(total_us / matched / 1000), (long long)(min_us / 1000), (long long)(max_us / 1000), missed);
+}
+
+static void ReportLatencyStages(AudioService& service) {
+    auto& tracer = service.GetLatencyTracer();
+    printf("%-22s %8s %10s %10s %10s %10s\n", "stage", "count", "avg_us", "p50<=us", "p99<=us", "max_us");
+    for (int i = 0; i < kLatencyStageCount; i++) {
+        auto stage = (AudioLatencyStage)i;
+        auto& histogram = tracer.histogram(stage);
+        if (histogram.count() == 0) {
+            continue;
+        }
+        printf("%-22s %8lu %10lu %10lu %10lu %10lu\n", AudioLatencyTracer::StageName(stage),
+            (unsigned long)histogram.count(), (unsigned long)histogram.average_us(),
+            (unsigned long)histogram.PercentileUpperUs(50), (unsigned long)histogram.PercentileUpperUs(99),
+            (unsigned long)histogram.max_us());
+    }
+}
+
+static void ReportCodecStatistics(const char* name, const CodecTaskStatistics& statistics) {
+    printf("%s: %lu frames, avg %llu us, max %lu us, %lu deadline misses\n", name, (unsigned long)statistics.frames,
+        (unsigned long long)statistics.average_us(), (unsigned long)statistics.max_us,
+        (unsigned long)statistics.deadline_misses);
+}
+
+static int Run(int seconds, int frame_ms, const char* input_path, const char* output_path) {
+    WavAudioCodec codec(INPUT_SAMPLE_RATE, OUTPUT_SAMPLE_RATE);
+    if (input_path != nullptr) {
+        if (!codec.LoadInput(input_path)) {
+            return 1;
+        }
+    } else {
+        codec.SetInput(MakeBursts(seconds));
+    }
+
+    AudioService service;
+    service.Initialize(&codec);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool available = false;
+    AudioServiceCallbacks callbacks;
+    callbacks.on_send_queue_available = [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        available = true;
+        cv.notify_one();
+    };
+    service.SetCallbacks(callbacks);
+    service.SetEncodeFrameDuration(frame_ms);
+    service.Start();
+    service.EnableVoiceProcessing(true);
+
+    /* The loopback plays the server, it runs on the main thread */
+    int64_t start_us = esp_timer_get_time();
+    int64_t end_us = start_us + seconds * 1000000LL;
+    int64_t loopback_cpu_us = HostThreadCpuTimeUs();
+    uint32_t sequence = 0;
+    while (esp_timer_get_time() < end_us) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait_for(lock, std::chrono::milliseconds(20), [&]() { return available; });
+            available = false;
+        }
+        while (auto packet = service.PopPacketFromSendQueue()) {
+            packet->sequence = ++sequence;
+            service.PushPacketToDecodeQueue(std::move(packet));
+        }
+    }
+    loopback_cpu_us = HostThreadCpuTimeUs() - loopback_cpu_us;
+
+    auto peaks = service.GetQueuePeaks();
+    service.EnableVoiceProcessing(false);
+    service.Stop();
+    HostJoinTasks();
+    int64_t wall_us = esp_timer_get_time() - start_us;
+
+    printf("%s layout, encode load %d%%, decode load %d%%\n", host_codec_load.shared_core ? "single" : "split",
+        host_codec_load.encode_percent, host_codec_load.decode_percent);
+    printf("%d s at %d ms frames, %lu packets looped back\n", seconds, frame_ms, (unsigned long)sequence);
+    ReportMouthToEar(codec);
+    printf("speaker underruns: %lu\n", (unsigned long)codec.output_underruns());
+    printf("\n");
+    ReportLatencyStages(service);
+    printf("\n");
+
+    printf("%-22s %10s %8s\n", "task", "cpu_ms", "cpu_%");
+    for (auto& task : host_tasks) {
+        printf("%-22s %10.1f %8.2f\n", task.name.c_str(), task.cpu_us / 1000.0, task.cpu_us * 100.0 / wall_us);
+    }
+    printf("%-22s %10.1f %8.2f\n", "loopback", loopback_cpu_us / 1000.0, loopback_cpu_us * 100.0 / wall_us);
+    printf("\n");
+
+    ReportCodecStatistics("encode", service.GetEncodeStatistics());
+    ReportCodecStatistics("decode", service.GetDecodeStatistics());
+    auto& jitter = service.GetJitterBufferStats();
+    printf("jitter buffer: late %lu, lost %lu, concealed %lu, underruns %lu, jitter %lu ms, target %lu ms\n",
+        (unsigned long)jitter.late, (unsigned long)jitter.lost, (unsigned long)jitter.concealed,
+        (unsigned long)jitter.underruns, (unsigned long)jitter.jitter_ms, (unsigned long)jitter.target_delay_ms);
+    printf("queue peaks: encode %zu/%d, send %zu/%d, decode %zu/%d, playback %zu/%d\n",
+        peaks.encode, QUEUE_FRAMES(ENCODE_QUEUE_BUDGET_MS, frame_ms),
+        peaks.send, QUEUE_FRAMES(SEND_QUEUE_BUDGET_MS, frame_ms),
+        peaks.decode, QUEUE_FRAMES(DECODE_QUEUE_BUDGET_MS, frame_ms),
+        peaks.playback, QUEUE_FRAMES(PLAYBACK_QUEUE_BUDGET_MS, frame_ms));
+
+    if (output_path != nullptr && !codec.SaveOutput(output_path)) {
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int seconds = 10;
+    int frame_ms = OPUS_FRAME_DURATION_MS;
+    const char* input_path = nullptr;
+    const char* output_path = nullptr;
+    const char* layout = "both";
+    host_codec_load.encode_percent = 60;
+    host_codec_load.decode_percent = 30;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--seconds") == 0) {
+            seconds = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--frame-ms") == 0) {
+            frame_ms = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--input") == 0) {
+            input_path = argv[i + 1];
+        } else if (strcmp(argv[i], "--output") == 0) {
+            output_path = argv[i + 1];
+        } else if (strcmp(argv[i], "--layout") == 0) {
+            layout = argv[i + 1];
+        } else if (strcmp(argv[i], "--encode-load") == 0) {
+            host_codec_load.encode_percent = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--decode-load") == 0) {
+            host_codec_load.decode_percent = atoi(argv[i + 1]);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (strcmp(layout, "split") == 0 || strcmp(layout, "single") == 0) {
+        host_codec_load.shared_core = strcmp(layout, "single") == 0;
+        return Run(seconds, frame_ms, input_path, output_path);
+    } else if (strcmp(layout, "both") != 0) {
+        fprintf(stderr, "Unknown layout %s\n", layout);
+        return 1;
+    }
+
+    int result = 0;
+    for (bool shared_core : {false, true}) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            host_codec_load.shared_core = shared_core;
+            // Only the first layout writes the output file
+            int status = Run(seconds, frame_ms, input_path, shared_core ? nullptr : output_path);
+            fflush(stdout);
+            _exit(status);
+        }
+        int status = 1;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            result = 1;
+        }
+        if (!shared_core) {
+            printf("\n========================================\n\n");
+        }
+    }
+    return result;
+}
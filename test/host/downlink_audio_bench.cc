@@ -0,0 +1,265 @@
+#include "audio_service.h"
+#include "protocol.h"
+#include "wav_audio_codec.h"
+#include "host_bench.h"
+
+#include <esp_memory_utils.h>
+#include <freertos/task.h>
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Downlink costs of the service: binary audio messages turned into packets, and local sounds
+ * played with and without the decoded sound cache.
+ *
+ *   downlink_audio_bench [--frames N] [--plays N] [--decode-load percent]
+ *
+ * The first part parses N messages of each WebSocket binary protocol version the way the receive
+ * callback does, with ParseBinaryAudio() or ParseBinaryProtocol4() and one copy of the payload into
+ * a pooled packet. Frames are 180 bytes, 60 ms of 24 kHz TTS at 24 kbit/s, version 4 carries 5 per
+ * message. Reports the cost per frame, how many frames per second one core copies, the CPU time
+ * sustained TTS takes per second, and operator new calls per frame.
+ *
+ * The second part runs AudioService as a board with PSRAM and plays a 1 s prompt from "flash" N
+ * times. The first play decodes it and fills the cache, the others are hits. Reports how long
+ * PlaySound() takes and the time from the call to the first sample at the speaker, DMA included.
+ * --decode-load charges the stand-in decoder that share of every frame (host_codec_load.h).
+ */
+
+#define TTS_FRAME_BYTES 180
+#define TTS_FRAME_MS 60
+#define BATCH_FRAMES 5
+#define SOUND_SAMPLE_RATE 16000
+#define OUTPUT_SAMPLE_RATE 24000
+#define SOUND_MS 1000
+// The speaker stays powered between plays, its idle timeout is longer
+#define PLAY_GAP_MS 800
+#define ONSET_THRESHOLD 4000
+
+static std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations++;
+    void* ptr = malloc(size > 0 ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+static std::vector<uint8_t> MakeMessage(int version, const std::vector<uint8_t>& frame) {
+    std::vector<uint8_t> message;
+    if (version == 2) {
+        message.resize(sizeof(BinaryProtocol2) + frame.size());
+        auto bp2 = (BinaryProtocol2*)message.data();
+        bp2->version = htons(2);
+        bp2->type = 0;
+        bp2->reserved = 0;
+        bp2->timestamp = htonl(1000);
+        bp2->payload_size = htonl(frame.size());
+        memcpy(bp2->payload, frame.data(), frame.size());
+    } else if (version == 3) {
+        message.resize(sizeof(BinaryProtocol3) + frame.size());
+        auto bp3 = (BinaryProtocol3*)message.data();
+        bp3->type = 0;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(frame.size());
+        memcpy(bp3->payload, frame.data(), frame.size());
+    } else if (version == 4) {
+        std::vector<AudioStreamPacketPtr> packets;
+        for (int i = 0; i < BATCH_FRAMES; i++) {
+            auto packet = GetAudioStreamPacketPool().Acquire();
+            packet->payload = frame;
+            packets.push_back(std::move(packet));
+        }
+        size_t payload_size = GetAudioBatchSize(packets.data(), packets.size());
+        message.resize(sizeof(BinaryProtocol4) + payload_size);
+        auto bp4 = (BinaryProtocol4*)message.data();
+        bp4->type = 0;
+        bp4->reserved = 0;
+        bp4->payload_size = htons(payload_size);
+        bp4->timestamp = htonl(1000);
+        WriteAudioBatch(packets.data(), packets.size(), bp4->payload);
+    } else {
+        message = frame;
+    }
+    return message;
+}
+
+static void ReportParsing(int messages) {
+    std::vector<uint8_t> frame(TTS_FRAME_BYTES);
+    for (size_t i = 0; i < frame.size(); i++) {
+        frame[i] = (uint8_t)(i * 13 + 5);
+    }
+    AudioStreamPacketPtr delivered;
+    auto deliver = [&](const BinaryAudioFrame& parsed) {
+        auto packet = GetAudioStreamPacketPool().Acquire();
+        packet->sample_rate = OUTPUT_SAMPLE_RATE;
+        packet->frame_duration = TTS_FRAME_MS;
+        packet->timestamp = parsed.timestamp;
+        packet->payload.assign(parsed.payload, parsed.payload + parsed.payload_size);
+        // The previous packet goes back to the pool, like the decode task releasing it
+        delivered = std::move(packet);
+    };
+
+    printf("Binary messages, %d per version, %d byte frames\n", messages, TTS_FRAME_BYTES);
+    printf("%8s %10s %10s %14s %14s %12s\n", "version", "frames", "ns/frame", "frames/s", "tts_us/s", "allocs/frm");
+    for (int version = 1; version <= 4; version++) {
+        auto message = MakeMessage(version, frame);
+        auto parse = [&]() {
+            if (version == 4) {
+                return ParseBinaryProtocol4(message.data(), message.size(), TTS_FRAME_MS, deliver);
+            }
+            BinaryAudioFrame parsed;
+            if (!ParseBinaryAudio(version, message.data(), message.size(), parsed)) {
+                return false;
+            }
+            deliver(parsed);
+            return true;
+        };
+        // Warms the pool, the packets then keep their capacity
+        if (!parse() || delivered->payload != frame) {
+            printf("Version %d: the parsed frame does not match\n", version);
+            return;
+        }
+
+        size_t frames = (size_t)messages * (version == 4 ? BATCH_FRAMES : 1);
+        size_t start_allocations = allocations;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < messages; i++) {
+            parse();
+            HostKeep(delivered->payload[0]);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        double ns_per_frame = ns / frames;
+        printf("%8d %10zu %10.1f %14.0f %14.2f %12.3f\n", version, frames, ns_per_frame, 1e9 / ns_per_frame,
+            ns_per_frame * (1000.0 / TTS_FRAME_MS) / 1000, (double)(allocations - start_allocations) / frames);
+    }
+    delivered.reset();
+}
+
+// One packet per page, OggOpusIndex reads neither the granule position nor the CRC
+static void AppendOggPage(std::string& ogg, const uint8_t* packet, size_t size, uint32_t sequence) {
+    uint8_t header[27] = {'O', 'g', 'g', 'S'};
+    header[5] = sequence == 0 ? 0x02 : 0;
+    memcpy(&header[18], &sequence, sizeof(sequence));
+    std::vector<uint8_t> lacing(size / 255 + 1, 255);
+    lacing.back() = size % 255;
+    header[26] = lacing.size();
+    ogg.append((const char*)header, sizeof(header));
+    ogg.append((const char*)lacing.data(), lacing.size());
+    ogg.append((const char*)packet, size);
+}
+
+static std::string MakeSound() {
+    std::string ogg;
+    uint8_t head[19] = {'O', 'p', 'u', 's', 'H', 'e', 'a', 'd', 1, 1};
+    uint32_t sample_rate = SOUND_SAMPLE_RATE;
+    memcpy(&head[12], &sample_rate, sizeof(sample_rate));
+    AppendOggPage(ogg, head, sizeof(head), 0);
+    const uint8_t tags[16] = {'O', 'p', 'u', 's', 'T', 'a', 'g', 's'};
+    AppendOggPage(ogg, tags, sizeof(tags), 1);
+
+    OpusEncoderWrapper encoder(SOUND_SAMPLE_RATE, 1, SOUND_FRAME_DURATION_MS);
+    std::vector<uint8_t> opus;
+    size_t frame_samples = SOUND_SAMPLE_RATE * SOUND_FRAME_DURATION_MS / 1000;
+    for (int i = 0; i < SOUND_MS / SOUND_FRAME_DURATION_MS; i++) {
+        std::vector<int16_t> pcm(frame_samples);
+        for (size_t j = 0; j < pcm.size(); j++) {
+            // 1 kHz square wave, loud enough to find its onset after resampling
+            pcm[j] = (j / 8) % 2 ? -16000 : 16000;
+        }
+        encoder.Encode(std::move(pcm), opus);
+        AppendOggPage(ogg, opus.data(), opus.size(), i + 2);
+    }
+    return ogg;
+}
+
+static void ReportSoundCache(int plays) {
+    // The prompt lives in "flash" so the service indexes and caches it, the copy is played normally
+    static const std::string sound = MakeSound();
+    const std::string warmup = sound;
+    host_drom_start = sound.data();
+    host_drom_size = sound.size();
+
+    int seconds = (plays + 1) * (SOUND_MS + PLAY_GAP_MS) / 1000 + 2;
+    WavAudioCodec codec(SOUND_SAMPLE_RATE, OUTPUT_SAMPLE_RATE);
+    codec.SetInput(std::vector<int16_t>());
+    codec.ReserveOutput(seconds * OUTPUT_SAMPLE_RATE * 2);
+    AudioService service;
+    service.Initialize(&codec);
+    service.Start();
+
+    // Powers up the speaker, the first cached play should not pay for that
+    service.PlaySound(warmup);
+    std::this_thread::sleep_for(std::chrono::milliseconds(SOUND_MS + PLAY_GAP_MS));
+
+    std::vector<int64_t> call_us(plays), returned_us(plays);
+    for (int i = 0; i < plays; i++) {
+        call_us[i] = esp_timer_get_time();
+        service.PlaySound(sound);
+        returned_us[i] = esp_timer_get_time();
+        std::this_thread::sleep_for(std::chrono::milliseconds(SOUND_MS + PLAY_GAP_MS));
+    }
+    auto stats = service.GetDecodedSoundCacheStats();
+    service.Stop();
+    HostJoinTasks();
+
+    printf("\nPrompt of %d ms from flash, %d plays, %d%% decode load\n", SOUND_MS, plays, host_codec_load.decode_percent);
+    printf("%6s %8s %12s %14s\n", "play", "cache", "call_us", "first_audio_ms");
+    auto& output = codec.output();
+    for (int i = 0; i < plays; i++) {
+        int64_t first = codec.output_start_us() < 0 ? -1 : (call_us[i] - codec.output_start_us()) * OUTPUT_SAMPLE_RATE / 1000000;
+        double first_audio_ms = -1;
+        for (int64_t j = std::max<int64_t>(first, 0); first >= 0 && j < (int64_t)output.size(); j++) {
+            if (abs(output[j]) >= ONSET_THRESHOLD) {
+                first_audio_ms = (double)(codec.output_start_us() + j * 1000000 / OUTPUT_SAMPLE_RATE - call_us[i]) / 1000;
+                break;
+            }
+        }
+        printf("%6d %8s %12lld %14.1f\n", i + 1, i == 0 ? "miss" : "hit", (long long)(returned_us[i] - call_us[i]),
+            first_audio_ms);
+    }
+    printf("cache: %lu hits, %lu misses, %zu bytes in %zu entries\n", (unsigned long)stats.hits,
+        (unsigned long)stats.misses, stats.bytes, stats.entries);
+}
+
+int main(int argc, char** argv) {
+    int messages = 200000;
+    int plays = 5;
+    host_codec_load.decode_percent = 10;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--frames") == 0) {
+            messages = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--plays") == 0) {
+            plays = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--decode-load") == 0) {
+            host_codec_load.decode_percent = atoi(argv[i + 1]);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    ReportParsing(messages);
+    ReportSoundCache(plays);
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef HOST_BENCH_H
+#define HOST_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Timing for the host benchmarks. HostCycles() reads the time stamp counter where there is one,
+ * which counts at a fixed rate close to the nominal clock, and falls back to nanoseconds.
+ */
+static inline uint64_t HostCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Keeps the compiler from dropping a result the benchmark never reads
+template <typename T>
+static inline void HostKeep(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+#endif // HOST_BENCH_H
@@ -0,0 +1,189 @@
+#include "jitter_buffer.h"
+#include "audio_service.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+/*
+ * Replays a downlink packet trace through the JitterBuffer on a simulated millisecond clock, with
+ * the opus decode task and the speaker around it: the decoder pulls while the playback queue has
+ * room, the speaker takes one frame per frame duration and stops when the queue runs dry.
+ *
+ *   jitter_buffer_sim [--trace file] [--loss percent] [--jitter ms] [--seed n]
+ *                     [--frame-ms 20|40|60] [--seconds n]
+ *
+ * A trace has one received packet per line, "arrival_ms sequence", '#' starts a comment. A
+ * sequence of 0 is an unsequenced WebSocket packet. Without a trace the server sends one packet
+ * per frame duration for --seconds. --loss drops packets at random and --jitter delays each one
+ * by a random 0..jitter ms on top of the trace, which also reorders them.
+ *
+ * Reports the late and concealed frame rates, the buffer's other counters and how long packets
+ * waited in it.
+ */
+
+struct TracePacket {
+    int64_t arrival_ms;
+    uint32_t sequence;
+};
+
+static bool LoadTrace(const char* path, std::vector<TracePacket>& trace) {
+    FILE* file = fopen(path, "r");
+    if (file == nullptr) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        char* comment = strchr(line, '#');
+        if (comment != nullptr) {
+            *comment = '\0';
+        }
+        long long arrival_ms;
+        unsigned long sequence;
+        int fields = sscanf(line, "%lld %lu", &arrival_ms, &sequence);
+        if (fields == 2) {
+            trace.push_back({arrival_ms, (uint32_t)sequence});
+        } else if (fields > 0) {
+            fprintf(stderr, "Invalid trace line: %s", line);
+            fclose(file);
+            return false;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+static int64_t Percentile(std::vector<int64_t>& values, int percent) {
+    if (values.empty()) {
+        return 0;
+    }
+    size_t index = std::min(values.size() - 1, values.size() * percent / 100);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+int main(int argc, char** argv) {
+    const char* trace_path = nullptr;
+    double loss_percent = 0;
+    int jitter_ms = 0;
+    unsigned seed = 1;
+    int frame_ms = 60;
+    int seconds = 60;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--trace") == 0) {
+            trace_path = argv[i + 1];
+        } else if (strcmp(argv[i], "--loss") == 0) {
+            loss_percent = atof(argv[i + 1]);
+        } else if (strcmp(argv[i], "--jitter") == 0) {
+            jitter_ms = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            seed = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--frame-ms") == 0) {
+            frame_ms = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--seconds") == 0) {
+            seconds = atoi(argv[i + 1]);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    std::vector<TracePacket> trace;
+    if (trace_path != nullptr) {
+        if (!LoadTrace(trace_path, trace)) {
+            return 1;
+        }
+    } else {
+        for (int i = 0; i < seconds * 1000 / frame_ms; i++) {
+            trace.push_back({(int64_t)i * frame_ms, (uint32_t)i + 1});
+        }
+    }
+
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> loss(0, 100);
+    std::uniform_int_distribution<int> delay(0, jitter_ms);
+    std::vector<TracePacket> arrivals;
+    for (auto& packet : trace) {
+        if (loss(random) < loss_percent) {
+            continue;
+        }
+        arrivals.push_back({packet.arrival_ms + delay(random), packet.sequence});
+    }
+    std::stable_sort(arrivals.begin(), arrivals.end(), [](const TracePacket& a, const TracePacket& b) {
+        return a.arrival_ms < b.arrival_ms;
+    });
+
+    JitterBuffer buffer(QUEUE_MAX_FRAMES(DECODE_QUEUE_BUDGET_MS), DECODE_QUEUE_BUDGET_MS);
+    size_t playback_capacity = QUEUE_FRAMES(PLAYBACK_QUEUE_BUDGET_MS, frame_ms);
+    size_t playback_queued = 0;
+    bool speaking = false;
+    int64_t next_play_ms = 0;
+    uint32_t played = 0;
+    uint32_t speaker_gaps = 0;
+    std::vector<int64_t> waits_ms;
+
+    size_t next = 0;
+    int64_t end_ms = arrivals.empty() ? 0 : arrivals.back().arrival_ms + DECODE_QUEUE_BUDGET_MS;
+    for (int64_t now = arrivals.empty() ? 0 : arrivals.front().arrival_ms; now <= end_ms; now++) {
+        for (; next < arrivals.size() && arrivals[next].arrival_ms <= now; next++) {
+            auto packet = GetAudioStreamPacketPool().Acquire();
+            packet->sample_rate = 24000;
+            packet->frame_duration = frame_ms;
+            packet->sequence = arrivals[next].sequence;
+            packet->queued_us = (uint32_t)now;
+            buffer.Put(std::move(packet), now);
+        }
+
+        // The decode task refills the playback queue, a missing frame is concealed
+        while (playback_queued < playback_capacity) {
+            AudioStreamPacketPtr packet;
+            auto result = buffer.Pull(packet, now);
+            if (result == JitterBuffer::kPullNone) {
+                break;
+            }
+            if (result == JitterBuffer::kPullPacket) {
+                waits_ms.push_back(now - packet->queued_us);
+            } else {
+                buffer.OnConcealed();
+            }
+            playback_queued++;
+        }
+
+        // The speaker plays a frame every frame duration while it has one
+        if (!speaking && playback_queued > 0) {
+            speaking = true;
+            next_play_ms = now;
+        }
+        if (speaking && now >= next_play_ms) {
+            if (playback_queued > 0) {
+                playback_queued--;
+                played++;
+                next_play_ms += frame_ms;
+            } else {
+                speaking = false;
+                speaker_gaps++;
+            }
+        }
+    }
+
+    auto& stats = buffer.stats();
+    size_t received = arrivals.size();
+    printf("%zu packets in the trace, %zu received (%.1f%% loss), jitter 0..%d ms, %d ms frames\n",
+        trace.size(), received, loss_percent, jitter_ms, frame_ms);
+    printf("late: %lu (%.2f%% of received)\n", (unsigned long)stats.late,
+        received > 0 ? stats.late * 100.0 / received : 0.0);
+    printf("concealed: %lu (%.2f%% of %lu frames played)\n", (unsigned long)stats.concealed,
+        played > 0 ? stats.concealed * 100.0 / played : 0.0, (unsigned long)played);
+    printf("lost %lu, duplicates %lu, underruns %lu, resyncs %lu, speaker gaps %lu\n", (unsigned long)stats.lost,
+        (unsigned long)stats.duplicates, (unsigned long)stats.underruns, (unsigned long)stats.resyncs,
+        (unsigned long)speaker_gaps);
+    printf("jitter %lu ms, target delay %lu ms\n", (unsigned long)stats.jitter_ms, (unsigned long)stats.target_delay_ms);
+    int64_t max_wait = waits_ms.empty() ? 0 : *std::max_element(waits_ms.begin(), waits_ms.end());
+    printf("buffer wait: p50 %lld ms, p95 %lld ms, max %lld ms\n", (long long)Percentile(waits_ms, 50),
+        (long long)Percentile(waits_ms, 95), (long long)max_wait);
+    return 0;
+}
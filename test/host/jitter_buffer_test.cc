@@ -0,0 +1,164 @@
+#include "jitter_buffer.h"
+#include "host_test.h"
+
+#include <esp_heap_caps.h>
+
+#define FRAME_MS 60
+
+AudioStreamPacketPool& GetAudioStreamPacketPool() {
+    static AudioStreamPacketPool pool(AUDIO_STREAM_PACKET_POOL_SIZE, MALLOC_CAP_INTERNAL);
+    return pool;
+}
+
+static AudioStreamPacketPtr MakePacket(uint32_t sequence) {
+    auto packet = GetAudioStreamPacketPool().Acquire();
+    packet->sample_rate = 16000;
+    packet->frame_duration = FRAME_MS;
+    packet->sequence = sequence;
+    packet->timestamp = sequence * FRAME_MS;
+    return packet;
+}
+
+// Pulls until a frame comes out or the buffer holds it back, returns its sequence, 0 if lost, -1 if none
+static long PullOne(JitterBuffer& buffer, int64_t now_ms) {
+    AudioStreamPacketPtr packet;
+    switch (buffer.Pull(packet, now_ms)) {
+    case JitterBuffer::kPullPacket:
+        return packet->sequence;
+    case JitterBuffer::kPullLost:
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+static void TestReorderAndLoss() {
+    JitterBuffer buffer(16, 16 * FRAME_MS);
+    int64_t now = 1000;
+    const uint32_t trace[] = {1, 3, 2, 2, 5, 6};
+    for (uint32_t sequence : trace) {
+        buffer.Put(MakePacket(sequence), now);
+    }
+    CHECK_EQ(buffer.stats().duplicates, 1);
+    CHECK_EQ(buffer.size(), 5);
+
+    // Everything arrived at once, playout starts right away
+    CHECK_EQ(PullOne(buffer, now), 1);
+    CHECK_EQ(PullOne(buffer, now), 2);
+    CHECK_EQ(PullOne(buffer, now), 3);
+    CHECK_EQ(PullOne(buffer, now), 0);
+    CHECK_EQ(PullOne(buffer, now), 5);
+    CHECK_EQ(buffer.stats().lost, 1);
+
+    // 4 is too late now
+    buffer.Put(MakePacket(4), now);
+    CHECK_EQ(buffer.stats().late, 1);
+    CHECK_EQ(PullOne(buffer, now), 6);
+    CHECK_EQ(PullOne(buffer, now), -1);
+    CHECK_EQ(buffer.stats().underruns, 1);
+}
+
+static void TestCleanNetworkAddsNoDelay() {
+    JitterBuffer buffer(16, 16 * FRAME_MS);
+    buffer.Put(MakePacket(1), 0);
+    // On a clean network the target is one frame, which is already buffered
+    CHECK_EQ(PullOne(buffer, 0), 1);
+    CHECK_EQ(buffer.stats().target_delay_ms, FRAME_MS);
+}
+
+static void TestJitterRaisesTarget() {
+    JitterBuffer buffer(16, 16 * FRAME_MS);
+    // Packets arrive in pairs, every other one 60 ms late
+    int64_t now = 0;
+    uint32_t sequence = 1;
+    for (; sequence <= 40; sequence++) {
+        now = (sequence / 2) * 2 * FRAME_MS;
+        buffer.Put(MakePacket(sequence), now);
+        PullOne(buffer, now);
+    }
+    CHECK(buffer.stats().jitter_ms >= FRAME_MS / 4);
+
+    // After an underrun the next packet is held until the higher target has passed
+    CHECK_EQ(PullOne(buffer, now), -1);
+    CHECK_EQ(buffer.stats().underruns, 1);
+    buffer.Put(MakePacket(sequence), now + FRAME_MS);
+    CHECK_EQ(PullOne(buffer, now + FRAME_MS), -1);
+    int wait_ms = buffer.NextWakeupMs(now + FRAME_MS);
+    CHECK(wait_ms > 0);
+    CHECK_EQ(PullOne(buffer, now + FRAME_MS + wait_ms), sequence);
+    CHECK(buffer.stats().target_delay_ms > FRAME_MS);
+}
+
+static void TestResync() {
+    JitterBuffer buffer(16, 16 * FRAME_MS);
+    buffer.Put(MakePacket(1), 0);
+    buffer.Put(MakePacket(1 + 16), 0);
+    CHECK_EQ(buffer.stats().resyncs, 1);
+    CHECK_EQ(buffer.size(), 1);
+    CHECK_EQ(PullOne(buffer, FRAME_MS), 17);
+}
+
+static void TestUnsequenced() {
+    // WebSocket packets carry no sequence, they are numbered in arrival order
+    JitterBuffer buffer(16, 16 * FRAME_MS);
+    for (int i = 0; i < 4; i++) {
+        buffer.Put(MakePacket(0), 0);
+    }
+    CHECK_EQ(buffer.size(), 4);
+    for (int i = 0; i < 4; i++) {
+        CHECK(PullOne(buffer, FRAME_MS) >= 0);
+    }
+    CHECK_EQ(buffer.stats().lost, 0);
+}
+
+// The decode task pulls until nothing is left, so packets arriving in real time underrun in between
+static void TestJitterWithUnderruns() {
+    JitterBuffer buffer(16, 16 * FRAME_MS);
+    for (uint32_t sequence = 1; sequence <= 40; sequence++) {
+        int64_t now = sequence * FRAME_MS + (sequence % 2) * 40;
+        buffer.Put(MakePacket(sequence), now);
+        AudioStreamPacketPtr packet;
+        while (buffer.Pull(packet, now) == JitterBuffer::kPullPacket) {
+        }
+    }
+    CHECK(buffer.stats().underruns > 0);
+    CHECK(buffer.stats().jitter_ms >= 20);
+}
+
+/*
+ * Talk spurts of 20 frames separated by 2 s of silence, every frame on time, the decoder pulling
+ * once per frame. The silence is not jitter, so the target stays one frame.
+ */
+static void TestIdleGapsAreNotJitter(bool sequenced) {
+    JitterBuffer buffer(16, 16 * FRAME_MS);
+    int64_t now = 0;
+    uint32_t sequence = 1;
+    for (int spurt = 0; spurt < 5; spurt++) {
+        for (int frame = 0; frame < 20; frame++) {
+            buffer.Put(MakePacket(sequenced ? sequence++ : 0), now);
+            AudioStreamPacketPtr packet;
+            CHECK_EQ(buffer.Pull(packet, now), JitterBuffer::kPullPacket);
+            now += FRAME_MS;
+        }
+        for (int frame = 0; frame < 2000 / FRAME_MS; frame++) {
+            CHECK_EQ(PullOne(buffer, now), -1);
+            now += FRAME_MS;
+        }
+    }
+    CHECK_EQ(buffer.stats().underruns, 5);
+    CHECK_EQ(buffer.stats().jitter_ms, 0);
+    CHECK_EQ(buffer.stats().target_delay_ms, FRAME_MS);
+    CHECK_EQ(buffer.stats().lost, 0);
+}
+
+int main() {
+    TestReorderAndLoss();
+    TestCleanNetworkAddsNoDelay();
+    TestJitterRaisesTarget();
+    TestResync();
+    TestUnsequenced();
+    TestJitterWithUnderruns();
+    TestIdleGapsAreNotJitter(false);
+    TestIdleGapsAreNotJitter(true);
+    return TEST_RESULT();
+}
@@ -0,0 +1,278 @@
+#include "protocol.h"
+#include "host_bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+/*
+ * Cost of dispatching server text messages, over a recorded session or a trace file.
+ *
+ *   json_message_bench [--rounds N] [--trace file]
+ *
+ * A trace file holds one message per line as the server sent it. Without one, the bench replays
+ * the messages of one spoken turn: hello, stt, llm, the tts sentences and the MCP calls of a
+ * volume change. Each message goes the way WebsocketProtocol::OnData sends it now: scanned and
+ * dispatched through the handler table, or parsed by cJSON when DispatchJson() turns it down.
+ * Next to that runs the dispatch before the scanner: cJSON_Parse() for every message and a strcmp
+ * chain on its type. Reports ns and allocations per message by type, allocations are counted at
+ * operator new and at the cJSON hooks.
+ *
+ * The host build has only a stand-in for cJSON. The comparison needs cJSON's sources, which CMake
+ * finds in ESP-IDF or in CJSON_SOURCE_DIR, and is left out without them.
+ */
+
+#ifndef HOST_CJSON
+#define HOST_CJSON 0
+#endif
+
+static const char* const kSessionTrace[] = {
+    R"({"type":"hello","transport":"websocket","session_id":"7b2f0c1e","audio_params":{"format":"opus","sample_rate":24000,"channels":1,"frame_duration":60}})",
+    R"({"type":"mcp","session_id":"7b2f0c1e","payload":{"jsonrpc":"2.0","method":"initialize","params":{"capabilities":{"vision":{"url":"http://api.xiaozhi.me/vision/explain","token":"test-token"}}},"id":1}})",
+    R"({"type":"mcp","session_id":"7b2f0c1e","payload":{"jsonrpc":"2.0","method":"tools/list","params":{"cursor":""},"id":2}})",
+    R"({"type":"stt","text":"把音量调到六十，然后讲个笑话","session_id":"7b2f0c1e"})",
+    R"({"type":"llm","text":"😊","emotion":"happy","session_id":"7b2f0c1e"})",
+    R"({"type":"mcp","session_id":"7b2f0c1e","payload":{"jsonrpc":"2.0","method":"tools/call","params":{"name":"self.audio_speaker.set_volume","arguments":{"volume":60}},"id":3}})",
+    R"({"type":"tts","state":"start","session_id":"7b2f0c1e","sample_rate":24000})",
+    R"({"type":"tts","state":"sentence_start","text":"好的，音量已经调到六十了。","session_id":"7b2f0c1e"})",
+    R"({"type":"tts","state":"sentence_end","text":"好的，音量已经调到六十了。","session_id":"7b2f0c1e"})",
+    R"({"type":"tts","state":"sentence_start","text":"给你讲个笑话吧：小明问爸爸，为什么天上的星星不会掉下来？","session_id":"7b2f0c1e"})",
+    R"({"type":"tts","state":"sentence_end","text":"给你讲个笑话吧：小明问爸爸，为什么天上的星星不会掉下来？","session_id":"7b2f0c1e"})",
+    R"({"type":"tts","state":"sentence_start","text":"爸爸说，因为它们都\"粘\"在天上了。","session_id":"7b2f0c1e"})",
+    R"({"type":"tts","state":"sentence_end","text":"爸爸说，因为它们都\"粘\"在天上了。","session_id":"7b2f0c1e"})",
+    R"({"type":"llm","text":"😂","emotion":"laughing","session_id":"7b2f0c1e"})",
+    R"({"type":"tts","state":"sentence_start","text":"小明想了想，说：那它们一定很怕胶水用完吧！哈哈。","session_id":"7b2f0c1e"})",
+    R"({"type":"tts","state":"sentence_end","text":"小明想了想，说：那它们一定很怕胶水用完吧！哈哈。","session_id":"7b2f0c1e"})",
+    R"({"type":"tts","state":"stop","session_id":"7b2f0c1e"})",
+};
+
+static std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations++;
+    void* ptr = malloc(size > 0 ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+#if HOST_CJSON
+static void* CountedMalloc(size_t size) {
+    allocations++;
+    return malloc(size);
+}
+#endif
+
+// The handlers read what Application's do, their work is the same on both paths
+static size_t handled_bytes = 0;
+
+static void Handle(const char* type, const char* state, const char* text, const char* emotion) {
+    handled_bytes += strlen(type);
+    if (state != nullptr) {
+        handled_bytes += strlen(state);
+    }
+    if (text != nullptr) {
+        handled_bytes += strlen(text);
+    }
+    if (emotion != nullptr) {
+        handled_bytes += strlen(emotion);
+    }
+}
+
+// The transport part of WebsocketProtocol::OnData, without a connection
+class TraceProtocol : public Protocol {
+public:
+    TraceProtocol() {
+        for (auto type : {"tts", "stt", "llm"}) {
+            OnIncomingMessage(type, [](const JsonMessage& message) {
+                Handle(message.type, message.state, message.text, message.emotion);
+            });
+        }
+        OnIncomingJson([](const cJSON* root) {
+            auto type = cJSON_GetObjectItem(root, "type");
+            auto payload = cJSON_GetObjectItem(root, "payload");
+            Handle(type->valuestring, nullptr, nullptr, nullptr);
+            HostKeep(payload);
+        });
+    }
+
+    bool Start() override { return true; }
+    bool OpenAudioChannel() override { return true; }
+    void CloseAudioChannel() override {}
+    bool IsAudioChannelOpened() const override { return true; }
+    bool SendAudio(AudioStreamPacketPtr packet) override { return true; }
+
+    // Returns whether the message needed the cJSON tree
+    bool Receive(const std::string& data) {
+        if (DispatchJson(data.data(), data.size())) {
+            return false;
+        }
+#if HOST_CJSON
+        auto root = cJSON_ParseWithLength(data.data(), data.size());
+        auto type = cJSON_GetObjectItem(root, "type");
+        if (cJSON_IsString(type) && strcmp(type->valuestring, "hello") != 0) {
+            DispatchJson(root);
+        }
+        cJSON_Delete(root);
+#endif
+        return true;
+    }
+
+protected:
+    bool SendText(const std::string& text) override { return true; }
+};
+
+#if HOST_CJSON
+// What OnData and Application did before the scanner
+static void ReceiveBefore(const std::string& data) {
+    auto root = cJSON_ParseWithLength(data.data(), data.size());
+    auto type = cJSON_GetObjectItem(root, "type");
+    auto get_string = [root](const char* name) -> const char* {
+        auto item = cJSON_GetObjectItem(root, name);
+        return cJSON_IsString(item) ? item->valuestring : nullptr;
+    };
+    if (!cJSON_IsString(type) || strcmp(type->valuestring, "hello") == 0) {
+        // The hello is parsed by the protocol on both paths
+    } else if (strcmp(type->valuestring, "tts") == 0) {
+        Handle(type->valuestring, get_string("state"), get_string("text"), nullptr);
+    } else if (strcmp(type->valuestring, "stt") == 0) {
+        Handle(type->valuestring, nullptr, get_string("text"), nullptr);
+    } else if (strcmp(type->valuestring, "llm") == 0) {
+        Handle(type->valuestring, nullptr, nullptr, get_string("emotion"));
+    } else if (strcmp(type->valuestring, "mcp") == 0) {
+        Handle(type->valuestring, nullptr, nullptr, nullptr);
+        HostKeep(cJSON_GetObjectItem(root, "payload"));
+    }
+    cJSON_Delete(root);
+}
+#endif
+
+struct Measurement {
+    double ns = 0;
+    double allocations = 0;
+};
+
+template <typename Function>
+static Measurement Measure(int rounds, Function function) {
+    function();
+    size_t start_allocations = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        function();
+    }
+    Measurement measurement;
+    measurement.ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / rounds;
+    measurement.allocations = (double)(allocations - start_allocations) / rounds;
+    return measurement;
+}
+
+static std::string TypeOf(const std::string& data) {
+    char buffer[JSON_MESSAGE_BUFFER_SIZE];
+    JsonMessage message;
+    if (ScanJsonMessage(data.data(), data.size(), message, buffer, sizeof(buffer)) && message.type != nullptr) {
+        return message.type;
+    }
+    return "(unscanned)";
+}
+
+int main(int argc, char** argv) {
+    int rounds = 100000;
+    const char* trace_path = nullptr;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--rounds") == 0) {
+            rounds = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            trace_path = argv[i + 1];
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    std::vector<std::string> trace;
+    if (trace_path != nullptr) {
+        std::ifstream file(trace_path);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty()) {
+                trace.push_back(line);
+            }
+        }
+    } else {
+        trace.assign(std::begin(kSessionTrace), std::end(kSessionTrace));
+    }
+    if (trace.empty()) {
+        fprintf(stderr, "No messages in %s\n", trace_path);
+        return 1;
+    }
+
+#if HOST_CJSON
+    cJSON_Hooks hooks = {CountedMalloc, free};
+    cJSON_InitHooks(&hooks);
+#endif
+    TraceProtocol protocol;
+
+    // Messages of one type are timed together, in trace order
+    std::map<std::string, std::vector<const std::string*>> by_type;
+    for (auto& data : trace) {
+        by_type[TypeOf(data)].push_back(&data);
+    }
+
+    printf("%zu messages, %d rounds\n", trace.size(), rounds);
+    printf("%-12s %6s %6s %10s %10s", "type", "count", "path", "ns/msg", "allocs/msg");
+#if HOST_CJSON
+    printf(" %12s %12s", "before_ns", "before_alloc");
+#endif
+    printf("\n");
+    Measurement total_now, total_before;
+    for (auto& [type, messages] : by_type) {
+        bool tree = false;
+        auto now = Measure(rounds, [&]() {
+            for (auto data : messages) {
+                tree = protocol.Receive(*data);
+            }
+        });
+        total_now.ns += now.ns;
+        total_now.allocations += now.allocations;
+        printf("%-12s %6zu %6s %10.1f %10.2f", type.c_str(), messages.size(), tree ? "tree" : "scan",
+            now.ns / messages.size(), now.allocations / messages.size());
+#if HOST_CJSON
+        auto before = Measure(rounds, [&]() {
+            for (auto data : messages) {
+                ReceiveBefore(*data);
+            }
+        });
+        total_before.ns += before.ns;
+        total_before.allocations += before.allocations;
+        printf(" %12.1f %12.2f", before.ns / messages.size(), before.allocations / messages.size());
+#endif
+        printf("\n");
+    }
+    printf("%-12s %6zu %6s %10.1f %10.2f", "all", trace.size(), "", total_now.ns / trace.size(),
+        total_now.allocations / trace.size());
+#if HOST_CJSON
+    printf(" %12.1f %12.2f", total_before.ns / trace.size(), total_before.allocations / trace.size());
+#else
+    printf("\ncJSON was not built in, the tree path above only counts the scan that turned it down");
+#endif
+    printf("\n");
+    HostKeep(handled_bytes);
+    return 0;
+}
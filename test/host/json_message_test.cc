@@ -0,0 +1,74 @@
+#include "json_message.h"
+#include "host_test.h"
+
+#include <cstring>
+
+static bool Scan(const char* text, JsonMessage& message, char* buffer, size_t size) {
+    message = JsonMessage();
+    return ScanJsonMessage(text, strlen(text), message, buffer, size);
+}
+
+static bool Equals(const char* actual, const char* expected) {
+    return actual != nullptr && strcmp(actual, expected) == 0;
+}
+
+static void TestFields() {
+    char buffer[JSON_MESSAGE_BUFFER_SIZE];
+    JsonMessage message;
+    CHECK(Scan(R"({"type":"tts","state":"sentence_start","text":"你好\n\"x\" 😀","session_id":"abc"})",
+        message, buffer, sizeof(buffer)));
+    CHECK(Equals(message.type, "tts"));
+    CHECK(Equals(message.state, "sentence_start"));
+    CHECK(Equals(message.text, "你好\n\"x\" 😀"));
+    CHECK(Equals(message.session_id, "abc"));
+    CHECK(message.emotion == nullptr);
+
+    // Other values are skipped whatever they hold, null is not a string
+    CHECK(Scan(R"( { "session_id" : null , "type" : "llm", "x": {"a":[1,"}]",{"b":2}]}, "n": -1.5e3,)"
+        R"( "t": true, "emotion":"happy" } )", message, buffer, sizeof(buffer)));
+    CHECK(message.session_id == nullptr);
+    CHECK(Equals(message.type, "llm"));
+    CHECK(Equals(message.emotion, "happy"));
+
+    // The first of duplicated keys wins, as with cJSON_GetObjectItem()
+    CHECK(Scan(R"({"type":"a","type":"b"})", message, buffer, sizeof(buffer)));
+    CHECK(Equals(message.type, "a"));
+
+    CHECK(Scan(R"({"session_id":null,"session_id":"abc","Type":1,"type":"tts"})", message, buffer, sizeof(buffer)));
+    CHECK(message.session_id == nullptr);
+    CHECK(message.type == nullptr);
+
+    // Keys match regardless of case, as they do for cJSON_GetObjectItem()
+    CHECK(Scan(R"({"TYPE":"tts","State":"start","text_x":"no"})", message, buffer, sizeof(buffer)));
+    CHECK(Equals(message.type, "tts"));
+    CHECK(Equals(message.state, "start"));
+    CHECK(message.text == nullptr);
+
+    CHECK(Scan(R"({})", message, buffer, sizeof(buffer)));
+    CHECK(message.type == nullptr);
+}
+
+static void TestEscapes() {
+    char buffer[JSON_MESSAGE_BUFFER_SIZE];
+    JsonMessage message;
+    CHECK(Scan(R"({"type":"stt","text":"\u4f60\ud83d\ude00\/\t"})", message, buffer, sizeof(buffer)));
+    CHECK(Equals(message.text, "你😀/\t"));
+}
+
+static void TestRejected() {
+    char buffer[JSON_MESSAGE_BUFFER_SIZE];
+    JsonMessage message;
+    CHECK(!Scan(R"({"type":"tts","text":"abc)", message, buffer, sizeof(buffer)));
+    CHECK(!Scan(R"([1,2])", message, buffer, sizeof(buffer)));
+    CHECK(!Scan(R"({"type":"x",})", message, buffer, sizeof(buffer)));
+    // The strings do not fit the buffer
+    CHECK(!Scan(R"({"type":"tts","text":"0123456789"})", message, buffer, 12));
+}
+
+int main() {
+    static_assert(HashJsonType("tts") != HashJsonType("stt"), "hash collision");
+    TestFields();
+    TestEscapes();
+    TestRejected();
+    return TEST_RESULT();
+}
@@ -0,0 +1,130 @@
+#include "playout_clock.h"
+#include "host_test.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#define SAMPLE_RATE 16000
+#define DMA_SAMPLES 960     // 60 ms
+#define DMA_FRAME_SAMPLES 240   // 15 ms per descriptor
+#define DMA_FRAME_US 15000
+#define BLOCK_SAMPLES 960
+#define BLOCK_US 60000
+
+static void TestBlockingWrites() {
+    PlayoutClock clock;
+    clock.Configure(SAMPLE_RATE, DMA_SAMPLES, DMA_FRAME_SAMPLES);
+    CHECK_EQ(clock.TimestampAt(0), 0);
+
+    // The write returns once its last sample is in a full DMA queue, so the block ends one DMA
+    // queue after that: 1000..1060 ms plays from 100 ms to 160 ms
+    clock.OnWrite(1000, BLOCK_SAMPLES, 0, 40000, 100000);
+    CHECK_EQ(clock.TimestampAt(100000), 1000);
+    CHECK_EQ(clock.TimestampAt(130000), 1030);
+    CHECK_EQ(clock.TimestampAt(159999), 1059);
+    CHECK_EQ(clock.TimestampAt(99999), 0);
+    CHECK_EQ(clock.TimestampAt(160000), 0);
+
+    // A write that does not block follows the previous block
+    clock.OnWrite(1060, BLOCK_SAMPLES, 0, 100100, 100200);
+    CHECK_EQ(clock.TimestampAt(160000), 1060);
+    CHECK_EQ(clock.TimestampAt(219000), 1119);
+}
+
+static void TestUnderrunAndDelay() {
+    PlayoutClock clock;
+    clock.Configure(SAMPLE_RATE, DMA_SAMPLES, DMA_FRAME_SAMPLES);
+    clock.OnWrite(2000, BLOCK_SAMPLES, 0, 0, 100);
+    // The queue ran dry at 60 ms and the DMA kept sending silent descriptors, the one playing at
+    // 500 ms ends at 510 ms and the block follows it
+    clock.OnWrite(3000, BLOCK_SAMPLES, 0, 500000, 500100);
+    CHECK_EQ(clock.TimestampAt(505000), 0);
+    CHECK_EQ(clock.TimestampAt(510000), 3000);
+    CHECK_EQ(clock.TimestampAt(510000 + BLOCK_US - 1), 3059);
+
+    // Written on a descriptor boundary, the block starts right away
+
+    // Filter delay shifts the stream time back
+    clock.OnWrite(4000, BLOCK_SAMPLES, 5000, 600000, 600100);
+    CHECK_EQ(clock.TimestampAt(600000 + 10000), 4005);
+
+    // Untimestamped audio, local sounds, moves the play-out on but maps to nothing
+    clock.OnWrite(0, BLOCK_SAMPLES, 0, 700000, 700100);
+    CHECK_EQ(clock.TimestampAt(700000 + 1000), 0);
+}
+
+static void TestWraparound() {
+    PlayoutClock clock;
+    clock.Configure(SAMPLE_RATE, DMA_SAMPLES, DMA_FRAME_SAMPLES);
+    uint32_t start = 0xffffffffu - 30000;
+    // The block plays from start + 20 ms to start + 80 ms, across the wrap of the 32-bit clock
+    clock.OnWrite(500, BLOCK_SAMPLES, 0, start, start + 20000);
+    CHECK_EQ(clock.TimestampAt(start + 40000), 520);
+    CHECK_EQ(clock.TimestampAt(start + 79000), 559);
+}
+
+/*
+ * The mic hears what the speaker plays: a writer with late blocks runs against a model of the I2S
+ * DMA ring, the same one WavAudioCodec uses, and at every ms the stream time the clock gives must
+ * be the one of the sample the ring was playing.
+ */
+static void TestLoopbackAlignment() {
+    // 20 ms frames from the server, shorter than the DMA ring, so a write after an underrun does not block
+    const size_t block_samples = 320;
+    const uint32_t block_us = 20000;
+    struct Block {
+        size_t position;
+        uint32_t timestamp_ms;
+    };
+    PlayoutClock clock;
+    clock.Configure(SAMPLE_RATE, DMA_SAMPLES, DMA_FRAME_SAMPLES);
+    const uint32_t output_start_us = 1000000;
+    std::vector<Block> blocks;
+    size_t written = 0;
+    uint32_t arrival_us = output_start_us - block_us;
+    uint32_t now_us = output_start_us;
+    uint32_t checked_us = output_start_us;
+    uint32_t random = 1;
+    for (int i = 0; i < 200; i++) {
+        // Every 7th frame is late enough to drain the ring
+        random = random * 1103515245 + 12345;
+        arrival_us += block_us + (i % 7 == 3 ? 20000 + (random >> 16) % 60000 : 0);
+        uint32_t start_us = std::max(now_us, arrival_us);
+        size_t played = (uint64_t)(start_us - output_start_us) * SAMPLE_RATE / 1000000;
+        if (played > written) {
+            written = (played + DMA_FRAME_SAMPLES - 1) / DMA_FRAME_SAMPLES * DMA_FRAME_SAMPLES;
+        }
+        uint32_t end_us = start_us + 50;
+        if (written + block_samples > DMA_SAMPLES) {
+            end_us = std::max<uint32_t>(end_us, output_start_us +
+                (uint64_t)(written + block_samples - DMA_SAMPLES) * 1000000 / SAMPLE_RATE);
+        }
+        blocks.push_back({written, 1000 + (uint32_t)i * 20});
+        clock.OnWrite(blocks.back().timestamp_ms, block_samples, 0, start_us, end_us);
+        written += block_samples;
+        now_us = end_us;
+
+        // What the mic captured up to this write
+        for (; checked_us < start_us; checked_us += 1000) {
+            size_t sample = (uint64_t)(checked_us - output_start_us) * SAMPLE_RATE / 1000000;
+            uint32_t expected = 0;
+            for (auto& block : blocks) {
+                if (sample >= block.position && sample < block.position + block_samples) {
+                    expected = block.timestamp_ms + (sample - block.position) * 1000 / SAMPLE_RATE;
+                }
+            }
+            uint32_t actual = clock.TimestampAt(checked_us);
+            CHECK((expected == 0) == (actual == 0));
+            CHECK(std::abs((int32_t)(actual - expected)) <= 1);
+        }
+    }
+}
+
+int main() {
+    TestBlockingWrites();
+    TestUnderrunAndDelay();
+    TestWraparound();
+    TestLoopbackAlignment();
+    return TEST_RESULT();
+}
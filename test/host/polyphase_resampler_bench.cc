@@ -0,0 +1,85 @@
+#include "polyphase_resampler.h"
+#include "audio_kernels.h"
+#include "host_bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+/*
+ * Cost of PolyphaseResampler for the ratios the service uses, processed in place in 60 ms blocks
+ * like the opus decode task does.
+ *
+ *   polyphase_resampler_bench [--blocks N]
+ *
+ * Reports the taps per phase, which is also the multiply-accumulates per output sample, the size of
+ * the shared coefficient table, and cycles per block (median over N blocks) and per output sample.
+ * Every phase is a multiple of 16 taps and aligned, so on the ESP32-S3 all dot products take the
+ * vector path of AudioKernels::DotProduct(); the host runs the scalar one.
+ */
+
+#define BLOCK_MS 60
+
+struct Ratio {
+    int input_sample_rate;
+    int output_sample_rate;
+};
+
+static void Run(const Ratio& ratio, int blocks) {
+    PolyphaseResampler resampler;
+    resampler.Configure(ratio.input_sample_rate, ratio.output_sample_rate);
+    size_t samples = ratio.input_sample_rate * BLOCK_MS / 1000;
+    std::vector<int16_t> input(samples);
+    for (size_t i = 0; i < samples; i++) {
+        input[i] = (int16_t)((i * 7919) & 0x3fff) - 0x2000;
+    }
+    std::vector<int16_t> pcm;
+    pcm.reserve(samples * 6 + AUDIO_KERNELS_PADDING);
+
+    std::vector<uint64_t> cycles;
+    size_t output_samples = 0;
+    for (int n = 0; n < blocks; n++) {
+        pcm.assign(input.begin(), input.end());
+        uint64_t start = HostCycles();
+        resampler.Process(pcm);
+        cycles.push_back(HostCycles() - start);
+        output_samples = pcm.size();
+        HostKeep(pcm[0]);
+    }
+    std::nth_element(cycles.begin(), cycles.begin() + cycles.size() / 2, cycles.end());
+    uint64_t median = cycles[cycles.size() / 2];
+
+    int divisor = std::gcd(ratio.input_sample_rate, ratio.output_sample_rate);
+    int up = ratio.output_sample_rate / divisor;
+    int down = ratio.input_sample_rate / divisor;
+    int taps = POLYPHASE_RESAMPLER_TAPS * std::max(1, (down + up - 1) / up);
+    printf("%6d -> %-6d %4d/%-4d %5d %8zu %10llu %9.1f\n", ratio.input_sample_rate, ratio.output_sample_rate,
+        up, down, taps, up * taps * sizeof(int16_t), (unsigned long long)median,
+        (double)median / std::max<size_t>(output_samples, 1));
+}
+
+int main(int argc, char** argv) {
+    int blocks = 500;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--blocks") == 0) {
+            blocks = atoi(argv[i + 1]);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    printf("Cycles per %d ms block in place, median of %d\n", BLOCK_MS, blocks);
+    printf("%-16s %9s %5s %8s %10s %9s\n", "ratio", "L/M", "taps", "table_b", "cycles", "per_out");
+    const Ratio ratios[] = {
+        {16000, 24000}, {24000, 16000}, {16000, 48000}, {48000, 16000},
+        {24000, 44100}, {16000, 8000}, {24000, 48000},
+    };
+    for (auto& ratio : ratios) {
+        Run(ratio, blocks);
+    }
+    return 0;
+}
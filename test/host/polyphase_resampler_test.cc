@@ -0,0 +1,106 @@
+#include "polyphase_resampler.h"
+#include "host_test.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Low enough that the filter delay is less than one period, so the phase of the output measures it
+#define TONE_HZ 250.0
+#define AMPLITUDE 16000.0
+
+static std::vector<int16_t> Tone(int sample_rate, size_t samples) {
+    std::vector<int16_t> pcm(samples);
+    for (size_t i = 0; i < samples; i++) {
+        pcm[i] = (int16_t)std::lround(AMPLITUDE * std::sin(2.0 * M_PI * TONE_HZ * i / sample_rate));
+    }
+    return pcm;
+}
+
+struct ToneFit {
+    double snr_db;
+    double delay_us;
+};
+
+/*
+ * Resamples a tone and fits a sine of the same frequency to the output. The phase of the fit is
+ * the delay of the filter, what the fit leaves over is noise and distortion.
+ */
+static ToneFit Measure(PolyphaseResampler& resampler, size_t block) {
+    int input_rate = resampler.input_sample_rate();
+    int output_rate = resampler.output_sample_rate();
+    auto input = Tone(input_rate, input_rate);
+
+    std::vector<int16_t> output;
+    for (size_t offset = 0; offset < input.size(); offset += block) {
+        size_t samples = std::min(block, input.size() - offset);
+        size_t expected = resampler.GetOutputSamples(samples);
+        std::vector<int16_t> out(expected);
+        size_t count = resampler.Process(input.data() + offset, samples, out.data());
+        CHECK_EQ(count, expected);
+        output.insert(output.end(), out.begin(), out.begin() + count);
+    }
+    CHECK_EQ(output.size(), (size_t)output_rate);
+
+    // Least squares fit of a * sin + b * cos over whole periods, skipping the filter start up
+    size_t first = output_rate / 10;
+    double sa = 0;
+    double sb = 0;
+    for (size_t i = first; i < output.size(); i++) {
+        double w = 2.0 * M_PI * TONE_HZ * i / output_rate;
+        sa += output[i] * std::sin(w);
+        sb += output[i] * std::cos(w);
+    }
+    double n = (output.size() - first) / 2.0;
+    double a = sa / n;
+    double b = sb / n;
+
+    double signal = 0;
+    double noise = 0;
+    for (size_t i = first; i < output.size(); i++) {
+        double w = 2.0 * M_PI * TONE_HZ * i / output_rate;
+        double fit = a * std::sin(w) + b * std::cos(w);
+        signal += fit * fit;
+        noise += (output[i] - fit) * (output[i] - fit);
+    }
+    // sin(w - 2 pi f d) = cos(2 pi f d) sin(w) - sin(2 pi f d) cos(w)
+    double delay_us = std::atan2(-b, a) / (2.0 * M_PI * TONE_HZ) * 1e6;
+    return {10.0 * std::log10(signal / noise), delay_us};
+}
+
+static void TestRatios() {
+    const int rates[][2] = {{24000, 16000}, {16000, 24000}, {16000, 48000}, {48000, 16000}, {24000, 44100}};
+    for (auto& rate : rates) {
+        PolyphaseResampler resampler;
+        resampler.Configure(rate[0], rate[1]);
+        ToneFit fit = Measure(resampler, 160);
+        fprintf(stderr, "%d -> %d: SNR %.1f dB, delay %.1f us, reported %lu us\n", rate[0], rate[1],
+            fit.snr_db, fit.delay_us, (unsigned long)resampler.delay_us());
+        CHECK(fit.snr_db >= 60.0);
+        CHECK(std::fabs(fit.delay_us - resampler.delay_us()) <= 1.0);
+    }
+
+    // Odd block sizes carry the filter state across calls
+    PolyphaseResampler resampler;
+    resampler.Configure(24000, 16000);
+    CHECK(Measure(resampler, 37).snr_db >= 60.0);
+}
+
+static void TestInPlace() {
+    PolyphaseResampler a;
+    PolyphaseResampler b;
+    a.Configure(16000, 24000);
+    b.Configure(16000, 24000);
+    auto pcm = Tone(16000, 320);
+    std::vector<int16_t> out(a.GetOutputSamples(pcm.size()));
+    out.resize(a.Process(pcm.data(), pcm.size(), out.data()));
+    b.Process(pcm);
+    CHECK(pcm == out);
+    CHECK_EQ(pcm.size(), 480);
+}
+
+int main() {
+    TestRatios();
+    TestInPlace();
+    return TEST_RESULT();
+}
@@ -0,0 +1,70 @@
+#include "replay_window.h"
+#include "host_test.h"
+
+static void TestReorderAndDuplicates() {
+    ReplayWindow window;
+    // 5 arrives after 7, 3 twice, 9 never
+    const uint32_t trace[] = {1, 2, 3, 4, 6, 7, 5, 3, 8, 10};
+    int accepted = 0;
+    for (uint32_t sequence : trace) {
+        accepted += window.Accept(sequence);
+    }
+    CHECK_EQ(accepted, 9);
+    CHECK_EQ(window.stats().received, 9);
+    CHECK_EQ(window.stats().reordered, 1);
+    CHECK_EQ(window.stats().duplicates, 1);
+    CHECK_EQ(window.stats().lost, 0);
+
+    // 9 is counted lost once it leaves the window, then it is a replay
+    for (uint32_t sequence = 11; sequence < 11 + REPLAY_WINDOW_SIZE; sequence++) {
+        window.Accept(sequence);
+    }
+    CHECK_EQ(window.stats().lost, 1);
+    CHECK(!window.Accept(9));
+    CHECK_EQ(window.stats().too_old, 1);
+
+    // A gap of 99 is lost as a whole once the window moves past it
+    window.Accept(74 + 100);
+    window.Accept(74 + 100 + REPLAY_WINDOW_SIZE);
+    CHECK_EQ(window.stats().lost, 1 + 99);
+}
+
+static void TestWraparoundAndResync() {
+    ReplayWindow window;
+    CHECK(window.Accept(0xfffffffe));
+    CHECK(window.Accept(1));
+    CHECK(window.Accept(0xffffffff));
+    CHECK(window.Accept(0));
+    CHECK_EQ(window.stats().reordered, 2);
+    CHECK_EQ(window.stats().lost, 0);
+
+    CHECK(window.Accept(1 + REPLAY_WINDOW_MAX_JUMP + 1));
+    CHECK_EQ(window.stats().resyncs, 1);
+}
+
+static void TestLateStart() {
+    // Packets sent before the first one received are not lost, they may still arrive
+    ReplayWindow window;
+    CHECK(window.Accept(5));
+    CHECK(window.Accept(3));
+    CHECK(window.Accept(4));
+    CHECK(!window.Accept(4));
+    CHECK(window.Accept(6));
+    CHECK(window.Accept(2));
+    for (uint32_t sequence = 7; sequence < 200; sequence++) {
+        window.Accept(sequence);
+    }
+    CHECK_EQ(window.stats().lost, 0);
+    CHECK_EQ(window.stats().duplicates, 1);
+
+    window.Reset();
+    CHECK(window.Accept(3));
+    CHECK_EQ(window.stats().received, 1);
+}
+
+int main() {
+    TestReorderAndDuplicates();
+    TestWraparoundAndResync();
+    TestLateStart();
+    return TEST_RESULT();
+}
@@ -0,0 +1,5 @@
+// Host build: the globals application.cc defines for the audio code
+
+extern "C" {
+    bool headset_present = false;
+}
@@ -0,0 +1,6 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+// Host build: the audio code only includes the board header, it uses nothing from it
+
+#endif // BOARD_H
@@ -0,0 +1,26 @@
+#ifndef CJSON_H
+#define CJSON_H
+
+/*
+ * Host build: the code under test only passes cJSON pointers around. No tree is ever built,
+ * creating one gives nullptr and every lookup comes back empty.
+ */
+typedef struct cJSON {
+    char* valuestring;
+    int valueint;
+    double valuedouble;
+} cJSON;
+
+inline cJSON* cJSON_CreateObject() { return nullptr; }
+inline cJSON* cJSON_CreateArray() { return nullptr; }
+inline cJSON* cJSON_CreateNumber(double number) { return nullptr; }
+inline void cJSON_AddItemToObject(cJSON* object, const char* name, cJSON* item) {}
+inline void cJSON_AddItemToArray(cJSON* array, cJSON* item) {}
+inline cJSON* cJSON_AddNumberToObject(cJSON* object, const char* name, double number) { return nullptr; }
+inline cJSON* cJSON_AddStringToObject(cJSON* object, const char* name, const char* string) { return nullptr; }
+inline cJSON* cJSON_GetObjectItem(const cJSON* object, const char* name) { return nullptr; }
+inline bool cJSON_IsNumber(const cJSON* item) { return false; }
+inline bool cJSON_IsString(const cJSON* item) { return false; }
+inline void cJSON_Delete(cJSON* item) {}
+
+#endif // CJSON_H
@@ -0,0 +1,6 @@
+#ifndef I2S_STD_H
+#define I2S_STD_H
+
+#include "i2s_common.h"
+
+#endif // I2S_STD_H
@@ -0,0 +1,23 @@
+#ifndef ESP_ERR_H
+#define ESP_ERR_H
+
+#include <cstdio>
+#include <cstdlib>
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+
+#define ESP_ERROR_CHECK(x) do { \
+        esp_err_t err_rc = (x); \
+        if (err_rc != ESP_OK) { \
+            fprintf(stderr, "%s:%d: ESP_ERROR_CHECK(%s) failed: %d\n", __FILE__, __LINE__, #x, err_rc); \
+            abort(); \
+        } \
+    } while (0)
+
+#endif // ESP_ERR_H
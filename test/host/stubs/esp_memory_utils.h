@@ -0,0 +1,16 @@
+#ifndef ESP_MEMORY_UTILS_H
+#define ESP_MEMORY_UTILS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Host build: nothing is mapped from flash, unless a benchmark declares a buffer of its own as such
+inline const void* host_drom_start = nullptr;
+inline size_t host_drom_size = 0;
+
+inline bool esp_ptr_in_drom(const void* ptr) {
+    auto start = (uintptr_t)host_drom_start;
+    return start != 0 && (uintptr_t)ptr >= start && (uintptr_t)ptr < start + host_drom_size;
+}
+
+#endif // ESP_MEMORY_UTILS_H
@@ -0,0 +1,12 @@
+#ifndef ESP_RANDOM_H
+#define ESP_RANDOM_H
+
+#include <cstdint>
+#include <random>
+
+inline uint32_t esp_random() {
+    static std::random_device device;
+    return device();
+}
+
+#endif // ESP_RANDOM_H
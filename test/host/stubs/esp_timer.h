@@ -0,0 +1,160 @@
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "esp_err.h"
+
+/*
+ * Host build: the time is the monotonic clock, like the time since boot on the device. Timer
+ * callbacks run one at a time on a single thread, like the esp_timer task.
+ */
+typedef void (*esp_timer_cb_t)(void* arg);
+
+typedef enum {
+    ESP_TIMER_TASK,
+    ESP_TIMER_ISR,
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void* arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char* name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    int64_t expiry_us = -1;     // -1 while the timer is not armed
+    int64_t period_us = 0;      // 0 for a one-shot
+};
+typedef esp_timer* esp_timer_handle_t;
+
+inline int64_t esp_timer_get_time() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+class HostTimerService {
+public:
+    static HostTimerService& GetInstance() {
+        static HostTimerService instance;
+        return instance;
+    }
+
+    std::mutex mutex;
+    std::vector<esp_timer*> timers;
+
+    void Arm(esp_timer* timer, int64_t timeout_us, int64_t period_us) {
+        timer->expiry_us = esp_timer_get_time() + timeout_us;
+        timer->period_us = period_us;
+        cv_.notify_all();
+    }
+
+private:
+    std::condition_variable cv_;
+    bool stopped_ = false;
+    std::thread thread_;
+
+    HostTimerService() : thread_([this]() { Run(); }) {}
+
+    ~HostTimerService() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    void Run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopped_) {
+            esp_timer* next = nullptr;
+            for (auto timer : timers) {
+                if (timer->expiry_us >= 0 && (next == nullptr || timer->expiry_us < next->expiry_us)) {
+                    next = timer;
+                }
+            }
+            if (next == nullptr) {
+                cv_.wait(lock);
+                continue;
+            }
+            int64_t now = esp_timer_get_time();
+            if (next->expiry_us > now) {
+                cv_.wait_for(lock, std::chrono::microseconds(next->expiry_us - now));
+                continue;
+            }
+            // A periodic timer that fell behind skips the missed periods
+            next->expiry_us = next->period_us > 0 ? std::max(next->expiry_us + next->period_us, now) : -1;
+            auto callback = next->callback;
+            auto arg = next->arg;
+            lock.unlock();
+            callback(arg);
+            lock.lock();
+        }
+    }
+};
+
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    auto& service = HostTimerService::GetInstance();
+    std::lock_guard<std::mutex> lock(service.mutex);
+    *handle = new esp_timer{args->callback, args->arg};
+    service.timers.push_back(*handle);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    auto& service = HostTimerService::GetInstance();
+    std::lock_guard<std::mutex> lock(service.mutex);
+    if (timer->expiry_us >= 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    service.Arm(timer, timeout_us, 0);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+    auto& service = HostTimerService::GetInstance();
+    std::lock_guard<std::mutex> lock(service.mutex);
+    if (timer->expiry_us >= 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    service.Arm(timer, period_us, period_us);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    auto& service = HostTimerService::GetInstance();
+    std::lock_guard<std::mutex> lock(service.mutex);
+    if (timer->expiry_us < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->expiry_us = -1;
+    return ESP_OK;
+}
+
+inline bool esp_timer_is_active(esp_timer_handle_t timer) {
+    auto& service = HostTimerService::GetInstance();
+    std::lock_guard<std::mutex> lock(service.mutex);
+    return timer->expiry_us >= 0;
+}
+
+// Like on the device, the caller makes sure the callback is not running
+inline esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    auto& service = HostTimerService::GetInstance();
+    std::lock_guard<std::mutex> lock(service.mutex);
+    service.timers.erase(std::remove(service.timers.begin(), service.timers.end(), timer), service.timers.end());
+    delete timer;
+    return ESP_OK;
+}
+
+#endif // ESP_TIMER_H
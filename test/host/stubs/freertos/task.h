@@ -0,0 +1,130 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <time.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "FreeRTOS.h"
+
+/*
+ * Host build: every task is a thread, priorities and core affinity are ignored. vTaskDelete(NULL)
+ * ends the calling task, deleting another task is not supported. HostJoinTasks() waits for the
+ * tasks to end, the CPU time each one used is kept for the benchmarks to report.
+ */
+typedef void (*TaskFunction_t)(void*);
+typedef uint8_t StackType_t;
+struct StaticTask_t {
+    uint8_t reserved;
+};
+
+#define tskNO_AFFINITY 0x7fffffff
+
+struct HostTask {
+    std::string name;
+    uint32_t stack_depth = 0;
+    std::thread thread;
+    int64_t cpu_us = 0;     // Set when the task ends
+};
+typedef HostTask* TaskHandle_t;
+
+// Thrown by vTaskDelete(NULL), caught where the task thread starts
+struct HostTaskDeleted {};
+
+inline std::mutex host_tasks_mutex;
+inline std::list<HostTask> host_tasks;
+inline thread_local HostTask* host_current_task = nullptr;
+
+inline int64_t HostThreadCpuTimeUs() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+inline TaskHandle_t HostStartTask(TaskFunction_t function, const char* name, uint32_t stack_depth, void* arg) {
+    std::lock_guard<std::mutex> lock(host_tasks_mutex);
+    HostTask* task = &host_tasks.emplace_back();
+    task->name = name;
+    task->stack_depth = stack_depth;
+    task->thread = std::thread([task, function, arg]() {
+        host_current_task = task;
+        try {
+            function(arg);
+        } catch (const HostTaskDeleted&) {
+        }
+        task->cpu_us = HostThreadCpuTimeUs();
+    });
+    return task;
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth,
+    void* arg, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    (void)priority;
+    (void)core;
+    TaskHandle_t task = HostStartTask(function, name, stack_depth, arg);
+    if (handle != nullptr) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth,
+    void* arg, UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(function, name, stack_depth, arg, priority, handle, tskNO_AFFINITY);
+}
+
+inline TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char* name, uint32_t stack_depth,
+    void* arg, UBaseType_t priority, StackType_t* stack, StaticTask_t* buffer) {
+    (void)priority;
+    (void)stack;
+    (void)buffer;
+    return HostStartTask(function, name, stack_depth, arg);
+}
+
+inline void vTaskDelete(TaskHandle_t task) {
+    if (task == nullptr || task == host_current_task) {
+        throw HostTaskDeleted();
+    }
+    fprintf(stderr, "vTaskDelete: deleting task %s from another task is not supported on the host\n",
+        task->name.c_str());
+    abort();
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+inline TickType_t xTaskGetTickCount() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+}
+
+// Host threads have plenty of stack, report the whole depth as unused
+inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    if (task == nullptr) {
+        task = host_current_task;
+    }
+    return task != nullptr ? task->stack_depth : 0;
+}
+
+// Waits for every task started so far to end, call it after the code under test told them to stop
+inline void HostJoinTasks() {
+    std::unique_lock<std::mutex> lock(host_tasks_mutex);
+    for (auto& task : host_tasks) {
+        if (task.thread.joinable()) {
+            // A task ending may still start another one, the list keeps its elements in place
+            lock.unlock();
+            task.thread.join();
+            lock.lock();
+        }
+    }
+}
+
+#endif // TASK_H
@@ -0,0 +1,37 @@
+#ifndef HOST_CODEC_LOAD_H
+#define HOST_CODEC_LOAD_H
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+/*
+ * Host build: the stand-in codecs cost next to nothing. A benchmark can charge them what Opus
+ * costs on the device, as a share of the frame duration. The time is slept rather than spun, so
+ * each codec task behaves as if it had its own core, which is how the encode and decode tasks are
+ * placed. With shared_core set, encode and decode take turns on one core, the way a single task
+ * running both loops served them.
+ */
+struct HostCodecLoad {
+    int encode_percent = 0;
+    int decode_percent = 0;
+    bool shared_core = false;
+    std::mutex core;
+};
+
+inline HostCodecLoad host_codec_load;
+
+inline void HostCodecWork(int percent, int duration_ms) {
+    if (percent <= 0) {
+        return;
+    }
+    auto work = std::chrono::microseconds(duration_ms * 10 * percent);
+    if (host_codec_load.shared_core) {
+        std::lock_guard<std::mutex> lock(host_codec_load.core);
+        std::this_thread::sleep_for(work);
+    } else {
+        std::this_thread::sleep_for(work);
+    }
+}
+
+#endif // HOST_CODEC_LOAD_H
@@ -0,0 +1,51 @@
+#ifndef MBEDTLS_AES_H
+#define MBEDTLS_AES_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include <openssl/aes.h>
+
+/*
+ * Host build: the mbedTLS AES calls the code under test makes, on OpenSSL's AES block function.
+ * The key is expanded once by setkey like on the device, CTR mode follows mbedtls_aes_crypt_ctr():
+ * the whole 16 byte counter block is incremented big-endian, and nc_off and stream_block carry a
+ * partial block across calls. Link with OpenSSL's libcrypto.
+ */
+#define MBEDTLS_ERR_AES_INVALID_KEY_LENGTH -0x0020
+
+struct mbedtls_aes_context {
+    AES_KEY key;
+};
+
+inline void mbedtls_aes_init(mbedtls_aes_context* ctx) {
+    *ctx = mbedtls_aes_context();
+}
+
+inline void mbedtls_aes_free(mbedtls_aes_context* ctx) {
+    *ctx = mbedtls_aes_context();
+}
+
+inline int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits) {
+    return AES_set_encrypt_key(key, keybits, &ctx->key) == 0 ? 0 : MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+}
+
+inline int mbedtls_aes_crypt_ctr(mbedtls_aes_context* ctx, size_t length, size_t* nc_off,
+    unsigned char nonce_counter[16], unsigned char stream_block[16], const unsigned char* input,
+    unsigned char* output) {
+    size_t n = *nc_off;
+    for (size_t i = 0; i < length; i++) {
+        if (n == 0) {
+            AES_encrypt(nonce_counter, stream_block, &ctx->key);
+            for (int j = 15; j >= 0 && ++nonce_counter[j] == 0; j--) {
+            }
+        }
+        output[i] = input[i] ^ stream_block[n];
+        n = (n + 1) & 0x0f;
+    }
+    *nc_off = n;
+    return 0;
+}
+
+#endif // MBEDTLS_AES_H
@@ -0,0 +1,23 @@
+#ifndef MODEL_PATH_H
+#define MODEL_PATH_H
+
+// Host build: there are no speech models, every lookup comes back empty
+typedef struct {
+    char** model_name;
+    char** model_data;
+    int num;
+} srmodel_list_t;
+
+#define ESP_WN_PREFIX "wn"
+#define ESP_MN_PREFIX "mn"
+#define ESP_NSNET_PREFIX "nsnet"
+#define ESP_VADN_PREFIX "vadnet"
+
+inline char* esp_srmodel_filter(srmodel_list_t* models, const char* keyword1, const char* keyword2) {
+    (void)models;
+    (void)keyword1;
+    (void)keyword2;
+    return nullptr;
+}
+
+#endif // MODEL_PATH_H
@@ -0,0 +1,49 @@
+#ifndef OPUS_DECODER_H
+#define OPUS_DECODER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "host_codec_load.h"
+
+// Host build: decodes the G.711 mu-law frames of the host OpusEncoderWrapper, concealment is silence.
+// host_codec_load can make it as slow as the real one.
+class OpusDecoderWrapper {
+public:
+    OpusDecoderWrapper(int sample_rate, int channels, int duration_ms = 60)
+        : sample_rate_(sample_rate), duration_ms_(duration_ms),
+          frame_size_(sample_rate / 1000 * channels * duration_ms) {}
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+
+    void ResetState() {}
+
+    // An empty packet conceals one frame
+    bool Decode(std::vector<uint8_t>&& opus, std::vector<int16_t>& pcm) {
+        HostCodecWork(host_codec_load.decode_percent, duration_ms_);
+        if (opus.empty()) {
+            pcm.assign(frame_size_, 0);
+            return true;
+        }
+        pcm.resize(opus.size());
+        for (size_t i = 0; i < opus.size(); i++) {
+            pcm[i] = UlawToLinear(opus[i]);
+        }
+        return true;
+    }
+
+private:
+    int sample_rate_;
+    int duration_ms_;
+    int frame_size_;
+
+    static int16_t UlawToLinear(uint8_t ulaw) {
+        ulaw = ~ulaw;
+        int exponent = (ulaw >> 4) & 0x07;
+        int sample = ((((ulaw & 0x0f) << 3) + 0x84) << exponent) - 0x84;
+        return (ulaw & 0x80) ? -sample : sample;
+    }
+};
+
+#endif // OPUS_DECODER_H
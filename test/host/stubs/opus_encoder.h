@@ -0,0 +1,69 @@
+#ifndef OPUS_ENCODER_H
+#define OPUS_ENCODER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "host_codec_load.h"
+
+/*
+ * Host build: there is no libopus, a frame is coded as G.711 mu-law instead, one byte per sample.
+ * Good enough to follow audio through the pipeline, and like the real wrapper it does not allocate
+ * once the output vector has its capacity. host_codec_load can make it as slow as the real one.
+ */
+class OpusEncoderWrapper {
+public:
+    OpusEncoderWrapper(int sample_rate, int channels, int duration_ms = 60)
+        : sample_rate_(sample_rate), duration_ms_(duration_ms),
+          frame_size_(sample_rate / 1000 * channels * duration_ms) {}
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+    inline int complexity() const { return complexity_; }
+
+    void SetDtx(bool enable) { dtx_ = enable; }
+    void SetComplexity(int complexity) { complexity_ = complexity; }
+    bool IsBufferEmpty() const { return true; }
+    void ResetState() {}
+
+    // Only whole frames are encoded, the real wrapper would buffer the rest
+    bool Encode(std::vector<int16_t>&& pcm, std::vector<uint8_t>& opus) {
+        if ((int)pcm.size() != frame_size_) {
+            return false;
+        }
+        HostCodecWork(host_codec_load.encode_percent, duration_ms_);
+        opus.resize(pcm.size());
+        for (size_t i = 0; i < pcm.size(); i++) {
+            opus[i] = LinearToUlaw(pcm[i]);
+        }
+        return true;
+    }
+
+private:
+    int sample_rate_;
+    int duration_ms_;
+    int frame_size_;
+    int complexity_ = 0;
+    bool dtx_ = false;
+
+    static uint8_t LinearToUlaw(int16_t pcm) {
+        int sample = pcm;
+        int sign = 0;
+        if (sample < 0) {
+            sign = 0x80;
+            sample = -sample;
+        }
+        if (sample > 32635) {
+            sample = 32635;
+        }
+        sample += 0x84;
+        int exponent = 7;
+        for (int mask = 0x4000; (sample & mask) == 0 && exponent > 0; mask >>= 1) {
+            exponent--;
+        }
+        int mantissa = (sample >> (exponent + 3)) & 0x0f;
+        return ~(sign | (exponent << 4) | mantissa);
+    }
+};
+
+#endif // OPUS_ENCODER_H
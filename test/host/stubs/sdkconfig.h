@@ -0,0 +1,12 @@
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+// Host build: the Kconfig defaults of a board without PSRAM, so no AFE processor and no server AEC
+#define CONFIG_OPUS_ENCODE_TASK_CORE 1
+#define CONFIG_OPUS_ENCODE_TASK_PRIORITY 2
+#define CONFIG_OPUS_ENCODE_MAX_COMPLEXITY 0
+#define CONFIG_OPUS_DECODE_TASK_CORE -1
+#define CONFIG_OPUS_DECODE_TASK_PRIORITY 3
+#define CONFIG_SPIFFS_BASE_PATH "/tmp"
+
+#endif // SDKCONFIG_H
@@ -0,0 +1,23 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <cstdint>
+#include <string>
+
+// Host build: nothing is stored, every read returns its default
+class Settings {
+public:
+    Settings(const std::string& ns, bool read_write = false) {
+        (void)ns;
+        (void)read_write;
+    }
+
+    std::string GetString(const std::string& key, const std::string& default_value = "") { return default_value; }
+    void SetString(const std::string& key, const std::string& value) {}
+    int32_t GetInt(const std::string& key, int32_t default_value = 0) { return default_value; }
+    void SetInt(const std::string& key, int32_t value) {}
+    bool GetBool(const std::string& key, bool default_value = false) { return default_value; }
+    void SetBool(const std::string& key, bool value) {}
+};
+
+#endif // SETTINGS_H
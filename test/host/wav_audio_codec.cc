@@ -0,0 +1,150 @@
+#include "wav_audio_codec.h"
+
+#include <esp_timer.h>
+
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+static void SleepUntil(int64_t time_us) {
+    int64_t wait_us = time_us - esp_timer_get_time();
+    if (wait_us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(wait_us));
+    }
+}
+
+WavAudioCodec::WavAudioCodec(int input_sample_rate, int output_sample_rate) {
+    duplex_ = true;
+    input_reference_ = true;
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+    input_channels_ = kCaptureSlots;
+    output_channels_ = 1;
+}
+
+bool WavAudioCodec::LoadInput(const char* path) {
+    int sample_rate = 0;
+    if (!ReadWav(path, input_, sample_rate)) {
+        return false;
+    }
+    if (sample_rate != input_sample_rate_) {
+        fprintf(stderr, "%s: %d Hz, the mic runs at %d Hz\n", path, sample_rate, input_sample_rate_);
+        return false;
+    }
+    return true;
+}
+
+bool WavAudioCodec::SaveOutput(const char* path) const {
+    return WriteWav(path, output_, output_sample_rate_);
+}
+
+int WavAudioCodec::Read(int16_t* dest, int samples) {
+    int64_t now = esp_timer_get_time();
+    if (input_start_us_ < 0) {
+        input_start_us_ = now;
+    }
+    size_t frames = samples / kCaptureSlots;
+    size_t position = input_position_;
+    SleepUntil(input_start_us_ + (int64_t)(position + frames) * 1000000 / input_sample_rate_);
+
+    memset(dest, 0, samples * sizeof(int16_t));
+    for (size_t i = 0; i < frames && position + i < input_.size(); i++) {
+        dest[i * kCaptureSlots] = input_[position + i];
+    }
+    input_position_ = position + frames;
+    return samples;
+}
+
+int WavAudioCodec::Write(const int16_t* data, int samples) {
+    int64_t now = esp_timer_get_time();
+    if (output_start_us_ < 0) {
+        output_start_us_ = now;
+    }
+
+    /*
+     * The DMA played everything written so far and then silence until now. It sends whole
+     * descriptors, so the block goes in after the one playing now
+     */
+    size_t played = (now - output_start_us_) * output_sample_rate_ / 1000000;
+    if (played > output_.size()) {
+        if (!output_.empty()) {
+            output_underruns_++;
+        }
+        size_t descriptors = (played + AUDIO_CODEC_DMA_FRAME_NUM - 1) / AUDIO_CODEC_DMA_FRAME_NUM;
+        output_.resize(descriptors * AUDIO_CODEC_DMA_FRAME_NUM, 0);
+    }
+
+    /* Wait until the DMA ring has room for the whole block */
+    int64_t ring = AUDIO_CODEC_DMA_DESC_NUM * AUDIO_CODEC_DMA_FRAME_NUM;
+    int64_t room_at = (int64_t)output_.size() + samples - ring;
+    if (room_at > 0) {
+        SleepUntil(output_start_us_ + room_at * 1000000 / output_sample_rate_);
+    }
+    output_.insert(output_.end(), data, data + samples);
+    return samples;
+}
+
+struct WavHeader {
+    char riff[4];
+    uint32_t riff_size;
+    char wave[4];
+    char fmt[4];
+    uint32_t fmt_size;
+    uint16_t format;
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+} __attribute__((packed));
+
+bool WavAudioCodec::ReadWav(const char* path, std::vector<int16_t>& samples, int& sample_rate) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+    WavHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.riff, "RIFF", 4) == 0 &&
+        memcmp(header.wave, "WAVE", 4) == 0 && header.format == 1 && header.channels == 1 &&
+        header.bits_per_sample == 16;
+    if (ok) {
+        fseek(file, (long)(20 + header.fmt_size), SEEK_SET);
+        /* Skip the chunks in front of the samples, e.g. LIST */
+        char id[4];
+        uint32_t size;
+        ok = false;
+        while (fread(id, 4, 1, file) == 1 && fread(&size, 4, 1, file) == 1) {
+            if (memcmp(id, "data", 4) == 0) {
+                samples.resize(size / 2);
+                ok = fread(samples.data(), 2, samples.size(), file) == samples.size();
+                break;
+            }
+            fseek(file, size + (size & 1), SEEK_CUR);
+        }
+    }
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "%s is not a mono 16-bit PCM WAV file\n", path);
+        return false;
+    }
+    sample_rate = header.sample_rate;
+    return true;
+}
+
+bool WavAudioCodec::WriteWav(const char* path, const std::vector<int16_t>& samples, int sample_rate) {
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "Failed to create %s\n", path);
+        return false;
+    }
+    uint32_t data_size = samples.size() * 2;
+    WavHeader header = {
+        {'R', 'I', 'F', 'F'}, 36 + data_size, {'W', 'A', 'V', 'E'}, {'f', 'm', 't', ' '}, 16,
+        1, 1, (uint32_t)sample_rate, (uint32_t)sample_rate * 2, 2, 16,
+    };
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite("data", 4, 1, file) == 1 &&
+        fwrite(&data_size, 4, 1, file) == 1 && fwrite(samples.data(), 2, samples.size(), file) == samples.size();
+    fclose(file);
+    return ok;
+}
@@ -0,0 +1,60 @@
+#ifndef WAV_AUDIO_CODEC_H
+#define WAV_AUDIO_CODEC_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "audio_codec.h"
+
+/*
+ * Host stand-in for the I2S codec of a board: the mic plays a mono 16-bit WAV file (or samples set
+ * directly) and the speaker is recorded, both paced in real time like the DMA would pace them.
+ *
+ * The input fills capture slot 0 of the 4 interleaved slots AudioService reads, the other slots
+ * stay silent. Read() returns once the requested frames would have been captured, so sample i of
+ * the input was captured at input_start_us() + i / input_sample_rate.
+ *
+ * Write() blocks while the DMA ring of AUDIO_CODEC_DMA_DESC_NUM * AUDIO_CODEC_DMA_FRAME_NUM frames
+ * is full. When the writer falls behind the DMA plays silence up to the end of the descriptor that
+ * is playing, which is recorded as well, so sample i of the output was played at
+ * output_start_us() + i / output_sample_rate.
+ */
+class WavAudioCodec : public AudioCodec {
+public:
+    WavAudioCodec(int input_sample_rate, int output_sample_rate);
+
+    // The input must be mono 16-bit PCM at the input sample rate, after it ends the mic is silent
+    bool LoadInput(const char* path);
+    void SetInput(std::vector<int16_t>&& samples) { input_ = std::move(samples); }
+    // Recording past the reserved samples allocates, the allocation tests reserve enough up front
+    void ReserveOutput(size_t samples) { output_.reserve(samples); }
+    bool SaveOutput(const char* path) const;
+
+    const std::vector<int16_t>& input() const { return input_; }
+    const std::vector<int16_t>& output() const { return output_; }
+    int64_t input_start_us() const { return input_start_us_; }
+    int64_t output_start_us() const { return output_start_us_; }
+    size_t input_position() const { return input_position_; }
+    // Times the DMA ran dry while the output was playing
+    uint32_t output_underruns() const { return output_underruns_; }
+
+    static bool ReadWav(const char* path, std::vector<int16_t>& samples, int& sample_rate);
+    static bool WriteWav(const char* path, const std::vector<int16_t>& samples, int sample_rate);
+
+protected:
+    int Read(int16_t* dest, int samples) override;
+    int Write(const int16_t* data, int samples) override;
+
+private:
+    static constexpr int kCaptureSlots = 4;
+
+    std::vector<int16_t> input_;
+    std::vector<int16_t> output_;
+    std::atomic<int64_t> input_start_us_ = -1;
+    std::atomic<int64_t> output_start_us_ = -1;
+    std::atomic<size_t> input_position_ = 0;
+    std::atomic<uint32_t> output_underruns_ = 0;
+};
+
+#endif // WAV_AUDIO_CODEC_H